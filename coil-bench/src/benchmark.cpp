@@ -0,0 +1,90 @@
+#include <algorithm>
+
+#include "benchmark.h"
+
+namespace coil {
+
+// Create a benchmark writing its results to the given stream.
+// Only the benchmarks whose name contains the filter are run,
+// quick mode reduces the iterations and the template sizes
+Benchmark::Benchmark(std::ostream& output, std::string filter, bool quick) :
+    m_output(output),
+    m_filter(std::move(filter)),
+    m_quick(quick)
+{
+}
+
+// Return true if the benchmark with the given name must be run
+bool Benchmark::isEnabled(std::string_view name) const
+{
+    return name.find(m_filter) != std::string_view::npos;
+}
+
+// Return true if any of the benchmarks with the given names
+// must be run
+bool Benchmark::isAnyEnabled(
+    std::initializer_list<std::string_view> names
+) const {
+    for (auto name : names) {
+        if (isEnabled(name))
+            return true;
+    }
+
+    return false;
+}
+
+// Return the given iteration count, reduced in quick mode
+size_t Benchmark::iterations(size_t count) const
+{
+    if (!m_quick)
+        return count;
+
+    return std::max<size_t>(1, count / 10);
+}
+
+// Write the result of a measurement, the throughput is computed
+// from the operation count and the elapsed time
+void Benchmark::report(
+    std::string_view name,
+    nlohmann::json parameters,
+    std::vector<std::chrono::nanoseconds> samples,
+    size_t operations,
+    std::chrono::nanoseconds elapsed
+) {
+    nlohmann::json result = nlohmann::json::object();
+    result["benchmark"] = name;
+    result["parameters"] = std::move(parameters);
+    result["iterations"] = operations;
+
+    if (!samples.empty()) {
+        std::sort(samples.begin(), samples.end());
+
+        std::chrono::nanoseconds total(0);
+
+        for (auto sample : samples) {
+            total += sample;
+        }
+
+        // Return the sample at the given fraction of the sorted samples
+        auto percentile = [&](double fraction) {
+            size_t index = static_cast<size_t>(fraction * (samples.size() - 1));
+            return samples[index].count();
+        };
+
+        result["mean_ns"] = total.count() / samples.size();
+        result["min_ns"] = samples.front().count();
+        result["p50_ns"] = percentile(0.50);
+        result["p90_ns"] = percentile(0.90);
+        result["p99_ns"] = percentile(0.99);
+        result["max_ns"] = samples.back().count();
+    }
+
+    if (elapsed.count() > 0) {
+        result["ops_per_sec"] = operations * 1e9 / elapsed.count();
+    }
+
+    // Flushed on every line so a crash keeps the previous results
+    m_output << result.dump() << std::endl;
+}
+
+} // namespace coil
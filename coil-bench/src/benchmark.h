@@ -0,0 +1,197 @@
+#ifndef COIL_BENCHMARK_H
+#define COIL_BENCHMARK_H
+
+#include <chrono>
+#include <cstddef>
+#include <initializer_list>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace coil {
+
+// Run the benchmarks and write one json object per measurement on
+// the output stream, one line each, so the results can be compared
+// between builds by a script
+class Benchmark {
+public:
+    // Create a benchmark writing its results to the given stream.
+    // Only the benchmarks whose name contains the filter are run,
+    // quick mode reduces the iterations and the template sizes
+    Benchmark(std::ostream& output, std::string filter, bool quick);
+
+    // Return true if the benchmark with the given name must be run
+    bool isEnabled(std::string_view name) const;
+
+    // Return true if any of the benchmarks with the given names
+    // must be run
+    bool isAnyEnabled(std::initializer_list<std::string_view> names) const;
+
+    // Return true if quick mode is enabled
+    bool isQuick() const { return m_quick; }
+
+    // Return the given iteration count, reduced in quick mode
+    size_t iterations(size_t count) const;
+
+    // Run the operation the given number of times timing each call for
+    // the latency, then the same number of times without timing each
+    // call for the throughput. The parameters are added to the result.
+    // Nothing is run if the benchmark isn't enabled
+    template <typename Operation>
+    void measure(
+        std::string_view name,
+        nlohmann::json parameters,
+        size_t iterations,
+        Operation&& operation
+    );
+
+    // Run the operation the given number of times on each of the threads,
+    // all the threads start together. The operation receive the index of
+    // its thread. The throughput is the total of all the threads.
+    // Nothing is run if the benchmark isn't enabled
+    template <typename Operation>
+    void measureConcurrent(
+        std::string_view name,
+        nlohmann::json parameters,
+        size_t thread_count,
+        size_t iterations,
+        Operation&& operation
+    );
+
+    // Write the result of a measurement, the throughput is computed
+    // from the operation count and the elapsed time
+    void report(
+        std::string_view name,
+        nlohmann::json parameters,
+        std::vector<std::chrono::nanoseconds> samples,
+        size_t operations,
+        std::chrono::nanoseconds elapsed
+    );
+
+private:
+    // Stream receiving the results
+    std::ostream& m_output;
+
+    // Substring the benchmark names must contain to be run
+    std::string m_filter;
+
+    // Store true if quick mode is enabled
+    bool m_quick;
+};
+
+// Run the operation the given number of times timing each call for
+// the latency, then the same number of times without timing each
+// call for the throughput. The parameters are added to the result.
+// Nothing is run if the benchmark isn't enabled
+template <typename Operation>
+void Benchmark::measure(
+    std::string_view name,
+    nlohmann::json parameters,
+    size_t iterations,
+    Operation&& operation
+) {
+    using Clock = std::chrono::steady_clock;
+
+    if (!isEnabled(name))
+        return;
+
+    std::vector<std::chrono::nanoseconds> samples;
+    samples.reserve(iterations);
+
+    for (size_t i = 0; i < iterations; i++) {
+        auto start = Clock::now();
+        operation();
+        samples.push_back(Clock::now() - start);
+    }
+
+    // Reading the clock costs about as much as a get, the throughput
+    // is measured separately
+    auto start = Clock::now();
+
+    for (size_t i = 0; i < iterations; i++) {
+        operation();
+    }
+
+    report(
+        name,
+        std::move(parameters),
+        std::move(samples),
+        iterations,
+        Clock::now() - start
+    );
+}
+
+// Run the operation the given number of times on each of the threads,
+// all the threads start together. The operation receive the index of
+// its thread. The throughput is the total of all the threads.
+// Nothing is run if the benchmark isn't enabled
+template <typename Operation>
+void Benchmark::measureConcurrent(
+    std::string_view name,
+    nlohmann::json parameters,
+    size_t thread_count,
+    size_t iterations,
+    Operation&& operation
+) {
+    using Clock = std::chrono::steady_clock;
+
+    if (!isEnabled(name))
+        return;
+
+    std::vector<std::vector<std::chrono::nanoseconds>> thread_samples(
+        thread_count
+    );
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+
+    // The threads wait for the start time, they are all created by then
+    auto start = Clock::now() + std::chrono::milliseconds(10);
+
+    for (size_t index = 0; index < thread_count; index++) {
+        threads.emplace_back([&, index]() {
+            std::vector<std::chrono::nanoseconds>& samples =
+                thread_samples[index];
+            samples.reserve(iterations);
+
+            std::this_thread::sleep_until(start);
+
+            for (size_t i = 0; i < iterations; i++) {
+                auto operation_start = Clock::now();
+                operation(index);
+                samples.push_back(Clock::now() - operation_start);
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto elapsed = Clock::now() - start;
+
+    std::vector<std::chrono::nanoseconds> samples;
+    samples.reserve(thread_count * iterations);
+
+    for (const auto& thread_sample : thread_samples) {
+        samples.insert(samples.end(), thread_sample.begin(),
+            thread_sample.end());
+    }
+
+    parameters["threads"] = thread_count;
+
+    report(
+        name,
+        std::move(parameters),
+        std::move(samples),
+        thread_count * iterations,
+        elapsed
+    );
+}
+
+} // namespace coil
+
+#endif
@@ -0,0 +1,238 @@
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+
+#include <sdbus-c++/IConnection.h>
+#include <sdbus-c++/IProxy.h>
+#include <sdbus-c++/Types.h>
+
+#include "spdlog/spdlog.h"
+
+#include "dbusBench.h"
+#include "dbusServer.h"
+#include "syntheticConfig.h"
+
+namespace coil {
+
+// Template size of the D-Bus benchmarks
+constexpr size_t c_dbus_template_size = 1000;
+
+// Number of settings written by a SetMany call
+constexpr size_t c_set_many_count = 10;
+
+// Private session bus run by a dbus-daemon child, the benchmarks
+// don't disturb the user session and don't need the system policy
+class PrivateBus {
+public:
+    // Start the bus daemon
+    // Return false if the daemon couldn't be started
+    bool start()
+    {
+        FILE* output = popen(
+            "dbus-daemon --session --fork --print-address=1 --print-pid=1 "
+            "2>/dev/null",
+            "r"
+        );
+
+        if (output == nullptr)
+            return false;
+
+        char address[512] = {};
+        char pid[32] = {};
+
+        bool started =
+            fgets(address, sizeof(address), output) != nullptr &&
+            fgets(pid, sizeof(pid), output) != nullptr;
+
+        pclose(output);
+
+        if (!started)
+            return false;
+
+        m_address = address;
+        m_address.erase(m_address.find_last_not_of('\n') + 1);
+        m_pid = std::atoi(pid);
+
+        return m_pid > 0 && !m_address.empty();
+    }
+
+    ~PrivateBus()
+    {
+        if (m_pid > 0)
+            kill(m_pid, SIGTERM);
+    }
+
+    // Return the address of the bus
+    const std::string& getAddress() const { return m_address; }
+
+private:
+    std::string m_address;
+    pid_t m_pid = 0;
+};
+
+// Return a proxy of the object of the given category
+static std::unique_ptr<sdbus::IProxy> createCategoryProxy(
+    sdbus::IConnection& connection,
+    std::string_view category
+) {
+    std::string object_path = c_dbus_root_object;
+    object_path += "/";
+    object_path += category;
+
+    return sdbus::createProxy(
+        connection,
+        sdbus::ServiceName{
+            std::string(c_dbus_service_name) + c_dbus_service_version
+        },
+        sdbus::ObjectPath{object_path}
+    );
+}
+
+// Run the end to end D-Bus benchmarks against a server on a private
+// bus, skipped if dbus-daemon isn't available
+void runDbusBenchmarks(Benchmark& benchmark)
+{
+    if (!benchmark.isAnyEnabled(
+        {"dbus_get", "dbus_set", "dbus_get_many", "dbus_set_many"}
+    )) {
+        return;
+    }
+
+    PrivateBus bus;
+
+    if (!bus.start()) {
+        spdlog::warn("dbus-daemon not available, skipping D-Bus benchmarks");
+        return;
+    }
+
+    // The server connects to the default bus, make it the private one
+    setenv("DBUS_SESSION_BUS_ADDRESS", bus.getAddress().c_str(), 1);
+    setenv("DBUS_STARTER_BUS_TYPE", "session", 1);
+
+    BenchDirectory directory;
+    std::filesystem::path base = directory.getPath() / "default.json";
+    std::filesystem::path user = directory.getPath() / "config.json";
+
+    writeTemplate(base, c_dbus_template_size);
+
+    // Every set writes the file, like the default daemon configuration
+    DbusServer server(
+        base, user, std::chrono::milliseconds(0), "", "", "", ""
+    );
+    std::thread server_thread([&]() { server.run(); });
+
+    sdbus::InterfaceName interface_name{
+        std::string(c_dbus_interface_name) + c_dbus_interface_version
+    };
+
+    auto connection = sdbus::createSessionBusConnection();
+
+    std::string category(settingPath(0).getCategory());
+    auto proxy = createCategoryProxy(*connection, category);
+    auto large_proxy = createCategoryProxy(
+        *connection,
+        largeArrayPath().getCategory()
+    );
+
+    auto root_proxy = sdbus::createProxy(
+        *connection,
+        sdbus::ServiceName{
+            std::string(c_dbus_service_name) + c_dbus_service_version
+        },
+        sdbus::ObjectPath{c_dbus_root_object}
+    );
+
+    std::string int_name(settingPath(0).getName());
+    std::string large_name(largeArrayPath().getName());
+
+    benchmark.measure(
+        "dbus_get",
+        {{"type", "Int"}},
+        benchmark.iterations(10000),
+        [&]() {
+            sdbus::Variant value =
+                proxy->getProperty(int_name).onInterface(interface_name);
+        }
+    );
+
+    benchmark.measure(
+        "dbus_get",
+        {{"type", "large ArrayString"}},
+        benchmark.iterations(1000),
+        [&]() {
+            sdbus::Variant value = large_proxy->getProperty(large_name)
+                .onInterface(interface_name);
+        }
+    );
+
+    // The property setter returns once the value is published, Flush
+    // waits for the queued write so a set is timed up to the file like
+    // SetMany and no write is left pending for the next benchmarks
+    int value = 0;
+
+    benchmark.measure(
+        "dbus_set",
+        {{"type", "Int"}},
+        benchmark.iterations(1000),
+        [&]() {
+            proxy->setProperty(int_name)
+                .onInterface(interface_name)
+                .toValue(value++);
+
+            root_proxy->callMethod("Flush").onInterface(interface_name);
+        }
+    );
+
+    benchmark.measure(
+        "dbus_get_many",
+        {{"settings", c_settings_per_category}},
+        benchmark.iterations(1000),
+        [&]() {
+            std::map<std::string, sdbus::Variant> values;
+
+            proxy->callMethod("GetMany")
+                .onInterface(interface_name)
+                .withArguments(std::vector<std::string>())
+                .storeResultsTo(values);
+        }
+    );
+
+    // The integer settings of the first category, SetMany returns
+    // once the file is written
+    std::vector<std::string> int_names;
+
+    for (size_t index = 0; int_names.size() < c_set_many_count;
+        index += c_type_count
+    ) {
+        int_names.emplace_back(settingPath(index).getName());
+    }
+
+    benchmark.measure(
+        "dbus_set_many",
+        {{"settings", c_set_many_count}},
+        benchmark.iterations(1000),
+        [&]() {
+            std::map<std::string, sdbus::Variant> values;
+
+            for (const auto& name : int_names) {
+                values.emplace(name, sdbus::Variant(value));
+            }
+
+            value++;
+
+            proxy->callMethod("SetMany")
+                .onInterface(interface_name)
+                .withArguments(values);
+        }
+    );
+
+    server.stop();
+    server_thread.join();
+}
+
+} // namespace coil
@@ -0,0 +1,14 @@
+#ifndef COIL_DBUS_BENCH_H
+#define COIL_DBUS_BENCH_H
+
+#include "benchmark.h"
+
+namespace coil {
+
+// Run the end to end D-Bus benchmarks against a server on a private
+// bus, skipped if dbus-daemon isn't available
+void runDbusBenchmarks(Benchmark& benchmark);
+
+} // namespace coil
+
+#endif
@@ -0,0 +1,59 @@
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+
+#include "benchmark.h"
+#include "dbusBench.h"
+#include "parserBench.h"
+
+// Print the command usage
+static void printUsage(const char* name)
+{
+    std::cerr
+        << "Usage: " << name << " [-q] [-f filter]\n"
+        << "  -q         quick run with fewer iterations\n"
+        << "  -f filter  run the benchmarks whose name contains filter\n"
+        << "The results are written to stdout, one json object per line\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    bool quick = false;
+
+    int option;
+
+    while ((option = getopt(argc, argv, "qf:h")) != -1) {
+        switch (option) {
+            case 'q':
+                quick = true;
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            default:
+                printUsage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    // Keep stdout for the results, only the errors are logged
+    spdlog::set_default_logger(spdlog::stderr_color_mt("coil-bench"));
+    spdlog::set_level(spdlog::level::err);
+
+    coil::Benchmark benchmark(std::cout, filter, quick);
+
+    try {
+        coil::runParserBenchmarks(benchmark);
+        coil::runDbusBenchmarks(benchmark);
+    } catch (std::exception& e) {
+        spdlog::error("Benchmark failed: {}", e.what());
+
+        return 1;
+    }
+
+    return 0;
+}
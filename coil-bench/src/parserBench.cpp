@@ -0,0 +1,425 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+#include "configParser.h"
+#include "parserBench.h"
+#include "syntheticConfig.h"
+
+namespace coil {
+
+// Template sizes of the parsing benchmarks
+constexpr size_t c_template_sizes[] = {10, 100, 1000, 10000, 100000};
+// Largest template size used in quick mode
+constexpr size_t c_quick_template_size = 10000;
+
+// Template size of the get and set benchmarks
+constexpr size_t c_access_template_size = 1000;
+
+// Write delay keeping the delayed writes out of the measurements
+constexpr std::chrono::milliseconds c_long_write_delay(60000);
+
+// Prevent the compiler from optimizing away the computation
+// of the given value
+template <typename Type>
+static void keepValue(const Type& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Return a value of the same type different from the given one, used
+// to make every set a real change
+template <typename Type>
+static Type otherValue(const Type& value)
+{
+    if constexpr (std::is_same_v<Type, bool>) {
+        return !value;
+    } else if constexpr (std::is_arithmetic_v<Type>) {
+        return value + 1;
+    } else if constexpr (std::is_same_v<Type, std::string>) {
+        return value + "x";
+    } else {
+        Type other = value;
+        other.push_back(other.front());
+
+        return other;
+    }
+}
+
+// Return the name of the setting type used in the results
+static std::string typeName(ConfigParser::ConfigType type)
+{
+    return std::string(ConfigParser::configTypeStr(type));
+}
+
+// Return the template sizes of the parsing benchmarks
+static std::vector<size_t> templateSizes(const Benchmark& benchmark)
+{
+    std::vector<size_t> sizes;
+
+    for (size_t size : c_template_sizes) {
+        if (!benchmark.isQuick() || size <= c_quick_template_size)
+            sizes.push_back(size);
+    }
+
+    return sizes;
+}
+
+// Return the number of parses of a template of the given size,
+// the large templates are parsed fewer times
+static size_t parseIterations(const Benchmark& benchmark, size_t size)
+{
+    return benchmark.iterations(std::clamp<size_t>(100000 / size, 5, 200));
+}
+
+// Measure the parse of the base template without the cache, then
+// loaded from the cache
+static void benchmarkBaseParse(Benchmark& benchmark)
+{
+    for (size_t size : templateSizes(benchmark)) {
+        BenchDirectory directory;
+        std::filesystem::path base = directory.getPath() / "default.json";
+        std::filesystem::path user = directory.getPath() / "config.json";
+        std::filesystem::path cache = directory.getPath() / "default.bin";
+
+        writeTemplate(base, size);
+        writeEmptyUserConfig(user);
+
+        // The user file is empty, only the template is parsed
+        benchmark.measure(
+            "parse_base",
+            {{"settings", size}, {"cache", false}},
+            parseIterations(benchmark, size),
+            [&]() {
+                ConfigParser parser(base, user, {}, "", "");
+                keepValue(parser);
+            }
+        );
+
+        // Build the cache before measuring
+        {
+            ConfigParser parser(base, user, {}, cache, "");
+        }
+
+        benchmark.measure(
+            "parse_base",
+            {{"settings", size}, {"cache", true}},
+            parseIterations(benchmark, size),
+            [&]() {
+                ConfigParser parser(base, user, {}, cache, "");
+                keepValue(parser);
+            }
+        );
+    }
+}
+
+// Measure the parse of a user configuration overriding every setting
+// after the file was changed
+static void benchmarkUserParse(Benchmark& benchmark)
+{
+    using Clock = std::chrono::steady_clock;
+
+    for (size_t size : templateSizes(benchmark)) {
+        BenchDirectory directory;
+        std::filesystem::path base = directory.getPath() / "default.json";
+        std::filesystem::path user = directory.getPath() / "config.json";
+
+        writeTemplate(base, size);
+        writeUserConfig(user, size, 1);
+
+        ConfigParser parser(base, user, {}, "", "");
+
+        size_t iterations = parseIterations(benchmark, size);
+        std::vector<std::chrono::nanoseconds> samples;
+        std::chrono::nanoseconds elapsed(0);
+
+        for (size_t i = 0; i < iterations; i++) {
+            // Every value changes, all the categories are parsed
+            writeUserConfig(user, size, i % 2 == 0 ? 2 : 1);
+
+            pollfd watch {parser.getWatchFd(), POLLIN, 0};
+
+            if (poll(&watch, 1, 1000) != 1) {
+                throw std::runtime_error("The user file change was missed");
+            }
+
+            auto start = Clock::now();
+            parser.processWatchEvents();
+            samples.push_back(Clock::now() - start);
+
+            elapsed += samples.back();
+            parser.updatedConfigs();
+        }
+
+        benchmark.report(
+            "parse_user",
+            {{"settings", size}},
+            std::move(samples),
+            iterations,
+            elapsed
+        );
+    }
+}
+
+// Measure get and set of a setting of the given type, the sets are
+// measured with a write of the file on every set and with delayed writes
+template <typename Type>
+static void benchmarkAccess(
+    Benchmark& benchmark,
+    const std::filesystem::path& directory,
+    const ConfigParser::ConfigPath& path,
+    std::string type_name,
+    size_t iterations
+) {
+    std::filesystem::path base = directory / "default.json";
+    std::filesystem::path user = directory / "config.json";
+
+    writeEmptyUserConfig(user);
+
+    {
+        ConfigParser parser(base, user, {}, "", "");
+        ConfigParser::ConfigId config_id = *parser.getConfigId(path);
+
+        benchmark.measure(
+            "get",
+            {{"type", type_name}},
+            benchmark.iterations(iterations),
+            [&]() { keepValue(parser.get<Type>(config_id)); }
+        );
+
+        // Include the lookup of the path
+        benchmark.measure(
+            "get_path",
+            {{"type", type_name}},
+            benchmark.iterations(iterations),
+            [&]() { keepValue(parser.get<Type>(path)); }
+        );
+    }
+
+    if (!benchmark.isEnabled("set"))
+        return;
+
+    for (auto write_delay : 
+        {std::chrono::milliseconds(0), c_long_write_delay}
+    ) {
+        ConfigParser parser(base, user, write_delay, "", "");
+        ConfigParser::ConfigId config_id = *parser.getConfigId(path);
+
+        Type values[] = {
+            parser.get<Type>(config_id),
+            otherValue(parser.get<Type>(config_id))
+        };
+        size_t index = 0;
+
+        // A write of the file cost much more than a set in memory
+        size_t set_iterations = write_delay.count() == 0 ?
+            std::max<size_t>(iterations / 1000, 100) :
+            iterations / 10;
+
+        benchmark.measure(
+            "set",
+            {{"type", type_name}, {"write_delay_ms", write_delay.count()}},
+            benchmark.iterations(set_iterations),
+            [&]() { parser.set<Type>(config_id, values[index++ % 2]); }
+        );
+    }
+}
+
+// Measure get and set for every setting type
+static void benchmarkGetSet(Benchmark& benchmark)
+{
+    BenchDirectory directory;
+    writeTemplate(
+        directory.getPath() / "default.json",
+        c_access_template_size
+    );
+
+    // The first settings cycle through every type
+    for (size_t index = 0; index < c_type_count; index++) {
+        const std::filesystem::path& path = directory.getPath();
+        std::string type_name = typeName(settingType(index));
+
+        switch (settingType(index)) {
+            case ConfigParser::ConfigType::Int:
+                benchmarkAccess<int>(benchmark, path, settingPath(index),
+                    type_name, 1000000);
+                break;
+            case ConfigParser::ConfigType::Bool:
+                benchmarkAccess<bool>(benchmark, path, settingPath(index),
+                    type_name, 1000000);
+                break;
+            case ConfigParser::ConfigType::Float:
+                benchmarkAccess<double>(benchmark, path, settingPath(index),
+                    type_name, 1000000);
+                break;
+            case ConfigParser::ConfigType::String:
+                benchmarkAccess<std::string>(benchmark, path,
+                    settingPath(index), type_name, 1000000);
+                break;
+            case ConfigParser::ConfigType::ArrayInt:
+                benchmarkAccess<std::vector<int>>(benchmark, path,
+                    settingPath(index), type_name, 100000);
+                break;
+            case ConfigParser::ConfigType::ArrayFloat:
+                benchmarkAccess<std::vector<double>>(benchmark, path,
+                    settingPath(index), type_name, 100000);
+                break;
+            case ConfigParser::ConfigType::ArrayString:
+                benchmarkAccess<std::vector<std::string>>(benchmark, path,
+                    settingPath(index), type_name, 100000);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    benchmarkAccess<std::vector<std::string>>(
+        benchmark,
+        directory.getPath(),
+        largeArrayPath(),
+        "large " + typeName(ConfigParser::ConfigType::ArrayString),
+        10000
+    );
+}
+
+// Measure gets from many threads, alone and with a thread setting
+// another value in a loop
+static void benchmarkContendedGet(Benchmark& benchmark)
+{
+    BenchDirectory directory;
+    std::filesystem::path base = directory.getPath() / "default.json";
+    std::filesystem::path user = directory.getPath() / "config.json";
+
+    writeTemplate(base, c_access_template_size);
+    writeEmptyUserConfig(user);
+
+    // The writes are delayed, the writer only contends in memory
+    ConfigParser parser(base, user, c_long_write_delay, "", "");
+    // The types cycle, the setting after the first cycle is an integer
+    ConfigParser::ConfigId read_id = *parser.getConfigId(settingPath(0));
+    ConfigParser::ConfigId write_id = *parser.getConfigId(
+        settingPath(c_type_count)
+    );
+
+    std::vector<size_t> thread_counts = {1, 2, 4, 8};
+    size_t hardware_threads = std::thread::hardware_concurrency();
+
+    if (hardware_threads > thread_counts.back())
+        thread_counts.push_back(hardware_threads);
+
+    for (bool with_writer : {false, true}) {
+        for (size_t thread_count : thread_counts) {
+            std::atomic<bool> reading = true;
+            std::thread writer;
+
+            if (with_writer) {
+                writer = std::thread([&]() {
+                    for (int value = 0; reading; value++) {
+                        parser.set<int>(write_id, value);
+                    }
+                });
+            }
+
+            benchmark.measureConcurrent(
+                "get_contended",
+                {{"writer", with_writer}},
+                thread_count,
+                benchmark.iterations(1000000),
+                [&](size_t) { keepValue(parser.get<int>(read_id)); }
+            );
+
+            reading = false;
+
+            if (writer.joinable())
+                writer.join();
+
+            parser.updatedConfigs();
+        }
+    }
+}
+
+// Return the id of an integer setting of the given category
+static ConfigParser::ConfigId intSettingId(
+    ConfigParser& parser,
+    size_t category
+) {
+    // The types cycle, the integers are at the multiples of the cycle
+    size_t first = category * c_settings_per_category;
+    size_t index = (first + c_type_count - 1) / c_type_count * c_type_count;
+
+    return *parser.getConfigId(settingPath(index));
+}
+
+// Measure sets from many threads, all in the same category or each
+// thread in its own category
+static void benchmarkConcurrentSet(Benchmark& benchmark)
+{
+    BenchDirectory directory;
+    std::filesystem::path base = directory.getPath() / "default.json";
+    std::filesystem::path user = directory.getPath() / "config.json";
+
+    writeTemplate(base, c_access_template_size);
+    writeEmptyUserConfig(user);
+
+    // The writes are delayed, only the category locks are measured
+    ConfigParser parser(base, user, c_long_write_delay, "", "");
+
+    std::vector<size_t> thread_counts = {1, 2, 4, 8};
+    size_t category_count = c_access_template_size / c_settings_per_category;
+
+    for (bool distinct : {false, true}) {
+        for (size_t thread_count : thread_counts) {
+            std::vector<ConfigParser::ConfigId> ids;
+
+            for (size_t index = 0; index < thread_count; index++) {
+                ids.push_back(intSettingId(
+                    parser,
+                    distinct ? index % category_count : 0
+                ));
+            }
+
+            // Every set is a change
+            std::atomic<int> value = 0;
+
+            benchmark.measureConcurrent(
+                "set_concurrent",
+                {{"categories", distinct ? "distinct" : "same"}},
+                thread_count,
+                benchmark.iterations(100000),
+                [&](size_t index) { parser.set<int>(ids[index], value++); }
+            );
+
+            parser.updatedConfigs();
+        }
+    }
+}
+
+// Run the ConfigParser benchmarks: template and user configuration
+// parsing, get and set of every type, contended gets and concurrent
+// sets
+void runParserBenchmarks(Benchmark& benchmark)
+{
+    if (benchmark.isEnabled("parse_base"))
+        benchmarkBaseParse(benchmark);
+
+    if (benchmark.isEnabled("parse_user"))
+        benchmarkUserParse(benchmark);
+
+    if (benchmark.isAnyEnabled({"get", "get_path", "set"}))
+        benchmarkGetSet(benchmark);
+
+    if (benchmark.isEnabled("get_contended"))
+        benchmarkContendedGet(benchmark);
+
+    if (benchmark.isEnabled("set_concurrent"))
+        benchmarkConcurrentSet(benchmark);
+}
+
+} // namespace coil
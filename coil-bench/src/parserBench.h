@@ -0,0 +1,15 @@
+#ifndef COIL_PARSER_BENCH_H
+#define COIL_PARSER_BENCH_H
+
+#include "benchmark.h"
+
+namespace coil {
+
+// Run the ConfigParser benchmarks: template and user configuration
+// parsing, get and set of every type, contended gets and concurrent
+// sets
+void runParserBenchmarks(Benchmark& benchmark);
+
+} // namespace coil
+
+#endif
@@ -0,0 +1,174 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <nlohmann/json.hpp>
+
+#include "syntheticConfig.h"
+
+namespace coil {
+
+// Return the value of the synthetic setting with the given index,
+// a different variant changes the value
+static nlohmann::json settingValue(size_t index, int variant)
+{
+    int64_t number = index + variant;
+
+    switch (settingType(index)) {
+        case ConfigParser::ConfigType::Int:
+            return number;
+        case ConfigParser::ConfigType::Bool:
+            return number % 2 == 0;
+        case ConfigParser::ConfigType::Float:
+            return number + 0.5;
+        case ConfigParser::ConfigType::String:
+            return "value " + std::to_string(number);
+        case ConfigParser::ConfigType::ArrayInt:
+            return {number, number + 1, number + 2};
+        case ConfigParser::ConfigType::ArrayFloat:
+            return {number + 0.25, number + 0.5, number + 0.75};
+        case ConfigParser::ConfigType::ArrayString:
+            return {"first " + std::to_string(number), "second"};
+
+        default:
+            return nullptr;
+    }
+}
+
+// Return the value of the large string array
+static nlohmann::json largeArrayValue(int variant)
+{
+    nlohmann::json values = nlohmann::json::array();
+
+    for (size_t i = 0; i < c_large_array_size; i++) {
+        std::string value = std::to_string(i + variant);
+        value.resize(c_large_string_size, 'x');
+
+        values.push_back(std::move(value));
+    }
+
+    return values;
+}
+
+// Write the given json to a file
+//
+// Raise an exception if the file can't be written
+static void writeJson(
+    const std::filesystem::path& path,
+    const nlohmann::json& json
+) {
+    std::ofstream file(path);
+    file << json.dump();
+
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path.string());
+    }
+}
+
+// Create a new temporary directory
+//
+// Raise an exception if the directory can't be created
+BenchDirectory::BenchDirectory()
+{
+    std::string path =
+        (std::filesystem::temp_directory_path() / "coil-bench-XXXXXX")
+            .string();
+
+    if (mkdtemp(path.data()) == nullptr) {
+        throw std::runtime_error(
+            std::string("mkdtemp failed: ") + std::strerror(errno)
+        );
+    }
+
+    m_path = path;
+}
+
+BenchDirectory::~BenchDirectory()
+{
+    std::error_code error;
+    std::filesystem::remove_all(m_path, error);
+}
+
+// Return the type of the synthetic setting with the given index,
+// the settings cycle through every type
+ConfigParser::ConfigType settingType(size_t index)
+{
+    return static_cast<ConfigParser::ConfigType>(index % c_type_count + 1);
+}
+
+// Return the path of the synthetic setting with the given index
+ConfigParser::ConfigPath settingPath(size_t index)
+{
+    return ConfigParser::ConfigPath(
+        "category" + std::to_string(index / c_settings_per_category),
+        "setting" + std::to_string(index)
+    );
+}
+
+// Return the path of the large string array added to every
+// synthetic template
+ConfigParser::ConfigPath largeArrayPath()
+{
+    return ConfigParser::ConfigPath("large", "strings");
+}
+
+// Write a synthetic base template with the given number of settings
+// and the large string array
+void writeTemplate(const std::filesystem::path& path, size_t setting_count)
+{
+    nlohmann::json base = nlohmann::json::object();
+
+    // Add a setting with its template entry
+    auto add_setting = [&](
+        const ConfigParser::ConfigPath& setting_path,
+        nlohmann::json value
+    ) {
+        base[std::string(setting_path.getCategory())]
+            [std::string(setting_path.getName())] = {
+                {"default", std::move(value)},
+                {"displayed_name", std::string(setting_path.getName())},
+                {"description", "Synthetic benchmark setting"}
+            };
+    };
+
+    for (size_t index = 0; index < setting_count; index++) {
+        add_setting(settingPath(index), settingValue(index, 0));
+    }
+
+    add_setting(largeArrayPath(), largeArrayValue(0));
+
+    writeJson(path, base);
+}
+
+// Write a user configuration without any setting
+void writeEmptyUserConfig(const std::filesystem::path& path)
+{
+    writeJson(path, nlohmann::json::object());
+}
+
+// Write a user configuration overriding every setting of a synthetic
+// template, a different variant changes every value
+void writeUserConfig(
+    const std::filesystem::path& path,
+    size_t setting_count,
+    int variant
+) {
+    nlohmann::json user = nlohmann::json::object();
+
+    for (size_t index = 0; index < setting_count; index++) {
+        ConfigParser::ConfigPath setting_path = settingPath(index);
+
+        user[std::string(setting_path.getCategory())]
+            [std::string(setting_path.getName())] =
+                settingValue(index, variant);
+    }
+
+    user[std::string(largeArrayPath().getCategory())]
+        [std::string(largeArrayPath().getName())] = largeArrayValue(variant);
+
+    writeJson(path, user);
+}
+
+} // namespace coil
@@ -0,0 +1,70 @@
+#ifndef COIL_SYNTHETIC_CONFIG_H
+#define COIL_SYNTHETIC_CONFIG_H
+
+#include <filesystem>
+#include <string>
+
+#include "configParser.h"
+
+namespace coil {
+
+// Number of settings in each category of a synthetic template
+constexpr size_t c_settings_per_category = 100;
+
+// Number of setting types, the synthetic settings cycle through them
+constexpr size_t c_type_count =
+    static_cast<size_t>(ConfigParser::ConfigType::ArrayString);
+
+// Number of strings of the large array setting and their size
+constexpr size_t c_large_array_size = 1024;
+constexpr size_t c_large_string_size = 64;
+
+// Temporary directory holding the files of a benchmark, removed
+// with its content when destroyed
+class BenchDirectory {
+public:
+    // Create a new temporary directory
+    //
+    // Raise an exception if the directory can't be created
+    BenchDirectory();
+    ~BenchDirectory();
+
+    BenchDirectory(const BenchDirectory&) = delete;
+    BenchDirectory& operator=(const BenchDirectory&) = delete;
+
+    // Return the path of the directory
+    const std::filesystem::path& getPath() const { return m_path; }
+
+private:
+    std::filesystem::path m_path;
+};
+
+// Return the type of the synthetic setting with the given index,
+// the settings cycle through every type
+ConfigParser::ConfigType settingType(size_t index);
+
+// Return the path of the synthetic setting with the given index
+ConfigParser::ConfigPath settingPath(size_t index);
+
+// Return the path of the large string array added to every
+// synthetic template
+ConfigParser::ConfigPath largeArrayPath();
+
+// Write a synthetic base template with the given number of settings
+// and the large string array
+void writeTemplate(const std::filesystem::path& path, size_t setting_count);
+
+// Write a user configuration without any setting
+void writeEmptyUserConfig(const std::filesystem::path& path);
+
+// Write a user configuration overriding every setting of a synthetic
+// template, a different variant changes every value
+void writeUserConfig(
+    const std::filesystem::path& path,
+    size_t setting_count,
+    int variant
+);
+
+} // namespace coil
+
+#endif
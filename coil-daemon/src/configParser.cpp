@@ -1,16 +1,31 @@
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
 #include <exception>
 #include <filesystem>
-#include <fstream>
-#include <iostream>
+#include <future>
 #include <optional>
+#include <set>
 #include <stdexcept>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <utility>
 
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
 #include "nlohmann/json_fwd.hpp"
 #include "spdlog/spdlog.h"
 
 #include "configParser.h"
+#include "fileUtils.h"
+#include "jsonLoader.h"
+#include "templateCache.h"
+#include "threadPool.h"
 
 namespace coil {
 
@@ -20,511 +35,2683 @@ namespace coil {
 // Raise exception if the base file is not found
 ConfigParser::ConfigParser(
     std::filesystem::path base, 
-    std::filesystem::path config 
+    std::filesystem::path config,
+    std::chrono::milliseconds write_delay,
+    std::filesystem::path cache,
+    std::filesystem::path fragments,
+    bool split,
+    UserFormat format,
+    bool journal
+) :
+    ConfigParser(
+        std::make_shared<TemplateStore>(base, cache, fragments),
+        config,
+        write_delay,
+        split,
+        format,
+        journal
+    )
+{
+}
+
+// Create a configuration parser of the given user configuration
+// file using the template of the given store
+ConfigParser::ConfigParser(
+    std::shared_ptr<TemplateStore> templates,
+    std::filesystem::path config,
+    std::chrono::milliseconds write_delay,
+    bool split,
+    UserFormat format,
+    bool journal,
+    std::shared_ptr<Metrics> metrics
 ) : 
-    m_base_path(base),
-    m_user_config_path(config)
+    m_template_store(std::move(templates)),
+    m_template(&m_template_store->getTemplate()),
+    m_user_config_path(config),
+    m_user_config_dir(
+        config.has_parent_path() ? config.parent_path() : "."
+    ),
+    m_split(split),
+    m_format(format),
+    m_watcher(m_user_config_dir),
+    m_change_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    m_write_delay(write_delay),
+    m_write_fd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+    m_write_scheduled(false),
+    m_write_pending(false),
+    m_write_failed(false),
+    m_change_log_start(0),
+    m_metrics(metrics ? std::move(metrics) : std::make_shared<Metrics>()),
+    m_handle_fingerprint(0)
 {
-    parseBaseConfig();
-    parseUserConfig();
+    if (m_change_fd < 0) {
+        throw std::runtime_error(
+            std::string("eventfd failed: ") + std::strerror(errno)
+        );
+    }
+    if (m_write_fd < 0) {
+        throw std::runtime_error(
+            std::string("timerfd_create failed: ") + std::strerror(errno)
+        );
+    }
+
+    // Every setting starts without user value
+    addCategoryStates(getTemplate());
+    publishSnapshot(getTemplate());
+
+    // A file corrupted before a crash is restored before it's parsed
+    if (m_split) {
+        for (size_t category = 0; category < m_categories.size(); category++)
+            checkUserFile(getCategoryPath(category), true);
+    } else {
+        checkUserFile(m_user_config_path, false);
+    }
+
+    {
+        std::shared_lock<std::shared_mutex> guard(m_structure_mutex);
+        reloadUserConfig();
+    }
+
+    // Store the stamp of the user config file if it exist
+    if (!m_split)
+        m_last_write = getFileStamp(m_user_config_path);
+
+    // Without delay the file write is the commit, there is nothing
+    // to journal
+    if (journal && m_write_delay.count() > 0) {
+        std::filesystem::path journal_path = m_user_config_path;
+        journal_path += ".journal";
+
+        m_journal.emplace(journal_path);
+        replayJournal();
+    }
+
+    // Clear the updated config vector and the change notification
+    m_notified_config.clear();
+    wasUpdated();
+}
 
-    // Store the last update time of the user config file if it exist
-    if (std::filesystem::exists(m_user_config_path)) {
-        m_last_write = std::filesystem::last_write_time(m_user_config_path);
+ConfigParser::~ConfigParser()
+{
+    // Don't lose the changes waiting for the write timer
+    if (writePending() != SetStatus::Ok) {
+        spdlog::error("Pending configuration changes were not written");
     }
 
-    // Clear the updated config vector
-    m_updated_config.clear();
-    m_updated = false;
+    close(m_change_fd);
+    close(m_write_fd);
 }
 
 // Return a list of all the category in the configuration structure
 std::vector<std::string> ConfigParser::getCategories() const 
 {
+    return listCategories(getTemplate());
+}
+
+// Return a list of meta data for the settings in the give category
+// Return a empty list if the category doesn't exist
+const std::vector<ConfigParser::ConfigMetadata>& ConfigParser::getMetadatas(
+    std::string_view category
+) const {
+    return findMetadatas(getTemplate(), category);
+}
+
+// Return a list of all the category of the given template
+std::vector<std::string> ConfigParser::listCategories(
+    const ConfigTemplate& config_template
+) {
     std::vector<std::string> categories;
+    categories.reserve(config_template.m_category_indexes.size());
 
-    for (const auto& category : m_config_structure) {
-        categories.push_back(category.first);
+    for (const auto& category : config_template.m_category_indexes) {
+        categories.emplace_back(category.first);
     }
 
     return std::move(categories);
 }
 
 // Return a list of meta data for the settings in the give category
-const std::vector<ConfigParser::ConfigMetadata>& ConfigParser::getMetadatas(
+// of the given template
+// Return a empty list if the category doesn't exist
+const std::vector<ConfigParser::ConfigMetadata>& ConfigParser::findMetadatas(
+    const ConfigTemplate& config_template,
     std::string_view category
 ) {
-    // TODO: Fix this cast to string
-    return m_config_structure[std::string(category)];
+    static const std::vector<ConfigMetadata> empty;
+
+    // The template is immutable, the lookup must not insert the category
+    const auto& indexes = config_template.m_category_indexes;
+    auto index = indexes.find(category);
+
+    if (index == indexes.end())
+        return empty;
+
+    return config_template.m_category_settings[index->second];
+}
+
+// Return the id of the setting at the given path
+// Return nullopt if the setting is not in the base template
+std::optional<ConfigParser::ConfigId> ConfigParser::getConfigId(
+    ConfigPathView config_path
+) const {
+    const auto& config_ids = getTemplate().m_config_ids;
+    auto config_id = config_ids.find(config_path);
+
+    if (config_id == config_ids.end())
+        return std::nullopt;
+
+    return config_id->second;
+}
+
+// Return the id of the setting at the given path, log a warning
+// naming the failed operation if the setting doesn't exist
+// Return nullopt if the setting is not in the base template
+std::optional<ConfigParser::ConfigId> ConfigParser::lookupConfigId(
+    ConfigPathView config_path,
+    std::string_view operation
+) const {
+    std::optional<ConfigId> config_id = getConfigId(config_path);
+
+    if (!config_id.has_value()) {
+        spdlog::warn(
+            "{} failed: setting not found ({}:{})",
+            operation,
+            config_path.getCategory(),
+            config_path.getName()
+        );
+    }
+
+    return config_id;
+}
+
+// Return the meta data of the setting with the given id
+// The id must be valid
+const ConfigParser::ConfigMetadata& ConfigParser::getMetadata(
+    ConfigId config_id
+) const {
+    return findMetadata(getTemplate(), config_id);
+}
+
+// Return the value of the configuration with the given id without
+// copying it. The returned pointer keeps the snapshot it belong
+// to alive, the value is not affected by later changes
+//
+// Return nullptr if the given config id isn't valid
+std::shared_ptr<const ConfigParser::ConfigValue> ConfigParser::getValue(
+    ConfigId config_id
+) const {
+    std::shared_ptr<const ConfigSnapshot> snapshot = m_snapshot.load();
+
+    if (config_id >= snapshot->size()) {
+        spdlog::warn("getConfig failed: setting not found (id: {})", config_id);
+
+        return nullptr;
+    }
+
+    // Aliasing constructor, share the ownership of the snapshot which
+    // holds the snapshot of the category
+    return std::shared_ptr<const ConfigValue>(
+        snapshot, &(*snapshot)[config_id]
+    );
+}
+
+// Set many configurations of the given layer at once with a single
+// write of the user configuration file and a single change notification.
+void ConfigParser::setValues(
+    std::vector<std::pair<ConfigId, ConfigValue>> values,
+    ConfigLayer layer
+) {
+    checkWritableLayer(layer);
+    checkSetStatus(setConfigValues(std::move(values), layer));
+}
+
+// Remove the values of the given layer of many configurations at
+// once, they go back to the value of the previous layers
+void ConfigParser::resetValues(
+    const std::vector<ConfigId>& config_ids,
+    ConfigLayer layer
+) {
+    checkWritableLayer(layer);
+
+    std::vector<std::pair<ConfigId, ConfigValue>> values;
+    values.reserve(config_ids.size());
+
+    for (ConfigId config_id : config_ids) {
+        values.emplace_back(config_id, ConfigValue());
+    }
+
+    checkSetStatus(setConfigValues(std::move(values), layer));
+}
+
+// Return the layer providing the value of the setting with the 
+// given id in the current snapshot
+ConfigParser::ConfigLayer ConfigParser::getLayer(ConfigId config_id) const
+{
+    std::shared_ptr<const ConfigSnapshot> snapshot = m_snapshot.load();
+    const SettingLocation& location = 
+        snapshot->m_template->m_locations[config_id];
+
+    return snapshot->m_categories[location.m_category]->m_layers[
+        location.m_index
+    ];
+}
+
+// Return true if any setting has a value of the Runtime layer
+bool ConfigParser::hasRuntimeValues() const
+{
+    std::shared_ptr<const ConfigSnapshot> snapshot = m_snapshot.load();
+    size_t runtime = static_cast<size_t>(ConfigLayer::Runtime);
+
+    for (const auto& category : snapshot->m_categories) {
+        if (!category->m_overrides[runtime].empty())
+            return true;
+    }
+
+    return false;
+}
+
+// Raise an exception if the values of the layer can't be set, the
+// system layers are only read from their files
+void ConfigParser::checkWritableLayer(ConfigLayer layer)
+{
+    if (layer != ConfigLayer::User && layer != ConfigLayer::Runtime) {
+        throw std::runtime_error(
+            "The " + std::string(configLayerStr(layer)) + 
+            " layer can't be set"
+        );
+    }
+}
+
+// Stage a change of the setting with the given id, the last
+// change of a setting wins
+void ConfigParser::Transaction::setValue(ConfigId config_id, ConfigValue value)
+{
+    m_values.emplace_back(config_id, std::move(value));
+}
+
+// Stage the removal of the value of the layer of the setting 
+// with the given id
+void ConfigParser::Transaction::resetValue(ConfigId config_id)
+{
+    m_values.emplace_back(config_id, ConfigValue());
+}
+
+// Apply the staged changes, the transaction is empty afterward
+//
+// Raise an exception if a change is invalid or if an error occurred
+// during file writing. None of the changes is applied then
+void ConfigParser::Transaction::commit()
+{
+    std::vector<std::pair<ConfigId, ConfigValue>> values;
+    values.swap(m_values);
+
+    m_parser.setValues(std::move(values), m_layer);
+}
+
+// Compare the fingerprint of the setting handles with the one of
+// the first count settings of the template
+//
+// Raise an exception if the fingerprints don't match
+void ConfigParser::checkHandles(size_t count, uint64_t fingerprint)
+{
+    const ConfigTemplate& config_template = getTemplate();
+
+    if (count > config_template.m_locations.size()) {
+        throw std::runtime_error(
+            "The setting handles don't match the base template"
+        );
+    }
+
+    uint64_t template_fingerprint = c_fingerprint_basis;
+
+    for (ConfigId config_id = 0; config_id < count; config_id++) {
+        const ConfigMetadata& metadata = 
+            findMetadata(config_template, config_id);
+
+        template_fingerprint = fingerprintSetting(
+            template_fingerprint,
+            metadata.getPath().getCategory(),
+            metadata.getPath().getName(),
+            static_cast<SharedType>(metadata.getType())
+        );
+    }
+
+    if (template_fingerprint != fingerprint) {
+        throw std::runtime_error(
+            "The setting handles don't match the base template"
+        );
+    }
+
+    m_handle_fingerprint.store(fingerprint, std::memory_order_relaxed);
+}
+
+// Raise the exception associated with the set status if it isn't Ok
+void ConfigParser::checkSetStatus(SetStatus status)
+{
+    switch (status) {
+        case SetStatus::Ok:
+            return;
+
+        case SetStatus::NotFound:
+            throw std::runtime_error("Config set not found");
+        case SetStatus::TypeMismatch:
+            throw std::runtime_error("Config set type mismatch");
+        case SetStatus::FileError:
+            throw std::runtime_error("Config set file error");
+
+        default:
+            throw std::runtime_error("Unknown error");
+    }
+}
+
+// Set the values of the given layer associated with the requested
+// settings, a monostate value removes the value of the layer.
+// The values are validated before any of them is applied, either 
+// all the values are set or none of them.
+//
+// Return Ok if the operation was successful 
+// Return NotFound if a requested setting is not found 
+// in the base template configuration.
+// Return TypeMismatch if the type of a given value doesn't match
+// the type of the settings in the base template configuration.
+// Return FileError if writing to the config file failed.
+ConfigParser::SetStatus ConfigParser::setConfigValues(
+    std::vector<std::pair<ConfigId, ConfigValue>> values,
+    ConfigLayer layer,
+    bool defer_write
+) {
+    std::shared_lock<std::shared_mutex> structure_guard(m_structure_mutex);
+
+    const ConfigTemplate& config_template = getTemplate();
+
+    // Validate all the values before changing anything
+    for (const auto& [config_id, data] : values) {
+        // Check if the setting is in the base template table
+        if (config_id >= config_template.m_base_config.size()) {
+            spdlog::warn(
+                "setConfig failed: setting not found (id: {})", 
+                config_id
+            );
+
+            return SetStatus::NotFound;
+        }
+
+        ConfigPathView config_path = 
+            findMetadata(config_template, config_id).getPath();
+
+        spdlog::debug(
+            "Updating setting: \"{}:{}\"",
+            config_path.getCategory(),
+            config_path.getName()
+        );
+
+        // Check if the provided data type matches the expected one,
+        // a removal has no type
+        ConfigType type = config_template.m_base_config[config_id].getType();
+
+        if (getValueType(data) != ConfigType::None &&
+            type != getValueType(data)
+        ) {
+            spdlog::warn(
+                "setConfig failed: type mismatch (expected: {}; got: {})",
+                configTypeStr(type),
+                configTypeStr(getValueType(data))
+            );
+
+            return SetStatus::TypeMismatch;
+        }
+    }
+
+    // Only the categories of the values are locked, in index order,
+    // the writers of the other categories are not blocked
+    std::set<size_t> categories;
+
+    for (const auto& [config_id, data] : values) {
+        categories.insert(config_template.m_locations[config_id].m_category);
+    }
+
+    // The user values are written to the file away from the locks
+    if (layer == ConfigLayer::User && !defer_write)
+        return commitValues(config_template, values, categories);
+
+    std::vector<ConfigId> updated;
+
+    {
+        std::vector<std::unique_lock<std::mutex>> guards = 
+            lockCategories(categories);
+
+        CategoryUpdates updates = 
+            applyValues(config_template, values, layer, updated);
+
+        // The runtime values are never written, they are only published.
+        // The deferred user values are flagged pending once published
+        publishCategories(updates, updated);
+
+        if (layer == ConfigLayer::User)
+            markPending(categories);
+    }
+
+    // Notify the change and return Ok
+    if (!updated.empty())
+        notifyChange(updated);
+
+    return SetStatus::Ok;
+}
+
+// Return the snapshots of the categories of the given values with the
+// values of the layer applied to the current snapshot. Only the
+// settings whose value is not hidden by a later layer are updated, 
+// they are appended to the updated vector.
+// The caller must hold the lock of the categories
+ConfigParser::CategoryUpdates ConfigParser::applyValues(
+    const ConfigTemplate& config_template,
+    const std::vector<std::pair<ConfigId, ConfigValue>>& values,
+    ConfigLayer layer,
+    std::vector<ConfigId>& updated
+) {
+    // Copy the snapshot of the categories, only their lock holder
+    // publishes them so they can't change in the meantime
+    std::shared_ptr<const ConfigSnapshot> current = m_snapshot.load();
+    std::map<size_t, std::shared_ptr<CategorySnapshot>> categories;
+
+    for (const auto& [config_id, data] : values) {
+        size_t category = config_template.m_locations[config_id].m_category;
+
+        if (categories.count(category) == 0) {
+            categories.emplace(
+                category,
+                std::make_shared<CategorySnapshot>(
+                    *current->m_categories[category]
+                )
+            );
+        }
+    }
+
+    updated.reserve(updated.size() + values.size());
+
+    for (const auto& [config_id, data] : values) {
+        const SettingLocation& location = 
+            config_template.m_locations[config_id];
+        CategorySnapshot& snapshot = *categories[location.m_category];
+        auto& layer_values = 
+            snapshot.m_overrides[static_cast<size_t>(layer)];
+
+        if (getValueType(data) == ConfigType::None) {
+            if (layer_values.erase(location.m_index) == 0)
+                continue;
+        } else {
+            layer_values[location.m_index] = data;
+        }
+
+        if (isHidden(snapshot, location.m_index, layer))
+            continue;
+
+        mergeSetting(
+            config_template,
+            location.m_category,
+            snapshot,
+            location.m_index
+        );
+        updated.push_back(config_id);
+    }
+
+    CategoryUpdates updates;
+
+    for (auto& [category, snapshot] : categories) {
+        updates.emplace(
+            category,
+            shareDefaults(config_template, category, std::move(snapshot))
+        );
+    }
+
+    return updates;
+}
+
+// Merge again the value of the setting at the given position of
+// a category from the values of its layers
+void ConfigParser::mergeSetting(
+    const ConfigTemplate& config_template,
+    size_t category,
+    CategorySnapshot& snapshot,
+    size_t index
+) {
+    // The last layer holding a value wins
+    for (size_t layer = c_layer_count - 1; layer > 0; layer--) {
+        auto value = snapshot.m_overrides[layer].find(index);
+
+        if (value != snapshot.m_overrides[layer].end()) {
+            snapshot.m_values[index] = value->second;
+            snapshot.m_layers[index] = static_cast<ConfigLayer>(layer);
+
+            return;
+        }
+    }
+
+    ConfigId config_id = 
+        config_template.m_category_settings[category][index].getId();
+
+    snapshot.m_values[index] = 
+        config_template.m_base_config[config_id].getDefault();
+    snapshot.m_layers[index] = ConfigLayer::Default;
+}
+
+// Return true if a layer after the given one holds a value of the
+// setting at the given position
+bool ConfigParser::isHidden(
+    const CategorySnapshot& snapshot,
+    size_t index,
+    ConfigLayer layer
+) {
+    for (size_t next = static_cast<size_t>(layer) + 1; 
+        next < c_layer_count; 
+        next++
+    ) {
+        if (snapshot.m_overrides[next].count(index) != 0)
+            return true;
+    }
+
+    return false;
+}
+
+// Return the snapshot of the category to publish, the default 
+// snapshot of the template if the category has no user or runtime
+// value so the copy is released
+std::shared_ptr<const ConfigParser::CategorySnapshot> 
+ConfigParser::shareDefaults(
+    const ConfigTemplate& config_template,
+    size_t category,
+    std::shared_ptr<const CategorySnapshot> snapshot
+) {
+    const auto& overrides = snapshot->m_overrides;
+
+    if (overrides[static_cast<size_t>(ConfigLayer::User)].empty() &&
+        overrides[static_cast<size_t>(ConfigLayer::Runtime)].empty()
+    ) {
+        return config_template.m_defaults[category];
+    }
+
+    return snapshot;
 }
 
-// Return the json object associated with the requested setting.
-// Settings are retrieved from the configuration files according
-// to they name and category
+// Write the given user values to the user configuration, or journal
+// them if the writes are delayed, and publish them.
+// Either all the values are written or none of them.
+// The category locks are only held to apply and publish the values,
+// the files are written holding m_file_mutex alone
 //
-// Return nullopt if the requested setting is not found 
-// in the base template configuration
-std::optional<nlohmann::json> ConfigParser::getConfigJson(
-    const ConfigPath& config_path
+// Return Ok if the write was successful or scheduled
+// Return FileError if writing to the config file failed
+ConfigParser::SetStatus ConfigParser::commitValues(
+    const ConfigTemplate& config_template,
+    const std::vector<std::pair<ConfigId, ConfigValue>>& values,
+    const std::set<size_t>& categories
 ) {
-    // Check for config file updates and parse the file if necessary
-    checkConfigFileUpdate();
+    std::lock_guard<std::mutex> file_guard(m_file_mutex);
+    bool delayed = m_write_delay.count() > 0;
+
+    // A previous delayed write failed, retry it before accepting
+    // new changes so the error is reported to the caller
+    if (delayed && hasFailedWrite() && writePendingFiles() != SetStatus::Ok)
+        return SetStatus::FileError;
+
+    std::shared_ptr<const ConfigSnapshot> base;
+    std::vector<ConfigId> updated;
+    CategoryUpdates updates;
+
+    {
+        std::vector<std::unique_lock<std::mutex>> guards = 
+            lockCategories(categories);
+
+        base = m_snapshot.load();
+        updates = applyValues(
+            config_template,
+            values,
+            ConfigLayer::User,
+            updated
+        );
+    }
+
+    // The delayed values are written when the timer expire, the change
+    // is in the journal before any reader can see it
+    if (delayed && m_journal) {
+        std::string record = getJournalRecord(updates);
+        std::lock_guard<std::mutex> guard(m_journal_mutex);
+
+        try {
+            m_journal->append(record);
+        } catch (std::exception& e) {
+            spdlog::warn(
+                "setConfig failed: journal error ({})",
+                e.what()
+            ); 
+
+            return SetStatus::FileError;
+        }
+    } else if (!delayed && m_split) {
+        // Only the files of the given categories are written, the old
+        // values are restored in case of write failure
+        std::vector<size_t> written;
+
+        for (const auto& [category, snapshot] : updates) {
+            try {
+                storeCategoryConfig(category, *snapshot);
+                written.push_back(category);
+            } catch (std::exception& e) {
+                spdlog::warn(
+                    "setConfig failed: file error ({})",
+                    e.what()
+                ); 
+
+                for (auto old : written) {
+                    try {
+                        storeCategoryConfig(old, *base->m_categories[old]);
+                    } catch (std::exception& e) {
+                        spdlog::error(
+                            "Failed to restore \"{}\": {}",
+                            getCategoryPath(old).c_str(),
+                            e.what()
+                        );
+                    }
+                }
+
+                return SetStatus::FileError;
+            }
+        }
+    } else if (!delayed) {
+        // The whole file is written with the published values of the
+        // other categories
+        try {
+            storeUserCofig(*applyCategories(*m_snapshot.load(), updates));
+        } catch (std::exception& e) {
+            spdlog::warn(
+                "setConfig failed: file error ({})",
+                e.what()
+            ); 
+
+            return SetStatus::FileError;
+        }
+    }
+
+    {
+        std::vector<std::unique_lock<std::mutex>> guards = 
+            lockCategories(categories);
+
+        // A deferred set or a runtime value published a category in the
+        // meantime, the values are applied again on top of it. The
+        // deferred change is pending and written after this one
+        std::shared_ptr<const ConfigSnapshot> current = m_snapshot.load();
+
+        for (size_t category : categories) {
+            if (current->m_categories[category] != 
+                base->m_categories[category]
+            ) {
+                updated.clear();
+                updates = applyValues(
+                    config_template,
+                    values,
+                    ConfigLayer::User,
+                    updated
+                );
+
+                break;
+            }
+        }
+
+        publishCategories(updates, updated);
+
+        if (delayed) {
+            markPending(categories);
+        } else {
+            // The file no longer match the content read by the last
+            // parse, the categories must be compared again
+            for (size_t category : categories) {
+                m_categories[category]->m_content.reset();
+            }
+        }
+    }
+
+    if (delayed)
+        scheduleWrite();
+
+    // Notify the change and return Ok
+    if (!updated.empty())
+        notifyChange(updated);
+
+    return SetStatus::Ok;
+}
+
+// Flag the changes of the given categories as not written. The file no
+// longer match the content read by the last parse, the categories must
+// be compared again on the next parse.
+// The caller must hold the lock of the categories
+void ConfigParser::markPending(const std::set<size_t>& categories)
+{
+    for (size_t category : categories) {
+        CategoryState& state = *m_categories[category];
+        state.m_content.reset();
+
+        if (m_split)
+            state.m_write_pending.store(true);
+    }
+
+    if (!m_split)
+        m_write_pending.store(true);
+}
+
+// Return true if the last write of a pending change failed
+bool ConfigParser::hasFailedWrite() const
+{
+    if (!m_split)
+        return m_write_failed.load();
+
+    for (const auto& state : m_categories) {
+        if (state->m_write_failed.load())
+            return true;
+    }
+
+    return false;
+}
+
+// Journal the published values of the category of a setting set with
+// setDeferred and write them, or schedule the write if the writes are
+// delayed
+//
+// Raise an exception if the change can't be journaled or written
+void ConfigParser::commitDeferred(ConfigId config_id)
+{
+    if (m_write_delay.count() == 0) {
+        flush();
+        return;
+    }
+
+    if (m_journal) {
+        std::shared_lock<std::shared_mutex> structure_guard(m_structure_mutex);
+        std::lock_guard<std::mutex> file_guard(m_file_mutex);
+
+        // The record holds the category as published now, the changes
+        // published since the set are journaled too
+        size_t category = getTemplate().m_locations[config_id].m_category;
+        std::string record = getJournalRecord({
+            {category, m_snapshot.load()->m_categories[category]}
+        });
+
+        std::lock_guard<std::mutex> guard(m_journal_mutex);
+        m_journal->append(record);
+    }
+
+    scheduleWrite();
+}
+
+// If the user configuration file was update since last calling this
+// function, return a vector with all the config id that were updated,
+// sorted and without duplicates.
+// It doesn't wait for a writer in progress
+std::vector<ConfigParser::ConfigId> ConfigParser::updatedConfigs()
+{
+    std::vector<ConfigId> updated;
+
+    {
+        std::lock_guard<std::mutex> guard(m_notify_mutex);
+        updated.swap(m_notified_config);
+    }
+
+    // The same setting could be updated several times before 
+    // the changes are collected
+    std::sort(updated.begin(), updated.end());
+    updated.erase(std::unique(updated.begin(), updated.end()), updated.end());
+
+    return updated;
+}
+
+// Return true if the any configuration was updated since 
+// last calling this function
+bool ConfigParser::wasUpdated() 
+{
+    // Reading the eventfd reset its counter, the read fail with EAGAIN
+    // if nothing was notified. No lock is needed
+    uint64_t counter;
+
+    return read(m_change_fd, &counter, sizeof(counter)) == sizeof(counter);
+}
+
+// Hand the updated config id to updatedConfigs and signal the change
+// file descriptor that a configuration was updated
+void ConfigParser::notifyChange(const std::vector<ConfigId>& updated)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_notify_mutex);
+        m_notified_config.insert(
+            m_notified_config.end(),
+            updated.begin(),
+            updated.end()
+        );
+    }
+
+    uint64_t increment = 1;
+
+    if (write(m_change_fd, &increment, sizeof(increment)) < 0) {
+        spdlog::warn(
+            "Failed to notify configuration change: {}",
+            std::strerror(errno)
+        );
+    }
+}
+
+// Read the pending file change events and parse the user
+// configuration file again if it was modified
+void ConfigParser::processWatchEvents()
+{
+    std::shared_lock<std::shared_mutex> guard(m_structure_mutex);
+
+    std::vector<std::string> files;
+
+    {
+        std::lock_guard<std::mutex> watcher_guard(m_watcher_mutex);
+        files = m_watcher.readEvents();
+
+        // The watch is lost if the directory is removed, try to watch
+        // it again in case it was recreated
+        m_watcher.addWatch();
+    }
+
+    if (m_split) {
+        // Only the files of the changed categories are parsed
+        const ConfigTemplate& config_template = getTemplate();
+
+        for (const auto& file : files) {
+            std::filesystem::path path(file);
+
+            if (path.extension() != getUserFormatExtension(m_format))
+                continue;
+
+            auto category = 
+                config_template.m_category_indexes.find(path.stem().string());
+
+            if (category != config_template.m_category_indexes.end())
+                reloadCategoryFile(category->second);
+        }
+
+        return;
+    }
+
+    // Only the user configuration file is relevant, the other files
+    // in the directory are ignored
+    for (const auto& file : files) {
+        if (file == m_user_config_path.filename()) {
+            checkConfigFileUpdate();
+            break;
+        }
+    }
+}
+
+// Write the pending changes to the user configuration file
+//
+// Raise an exception if the write fail
+void ConfigParser::flush()
+{
+    if (writePending() != SetStatus::Ok) {
+        throw std::runtime_error("Config flush file error");
+    }
+}
+
+// Read the expired write timer and write the pending changes
+void ConfigParser::processWriteTimer()
+{
+    uint64_t expirations;
+
+    if (read(m_write_fd, &expirations, sizeof(expirations)) < 0)
+        return;
+
+    // The changes done from now on arm the timer again
+    m_write_scheduled.store(false);
+
+    // The error is reported by the next set or flush 
+    writePending();
+}
+
+// Arm the write timer if it isn't already armed.
+// The timer is not rearmed by later changes, the delay bound the time
+// a change waits before being written
+void ConfigParser::scheduleWrite()
+{
+    if (m_write_scheduled.exchange(true))
+        return;
+
+    armWriteTimer(m_write_delay);
+}
+
+// Arm the write timer to retry a failed write. The retry doesn't depend
+// on the write delay, the timer is also used without delay then
+void ConfigParser::scheduleRetry()
+{
+    m_write_scheduled.store(true);
+    armWriteTimer(std::max(m_write_delay, c_write_retry_delay));
+}
+
+// Arm the write timer to expire after the given delay, it must not
+// be zero as a zero delay disarms the timer
+void ConfigParser::armWriteTimer(std::chrono::milliseconds delay)
+{
+    auto seconds = 
+        std::chrono::duration_cast<std::chrono::seconds>(delay);
+    auto nanoseconds = 
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            delay - seconds
+        );
+
+    struct itimerspec timer_spec = {};
+    timer_spec.it_value.tv_sec = seconds.count();
+    timer_spec.it_value.tv_nsec = nanoseconds.count();
+
+    if (timerfd_settime(m_write_fd, 0, &timer_spec, nullptr) < 0) {
+        spdlog::warn("Failed to arm write timer: {}", std::strerror(errno));
+    }
+}
+
+// Write the pending changes to the user configuration files.
+// On failure the changes stay pending and the timer is armed
+// again to retry the write. An expiration with nothing pending,
+// after a flush, does nothing
+//
+// Return Ok if nothing was pending or the write was successful
+// Return FileError if writing to a config file failed
+ConfigParser::SetStatus ConfigParser::writePending()
+{
+    std::shared_lock<std::shared_mutex> guard(m_structure_mutex);
+    std::lock_guard<std::mutex> file_guard(m_file_mutex);
+
+    return writePendingFiles();
+}
+
+// Write the pending changes to the user configuration files
+//
+// Return Ok if nothing was pending or the write was successful
+// Return FileError if writing to a config file failed
+ConfigParser::SetStatus ConfigParser::writePendingFiles()
+{
+    if (!m_split)
+        return writeFilePending();
+
+    SetStatus status = SetStatus::Ok;
+
+    // The records are appended holding m_file_mutex and their changes
+    // are published and flagged pending before it's released, the loop
+    // writes every change before the mark
+    Journal::Mark mark = getWrittenState().first;
+
+    // The categories are written from the published snapshot, the sets
+    // don't wait for the writes
+    for (size_t category = 0; category < m_categories.size(); category++) {
+        if (writeCategoryPending(category) != SetStatus::Ok)
+            status = SetStatus::FileError;
+    }
+
+    if (status == SetStatus::Ok)
+        discardJournal(mark);
+
+    return status;
+}
+
+// Write the pending changes to the user configuration file.
+//
+// Return Ok if nothing was pending or the write was successful
+// Return FileError if writing to the config file failed
+ConfigParser::SetStatus ConfigParser::writeFilePending()
+{
+    // A change flagged from now on is written by the next write
+    if (!m_write_pending.exchange(false))
+        return SetStatus::Ok;
+
+    auto [mark, snapshot] = getWrittenState();
+
+    try {
+        storeUserCofig(*snapshot);
+    } catch (std::exception& e) {
+        spdlog::warn(
+            "Delayed write failed: file error ({})",
+            e.what()
+        ); 
+
+        m_write_pending.store(true);
+        m_write_failed.store(true);
+        scheduleRetry();
+
+        return SetStatus::FileError;
+    }
+
+    m_write_failed.store(false);
+
+    discardJournal(mark);
+
+    return SetStatus::Ok;
+}
+
+// Write the pending changes of a category to its file.
+//
+// Return Ok if nothing was pending or the write was successful
+// Return FileError if writing to the config file failed
+ConfigParser::SetStatus ConfigParser::writeCategoryPending(size_t category)
+{
+    CategoryState& state = *m_categories[category];
+
+    // A change flagged from now on is written by the next write
+    if (!state.m_write_pending.exchange(false))
+        return SetStatus::Ok;
+
+    try {
+        storeCategoryConfig(
+            category,
+            *m_snapshot.load()->m_categories[category]
+        );
+    } catch (std::exception& e) {
+        spdlog::warn(
+            "Delayed write failed: file error ({})",
+            e.what()
+        ); 
+
+        state.m_write_pending.store(true);
+        state.m_write_failed.store(true);
+        scheduleRetry();
+
+        return SetStatus::FileError;
+    }
+
+    state.m_write_failed.store(false);
+
+    return SetStatus::Ok;
+}
+
+// Return the position of the journal and the snapshot, taken 
+// together so the records before the position are in the snapshot
+std::pair<Journal::Mark, std::shared_ptr<const ConfigParser::ConfigSnapshot>>
+ConfigParser::getWrittenState()
+{
+    // The journal is only created by the constructor
+    if (!m_journal)
+        return {Journal::Mark(), m_snapshot.load()};
+
+    std::lock_guard<std::mutex> guard(m_journal_mutex);
+
+    return {m_journal->getMark(), m_snapshot.load()};
+}
+
+// Discard the journal records before the given position, once
+// their changes are written to the user configuration
+void ConfigParser::discardJournal(const Journal::Mark& mark)
+{
+    if (!m_journal)
+        return;
+
+    std::lock_guard<std::mutex> guard(m_journal_mutex);
+
+    // The records left are replayed again, which is harmless
+    try {
+        m_journal->discard(mark);
+    } catch (std::exception& e) {
+        spdlog::warn("Failed to discard the journal records: {}", e.what());
+    }
+}
+
+// Apply the changes of the journal records left by a previous run
+// and write them to the user configuration
+void ConfigParser::replayJournal()
+{
+    std::vector<std::string> records = m_journal->readRecords();
+
+    if (records.empty())
+        return;
+
+    spdlog::info("Replaying {} journal records", records.size());
+
+    const ConfigTemplate& config_template = getTemplate();
+    std::vector<std::pair<ConfigId, ConfigValue>> values;
+
+    for (const auto& record : records) {
+        std::vector<UserCategory> categories;
+
+        try {
+            categories = loadUserConfig(record);
+        } catch (std::runtime_error& e) {
+            spdlog::warn("Ignoring journal record: {}", e.what());
+
+            continue;
+        }
+
+        // The template may have changed since the record was written
+        for (const auto& category : categories) {
+            for (const auto& setting : category.m_settings) {
+                std::optional<ConfigId> config_id = getConfigId(
+                    {category.m_name, setting.m_name}
+                );
+
+                if (!config_id.has_value() ||
+                    config_template.m_base_config[*config_id].getType() !=
+                        getValueType(setting.m_value)
+                ) {
+                    continue;
+                }
+
+                values.emplace_back(*config_id, setting.m_value);
+            }
+        }
+    }
+
+    // The replayed changes are written right away
+    SetStatus status = setConfigValues(std::move(values));
+
+    if (status == SetStatus::Ok)
+        status = writePending();
+
+    if (status != SetStatus::Ok)
+        spdlog::error("Failed to write the changes of the journal");
+}
+
+// Return the journal record of the given categories, a single line
+// json object holding the user values of each category
+std::string ConfigParser::getJournalRecord(
+    const CategoryUpdates& categories
+) const {
+    const ConfigTemplate& config_template = getTemplate();
+    nlohmann::json record = nlohmann::json::object();
+
+    for (const auto& [category, snapshot] : categories) {
+        record[std::string(config_template.m_category_names[category])] = 
+            categoryToJson(config_template, category, *snapshot);
+    }
+
+    // Without indentation the json holds no new line
+    return record.dump();
+}
+
+// Return a snapshot equal to the given one except for the
+// given categories
+std::shared_ptr<const ConfigParser::ConfigSnapshot> 
+ConfigParser::applyCategories(
+    const ConfigSnapshot& snapshot,
+    const CategoryUpdates& categories
+) {
+    // Only the pointers of the categories are copied
+    auto updated = std::make_shared<ConfigSnapshot>(snapshot);
+
+    for (const auto& [category, category_snapshot] : categories) {
+        updated->m_categories[category] = category_snapshot;
+    }
+
+    return updated;
+}
+
+// Build a new snapshot for the given template and publish it.
+// The categories already published keep their values, the new ones
+// start with the defaults
+void ConfigParser::publishSnapshot(const ConfigTemplate& config_template)
+{
+    std::lock_guard<std::mutex> guard(m_publish_mutex);
+
+    auto snapshot = std::make_shared<ConfigSnapshot>();
+    snapshot->m_template = &config_template;
+
+    std::shared_ptr<const ConfigSnapshot> current = m_snapshot.load();
+
+    if (current) {
+        snapshot->m_categories = current->m_categories;
+        snapshot->m_category_generations = current->m_category_generations;
+        snapshot->m_generation = current->m_generation + 1;
+    } else {
+        // The generations start from the creation time, a generation
+        // returned before the daemon restarted is older than the log
+        // and can't be mistaken for a recent one
+        snapshot->m_generation = 
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()
+            ).count();
+
+        std::lock_guard<std::mutex> log_guard(m_change_log_mutex);
+        m_change_log_start = snapshot->m_generation;
+    }
+
+    // The new categories share the defaults of the template until
+    // a user value is set
+    std::vector<ConfigId> added;
+
+    for (size_t category = snapshot->m_categories.size(); 
+        category < config_template.m_category_names.size();
+        category++
+    ) {
+        snapshot->m_categories.push_back(config_template.m_defaults[category]);
+        snapshot->m_category_generations.push_back(snapshot->m_generation);
+
+        for (const auto& metadata : 
+            config_template.m_category_settings[category]
+        ) {
+            added.push_back(metadata.getId());
+        }
+    }
+
+    // The settings of the categories added to a running parser are new
+    // to the readers of the previous generations
+    if (current)
+        logChanges(snapshot->m_generation, added);
+
+    m_snapshot.store(std::move(snapshot));
+}
+
+// Publish a new snapshot equal to the current one except for the
+// given categories, in a new generation recording the given 
+// updated settings in the change log
+void ConfigParser::publishCategories(
+    const CategoryUpdates& categories,
+    const std::vector<ConfigId>& updated
+) {
+    // The writers of different categories can publish concurrently, 
+    // the snapshot is replaced holding m_publish_mutex so no category
+    // update is lost
+    std::lock_guard<std::mutex> guard(m_publish_mutex);
+
+    // Only the pointers of the categories are copied
+    auto snapshot = std::make_shared<ConfigSnapshot>(*m_snapshot.load());
+    snapshot->m_generation++;
+
+    for (const auto& [category, category_snapshot] : categories) {
+        snapshot->m_categories[category] = category_snapshot;
+        snapshot->m_category_generations[category] = snapshot->m_generation;
+    }
+
+    // The changes are logged before the snapshot is visible, a reader
+    // of the snapshot always finds them in the log
+    logChanges(snapshot->m_generation, updated);
+
+    m_snapshot.store(std::move(snapshot));
+}
+
+// Append the updated settings of a generation to the change log,
+// dropping the oldest changes beyond its size
+void ConfigParser::logChanges(
+    uint64_t generation,
+    const std::vector<ConfigId>& updated
+) {
+    std::lock_guard<std::mutex> guard(m_change_log_mutex);
+
+    for (auto config_id : updated) {
+        m_change_log.emplace_back(generation, config_id);
+    }
+
+    // The changes of the dropped generation may be partially kept,
+    // the log is only complete after it
+    while (m_change_log.size() > c_change_log_size) {
+        m_change_log_start = m_change_log.front().first;
+        m_change_log.pop_front();
+    }
+}
+
+// Return the generation of the last change of the given category
+// Return nullopt if the category doesn't exist
+std::optional<uint64_t> ConfigParser::getCategoryGeneration(
+    std::string_view category
+) const {
+    std::shared_ptr<const ConfigSnapshot> snapshot = m_snapshot.load();
+    const auto& indexes = snapshot->m_template->m_category_indexes;
+    auto index = indexes.find(category);
+
+    if (index == indexes.end())
+        return std::nullopt;
+
+    return snapshot->m_category_generations[index->second];
+}
+
+// Return the settings whose value changed after the given generation,
+// up to the generation of the current snapshot
+ConfigParser::ChangeSet ConfigParser::changesSince(uint64_t generation) const
+{
+    ChangeSet changes;
+    changes.m_snapshot = m_snapshot.load();
+    changes.m_generation = changes.m_snapshot->m_generation;
+
+    {
+        // The changes of the snapshot were logged before it was 
+        // published, the later ones are ignored
+        std::lock_guard<std::mutex> guard(m_change_log_mutex);
+
+        changes.m_complete = 
+            generation >= m_change_log_start &&
+            generation <= changes.m_generation;
+
+        if (changes.m_complete) {
+            auto change = std::upper_bound(
+                m_change_log.begin(),
+                m_change_log.end(),
+                generation,
+                [](uint64_t generation, const auto& change) {
+                    return generation < change.first;
+                }
+            );
+
+            for (; change != m_change_log.end() && 
+                change->first <= changes.m_generation;
+                change++
+            ) {
+                changes.m_config_ids.push_back(change->second);
+            }
+        }
+    }
+
+    if (!changes.m_complete) {
+        changes.m_config_ids.resize(changes.m_snapshot->size());
+
+        for (ConfigId config_id = 0; 
+            config_id < changes.m_config_ids.size(); 
+            config_id++
+        ) {
+            changes.m_config_ids[config_id] = config_id;
+        }
+
+        return changes;
+    }
+
+    // The same setting could be updated by several generations
+    std::vector<ConfigId>& config_ids = changes.m_config_ids;
+    std::sort(config_ids.begin(), config_ids.end());
+    config_ids.erase(
+        std::unique(config_ids.begin(), config_ids.end()),
+        config_ids.end()
+    );
+
+    return changes;
+}
+
+// Return the user values of a category as a json object
+nlohmann::json ConfigParser::categoryToJson(
+    const ConfigTemplate& config_template,
+    size_t category,
+    const CategorySnapshot& snapshot
+) {
+    const auto& metadatas = config_template.m_category_settings[category];
+
+    nlohmann::json json_category = nlohmann::json::object();
+
+    // Only the User layer is stored, the runtime values are lost
+    for (const auto& [index, value] : 
+        snapshot.m_overrides[static_cast<size_t>(ConfigLayer::User)]
+    ) {
+        json_category[std::string(metadatas[index].getPath().getName())] = 
+            toJson(value);
+    }
+
+    return json_category;
+}
+
+// Store the user values of the given snapshot to the user 
+// configuration file
+//
+// Raise an exception if the write fail
+void ConfigParser::storeUserCofig(const ConfigSnapshot& snapshot)
+{
+    // Generate the json object, empty if no user value is set
+    nlohmann::json json_config = nlohmann::json::object();
+
+    spdlog::debug(
+        "Writing on user config file ({})",
+        m_user_config_path.c_str()
+    );
+
+    for (size_t category = 0; 
+        category < snapshot.m_categories.size(); 
+        category++
+    ) {
+        nlohmann::json json_category = categoryToJson(
+            *snapshot.m_template,
+            category,
+            *snapshot.m_categories[category]
+        );
+
+        // Store the configuration data at the appropriate path
+        if (!json_category.empty()) {
+            std::string category_name(
+                snapshot.m_template->m_category_names[category]
+            );
+
+            json_config[category_name] = std::move(json_category);
+        }
+    }
+
+    writeUserFile(
+        m_user_config_path,
+        encodeUserFile(json_config),
+        m_last_write
+    );
+}
+
+// Store the user values of a category to its own file
+//
+// Raise an exception if the write fail
+void ConfigParser::storeCategoryConfig(
+    size_t category,
+    const CategorySnapshot& snapshot
+) {
+    std::filesystem::path path = getCategoryPath(category);
+
+    spdlog::debug("Writing on user config file ({})", path.c_str());
+
+    writeUserFile(
+        path,
+        encodeUserFile(categoryToJson(getTemplate(), category, snapshot)),
+        m_categories[category]->m_last_write
+    );
+}
+
+// Return the content of a user configuration file holding the given
+// json in the storage format
+std::string ConfigParser::encodeUserFile(const nlohmann::json& json) const
+{
+    std::string content;
+
+    switch (m_format) {
+        case UserFormat::Cbor:
+            nlohmann::json::to_cbor(json, content);
+            break;
+        case UserFormat::MessagePack:
+            nlohmann::json::to_msgpack(json, content);
+            break;
+        default:
+            // Write prettified JSON
+            content = json.dump(4) + "\n";
+            break;
+    }
+
+    return content;
+}
+
+// Replace the content of a user configuration file and its last
+// known good copy, then update its stamp so our own write is not
+// detected as a change
+//
+// Raise an exception if the write fail
+void ConfigParser::writeUserFile(
+    const std::filesystem::path& path,
+    const std::string& content,
+    std::optional<FileStamp>& stamp
+) {
+    // If the configuration file doesn't exist warn that 
+    // a new one will be created
+    if (!stamp.has_value()) {
+        spdlog::warn(
+            "Configuration file not found, creating one at: {}",
+            path.c_str()
+        );
+    }
+
+    // The file is replaced atomically so a crash during the write 
+    // doesn't corrupt it
+    {
+        ScopedTimer timer(m_metrics->m_file_write);
+        writeFileAtomic(path, content);
+    }
+
+    // The file is written, a failure of the copy only costs a full
+    // check on the next startup
+    try {
+        writeChecksummedFile(getGoodCopyPath(path), content);
+
+    } catch (std::exception& e) {
+        spdlog::warn(
+            "Failed to write the last known good copy of {}: {}",
+            path.c_str(), e.what()
+        );
+    }
+
+    m_metrics->m_file_write_bytes.fetch_add(
+        content.size(),
+        std::memory_order_relaxed
+    );
+
+    // Update the file stamp so our own write is not detected as a change
+    stamp = getFileStamp(path);
+
+    // The directory may have been created after the watcher, 
+    // make sure it's watched
+    std::lock_guard<std::mutex> guard(m_watcher_mutex);
+    m_watcher.addWatch();
+}
+
+// Return the path of the file storing the given category when
+// each category is stored in its own file,
+// for example ~/.config/coil/network.json
+std::filesystem::path ConfigParser::getCategoryPath(size_t category) const
+{
+    std::string name(getTemplate().m_category_names[category]);
+
+    return m_user_config_dir / (name + getUserFormatExtension(m_format));
+}
+
+// Parse the base template, the fragments and the system layers
+//
+// Raise exception if neither the base file nor a fragment is found
+ConfigParser::TemplateStore::TemplateStore(
+    std::filesystem::path base,
+    std::filesystem::path cache,
+    std::filesystem::path fragments,
+    std::filesystem::path vendor,
+    std::filesystem::path site
+) :
+    m_template(nullptr),
+    m_base_path(base),
+    m_cache_path(cache),
+    m_fragments_path(fragments)
+{
+    // Watch the fragments directory before listing it, so a fragment 
+    // added during the startup is not missed
+    if (!m_fragments_path.empty() && 
+        std::filesystem::is_directory(m_fragments_path)
+    ) {
+        m_fragment_watcher.emplace(m_fragments_path);
+    }
+
+    // The layers are merged in the default snapshots of the template
+    readLayerFile(ConfigLayer::Vendor, vendor);
+    readLayerFile(ConfigLayer::Site, site);
+
+    parseBaseConfig();
+}
+
+// Read the values of a system layer from the file at the given
+// path, a missing file leaves the layer empty
+void ConfigParser::TemplateStore::readLayerFile(
+    ConfigLayer layer,
+    const std::filesystem::path& path
+) {
+    if (path.empty() || !std::filesystem::exists(path)) {
+        spdlog::debug(
+            "No {} configuration file ({})",
+            configLayerStr(layer),
+            path.c_str()
+        );
+
+        return;
+    }
+
+    spdlog::debug(
+        "Parsing {} configuration file ({})",
+        configLayerStr(layer),
+        path.c_str()
+    );
+
+    std::vector<UserCategory> categories;
+
+    try {
+        categories = loadUserConfig(readFile(path), UserFormat::Json);
+    } catch (std::runtime_error& e) {
+        spdlog::error(
+            "Ignoring {} configuration file \"{}\": {}",
+            configLayerStr(layer),
+            path.c_str(),
+            e.what()
+        );
+
+        return;
+    }
+
+    auto& layer_values = m_layer_values[static_cast<size_t>(layer)];
+
+    // The settings are checked against the template once its categories
+    // are known, a fragment may add them later
+    for (const auto& category : categories) {
+        if (!category.m_is_object) {
+            spdlog::warn(
+                "Ignoring \"{}: {}\"; category must be an object",
+                path.c_str(), category.m_name
+            );
+
+            continue;
+        }
+
+        for (const auto& setting : category.m_settings) {
+            layer_values[{category.m_name, setting.m_name}] = setting.m_value;
+        }
+    }
+}
+
+// Parse the base configuration file and the fragments on a thread
+// pool and publish the merged template
+// Raise exception if neither the base file nor a fragment is found
+void ConfigParser::TemplateStore::parseBaseConfig()
+{
+    // The base file comes first so it owns its categories
+    std::vector<std::filesystem::path> sources;
+    std::vector<std::filesystem::path> caches;
+
+    if (std::filesystem::exists(m_base_path) || 
+        m_fragments_path.empty()
+    ) {
+        sources.push_back(m_base_path);
+        caches.push_back(m_cache_path);
+    }
+
+    std::vector<std::filesystem::path> fragments = listFragments();
+
+    for (const auto& fragment : fragments) {
+        sources.push_back(fragment);
+        caches.push_back(getFragmentCachePath(fragment));
+    }
+
+    if (sources.empty()) {
+        throw std::runtime_error(
+            "Base config file not found"
+        );
+    }
+
+    // Parse all the sources concurrently, the results are merged 
+    // in the sources order so the ids don't depend on the scheduling
+    std::vector<std::future<std::vector<TemplateSetting>>> results;
+
+    {
+        ThreadPool pool(std::min<size_t>(
+            sources.size(), 
+            std::thread::hardware_concurrency()
+        ));
+
+        for (size_t i = 0; i < sources.size(); i++) {
+            results.push_back(pool.submit([this, &sources, &caches, i]() {
+                return loadTemplateSource(sources[i], caches[i]);
+            }));
+        }
+    }
+
+    auto config_template = std::make_unique<ConfigTemplate>();
+
+    for (size_t i = 0; i < sources.size(); i++) {
+        std::vector<TemplateSetting> settings;
+
+        try {
+            settings = results[i].get();
+        } catch (std::exception& e) {
+            // The base file is required, a broken fragment only 
+            // loses its own settings
+            if (sources[i] == m_base_path)
+                throw;
+
+            spdlog::error(
+                "Ignoring fragment \"{}\": {}",
+                sources[i].c_str(),
+                e.what()
+            );
+
+            continue;
+        }
+
+        if (sources[i] != m_base_path)
+            m_loaded_fragments.insert(sources[i].filename().string());
+
+        addTemplateSettings(*config_template, std::move(settings), sources[i]);
+    }
+
+    publishTemplate(std::move(config_template));
+}
+
+// Return the validated settings of a template source, loaded from 
+// its cache when it is up to date. The cache is refreshed otherwise.
+// Safe to call from any thread
+//
+// Raise exception if the file can't be parsed
+std::vector<TemplateSetting> ConfigParser::TemplateStore::loadTemplateSource(
+    const std::filesystem::path& source,
+    const std::filesystem::path& cache
+) const {
+    std::optional<FileStamp> stamp = getFileStamp(source);
+
+    if (!stamp.has_value()) {
+        throw std::runtime_error(
+            "Base config file not found"
+        );
+    }
+
+    // The stamp is taken before reading the file, a change during
+    // the read makes the cache stale on the next start
+    TemplateSource template_source;
+    template_source.m_device = stamp->m_device;
+    template_source.m_inode = stamp->m_inode;
+    template_source.m_size = stamp->m_size;
+    template_source.m_mtime_nsec = stamp->m_mtime_nsec;
+
+    if (!cache.empty()) {
+        auto settings = readTemplateCache(cache, template_source);
+
+        if (settings.has_value()) {
+            spdlog::debug(
+                "Loaded template \"{}\" from cache ({})",
+                source.c_str(),
+                cache.c_str()
+            );
+
+            return std::move(*settings);
+        }
+    }
+
+    // Parse the json template and refresh the cache
+    std::vector<TemplateSetting> settings = readBaseTemplate(source);
+
+    if (!cache.empty()) {
+        try {
+            writeTemplateCache(cache, template_source, settings);
+        } catch (std::exception& e) {
+            spdlog::warn(
+                "Couldn't store the template cache: {}",
+                e.what()
+            );
+        }
+    }
+
+    return settings;
+}
+
+// Parse and validate the template json file at the given path.
+// The file is read and parsed with a streaming parser, the settings
+// are validated as they are read without building a json document
+// Raise exception if the file can't be parsed
+std::vector<TemplateSetting> ConfigParser::TemplateStore::readBaseTemplate(
+    const std::filesystem::path& path
+) {
+    spdlog::debug("Parsing base config file ({})", path.c_str());
+
+    // If the file doesn't exist throw an exception
+    if (!std::filesystem::exists(path)) {
+        throw std::runtime_error(
+            "Base config file not found"
+        );
+    }
+
+    try {
+        return loadBaseTemplate(readFile(path), path);
+
+    } catch (std::exception& e) {
+        spdlog::error(
+            "Exception while parsing base config file json: {}",
+            e.what()
+        );
+
+        throw std::runtime_error(
+            "Base config file parsing error"
+        );
+    }
+}
+
+// Return the cache path of the given fragment, empty if the
+// cache is disabled
+std::filesystem::path ConfigParser::TemplateStore::getFragmentCachePath(
+    const std::filesystem::path& fragment
+) const {
+    if (m_cache_path.empty())
+        return {};
+
+    // The fragments are cached next to the base template cache, 
+    // for example /var/cache/coil/default.d/network.json.bin
+    std::filesystem::path cache = m_cache_path.parent_path();
+    cache /= m_cache_path.stem().string() + ".d";
+    cache /= fragment.filename().string() + ".bin";
+
+    return cache;
+}
+
+// Return the json files of the fragments directory sorted by name
+std::vector<std::filesystem::path> 
+ConfigParser::TemplateStore::listFragments() const
+{
+    std::vector<std::filesystem::path> fragments;
+
+    if (m_fragments_path.empty())
+        return fragments;
+
+    std::error_code error;
+    std::filesystem::directory_iterator directory(m_fragments_path, error);
+
+    if (error) {
+        spdlog::debug(
+            "No template fragments directory ({})",
+            m_fragments_path.c_str()
+        );
+
+        return fragments;
+    }
+
+    for (const auto& entry : directory) {
+        if (entry.is_regular_file() && entry.path().extension() == ".json")
+            fragments.push_back(entry.path());
+    }
+
+    std::sort(fragments.begin(), fragments.end());
+
+    return fragments;
+}
+
+// Add the settings of a template source to the template. 
+// The categories already defined by another source are ignored
+void ConfigParser::TemplateStore::addTemplateSettings(
+    ConfigTemplate& config_template,
+    std::vector<TemplateSetting> settings,
+    const std::filesystem::path& source
+) {
+    // Categories owned by the previous sources
+    std::set<std::string, std::less<>> owned(
+        config_template.m_category_names.begin(),
+        config_template.m_category_names.end()
+    );
+
+    std::set<std::string> ignored;
+
+    for (auto& setting : settings) {
+        std::string category(setting.m_path.getCategory());
+
+        if (owned.find(category) != owned.end()) {
+            if (ignored.insert(category).second) {
+                spdlog::warn(
+                    "Ignoring category \"{}\" of \"{}\"; "
+                    "already defined by another template",
+                    category,
+                    source.c_str()
+                );
+            }
+
+            continue;
+        }
+
+        addBaseSetting(config_template, std::move(setting));
+    }
+}
+
+// Add a validated setting of the base template to the tables
+void ConfigParser::TemplateStore::addBaseSetting(
+    ConfigTemplate& config_template,
+    TemplateSetting setting
+) {
+    ConfigId setting_id = config_template.m_base_config.size();
+    StringPool& strings = *config_template.m_strings;
+
+    // Create the base template table entry
+    const ConfigBaseData& base_data = 
+        config_template.m_base_config.emplace_back(
+            std::move(setting.m_default)
+        );
+
+    config_template.m_descriptions.push_back({
+        strings.intern(setting.m_displayed_name),
+        strings.intern(setting.m_description)
+    });
+
+    // The names repeat across the categories, the tables reference 
+    // a single copy of each of them
+    ConfigPathView path(
+        strings.intern(setting.m_path.getCategory()),
+        strings.intern(setting.m_path.getName())
+    );
+
+    config_template.m_config_ids[path] = setting_id;
+
+    // Index the category the first time one of its settings is added
+    auto category = 
+        config_template.m_category_indexes.find(path.getCategory());
+
+    if (category == config_template.m_category_indexes.end()) {
+        category = config_template.m_category_indexes.emplace(
+            path.getCategory(),
+            config_template.m_category_names.size()
+        ).first;
+
+        config_template.m_category_names.push_back(path.getCategory());
+        config_template.m_category_settings.emplace_back();
+    }
+
+    // Add the setting to the settings of its category
+    std::vector<ConfigMetadata>& metadatas = 
+        config_template.m_category_settings[category->second];
+
+    config_template.m_locations.push_back({
+        category->second,
+        metadatas.size()
+    });
+
+    metadatas.emplace_back(path, base_data.getType(), setting_id);
+}
+
+// Build the default snapshot of the categories of the given
+// template that don't have one yet, merging the values of 
+// the system layers
+void ConfigParser::TemplateStore::addCategoryDefaults(
+    ConfigTemplate& config_template
+) const {
+    for (size_t category = config_template.m_defaults.size(); 
+        category < config_template.m_category_names.size();
+        category++
+    ) {
+        const auto& metadatas = 
+            config_template.m_category_settings[category];
+
+        auto snapshot = std::make_shared<CategorySnapshot>();
+        snapshot->m_values.reserve(metadatas.size());
+        snapshot->m_layers.resize(metadatas.size(), ConfigLayer::Default);
+
+        for (size_t index = 0; index < metadatas.size(); index++) {
+            const ConfigMetadata& metadata = metadatas[index];
+            const ConfigBaseData& base_data = 
+                config_template.m_base_config[metadata.getId()];
+
+            snapshot->m_values.push_back(base_data.getDefault());
+
+            // The merged value is the one of the last layer
+            for (ConfigLayer layer : {ConfigLayer::Vendor, ConfigLayer::Site}) {
+                const auto& layer_values = 
+                    m_layer_values[static_cast<size_t>(layer)];
+                auto value = layer_values.find(metadata.getPath());
+
+                if (value == layer_values.end())
+                    continue;
+
+                if (getValueType(value->second) != base_data.getType()) {
+                    spdlog::warn(
+                        "Ignoring {} value of \"{}:{}\"; "
+                        "wrong type (expected: {})",
+                        configLayerStr(layer),
+                        metadata.getPath().getCategory(),
+                        metadata.getPath().getName(),
+                        configTypeStr(base_data.getType())
+                    );
+
+                    continue;
+                }
+
+                snapshot->m_overrides[static_cast<size_t>(layer)].emplace(
+                    index, value->second
+                );
+                snapshot->m_values[index] = value->second;
+                snapshot->m_layers[index] = layer;
+            }
+        }
+
+        config_template.m_defaults.push_back(std::move(snapshot));
+    }
+}
+
+// Publish the given template, it's kept alive until the store
+// is destroyed so the references to it remain valid
+void ConfigParser::TemplateStore::publishTemplate(
+    std::unique_ptr<ConfigTemplate> config_template
+) {
+    addCategoryDefaults(*config_template);
+
+    m_template.store(config_template.get(), std::memory_order_release);
+    m_templates.push_back(std::move(config_template));
+}
+
+// Return the file descriptor notifying changes in the template
+// fragments directory, to be used in poll. Negative if no fragments
+// directory is used.
+int ConfigParser::TemplateStore::getFragmentWatchFd() const
+{
+    if (!m_fragment_watcher.has_value())
+        return -1;
+
+    return m_fragment_watcher->getFd();
+}
+
+// Read the pending fragment events and merge the new fragments in
+// the template. Changes to an already loaded fragment are ignored,
+// existing categories can't change while the daemon runs
+//
+// Return the categories that were added
+std::vector<std::string> 
+ConfigParser::TemplateStore::processFragmentEvents()
+{
+    std::vector<std::string> added;
+
+    if (!m_fragment_watcher.has_value())
+        return added;
+
+    std::vector<std::string> files = m_fragment_watcher->readEvents();
+
+    // The directory may have been recreated
+    m_fragment_watcher->addWatch();
+
+    for (const auto& file : files) {
+        std::filesystem::path fragment = m_fragments_path / file;
+
+        if (fragment.extension() != ".json")
+            continue;
+
+        if (m_loaded_fragments.find(file) != m_loaded_fragments.end()) {
+            spdlog::warn(
+                "Template fragment \"{}\" changed, "
+                "restart the daemon to apply it",
+                fragment.c_str()
+            );
+
+            continue;
+        }
+
+        std::vector<TemplateSetting> settings;
+
+        try {
+            settings = loadTemplateSource(
+                fragment, 
+                getFragmentCachePath(fragment)
+            );
+        } catch (std::exception& e) {
+            spdlog::error(
+                "Ignoring fragment \"{}\": {}",
+                fragment.c_str(),
+                e.what()
+            );
+
+            continue;
+        }
+
+        m_loaded_fragments.insert(file);
+
+        spdlog::info("Adding template fragment \"{}\"", fragment.c_str());
+
+        // Build the new template from a copy of the current one, the
+        // parsers keep using the old one until they are updated
+        auto config_template = 
+            std::make_unique<ConfigTemplate>(getTemplate());
+        size_t first_category = config_template->m_category_names.size();
+
+        addTemplateSettings(
+            *config_template,
+            std::move(settings),
+            fragment
+        );
+
+        // Only new categories are added, the existing ones keep
+        // their index
+        for (size_t category = first_category; 
+            category < config_template->m_category_names.size(); 
+            category++
+        ) {
+            added.emplace_back(config_template->m_category_names[category]);
+        }
+
+        publishTemplate(std::move(config_template));
+    }
+
+    return added;
+}
+
+// Create the writer state of the categories of the given template
+// that don't have one yet
+void ConfigParser::addCategoryStates(const ConfigTemplate& config_template)
+{
+    while (m_categories.size() < config_template.m_category_names.size()) {
+        m_categories.push_back(std::make_unique<CategoryState>());
+    }
+}
+
+// Switch to the current template of the template store once it
+// merged new fragments
+void ConfigParser::updateTemplate()
+{
+    const ConfigTemplate& config_template = m_template_store->getTemplate();
+
+    {
+        // Wait for the operations in progress on the categories, the
+        // category tables grow
+        std::unique_lock<std::shared_mutex> guard(m_structure_mutex);
+
+        if (&config_template == &getTemplate())
+            return;
+
+        // Publish the values before the template, a reader finding 
+        // a new id in the template always find its value
+        addCategoryStates(config_template);
+        publishSnapshot(config_template);
+        m_template.store(&config_template, std::memory_order_release);
+    }
+
+    // Apply the user values of the new categories
+    std::shared_lock<std::shared_mutex> guard(m_structure_mutex);
+    reloadUserConfig();
+}
+
+// Parse the user configuration of every category again, the
+// categories whose content didn't change are skipped
+void ConfigParser::reloadUserConfig()
+{
+    if (m_split) {
+        for (size_t category = 0; category < m_categories.size(); category++) {
+            reloadCategoryFile(category);
+        }
+
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(m_file_mutex);
+
+    parseUserConfig();
+}
+
+// Parse the user configuration data using the data stored in 
+// the base configuration map
+void ConfigParser::parseUserConfig()
+{
+    std::vector<UserCategory> user_config;
+
+    spdlog::debug("Parsing user config file ({})", m_user_config_path.c_str());
+
+    try {
+        // If the file doesn't exist throw an exception
+        if (std::filesystem::exists(m_user_config_path)) {
+            // Parse the user config file, the settings are only
+            // converted for the categories that changed
+            user_config = loadUserContent(
+                readFile(m_user_config_path),
+                m_format
+            );
+        } else {
+            throw std::runtime_error(
+                "User config file not found"
+            );
+        }
+        
+    // TODO: catch proper exception type
+    } catch (std::exception& e) {
+        spdlog::error(
+            "Exception while opening user config file: {}",
+            e.what()
+        );
+
+        return;
+    }
+
+    // The file is read and parsed before locking the categories, the
+    // sets don't wait for the disk
+    std::vector<std::unique_lock<std::mutex>> guards = lockAllCategories();
+    const ConfigTemplate& config_template = getTemplate();
+
+    std::vector<ConfigId> updated;
+    CategoryUpdates categories;
+
+    // Categories found in the file
+    std::set<size_t> found;
+
+    // Iterate over all categories
+    for (auto& category: user_config) {
+        const std::string& category_name = category.m_name;
+
+        if (!category.m_is_object) {
+            spdlog::warn(
+                "Ignoring \"{}: {}\"; category must be an object",
+                m_user_config_path.c_str(), category_name
+            );
 
-    // Check if settings is in the user settings table
-    if (m_user_config.find(config_path) != m_user_config.end()) {
-        return m_user_config[config_path];
-    }
+            continue;
+        }
 
-    // Return the base template default value otherwise
-    if (m_base_config.find(config_path) != m_base_config.end()) {
-        return m_base_config[config_path].getDefault();
-    }
+        auto category_index = 
+            config_template.m_category_indexes.find(category_name);
 
-    spdlog::warn(
-        "getConfig failed: setting not found ({}:{})",
-        config_path.getCategory(),
-        config_path.getName()
-    );
+        if (category_index == config_template.m_category_indexes.end()) {
+            spdlog::warn(
+                "Ignoring \"{}: {}\"; category not in base config",
+                m_user_config_path.c_str(), category_name
+            );
 
-    // Return nullopt if the setting was not found
-    return std::nullopt;
-}
+            continue;
+        }
 
-// Return the json object associated with the requested setting.
-// Settings are retrieved from the configuration files according
-// to they name and category.
-//
-// Return Ok if the operation was successful 
-// Return NotFound if the requested setting is not found 
-// in the base template configuration.
-// Return TypeMismatch if the type of the given json object doesn't match
-// the type of the settings in the base template configuration.
-ConfigParser::SetStatus ConfigParser::setConfigJson(
-    const ConfigPath& config_path,
-    nlohmann::json data
-) {
-    // Check for config file updates and parse the file if necessary
-    checkConfigFileUpdate();
+        found.insert(category_index->second);
 
-    spdlog::debug(
-        "Updating setting: \"{}:{}\"",
-        config_path.getCategory(),
-        config_path.getName()
-    );
+        // Skip the categories that didn't change since the last parse
+        CategoryState& state = *m_categories[category_index->second];
 
-    // Check if the setting is in the base template table
-    if (m_base_config.find(config_path) == m_base_config.end()) {
-        spdlog::warn(
-            "setConfig failed: setting not found ({}:{})",
-            config_path.getCategory(),
-            config_path.getName()
-        );
+        if (state.m_content == category.m_content)
+            continue;
 
-        return SetStatus::NotFound;
-    }
+        loadUserSettings(category);
+        state.m_content = std::move(category.m_content);
 
-    // Check if the provided data type matches the expected one
-    if (m_base_config[config_path].getType() != getConfigType(data)) {
-        spdlog::warn(
-            "setConfig failed: type mismatch (expected: {}; got: {})",
-            configTypeStr(m_base_config[config_path].getType()),
-            configTypeStr(getConfigType(data))
+        auto snapshot = parseUserCategory(
+            m_user_config_path,
+            category_index->second,
+            category.m_settings,
+            updated
         );
 
-        return SetStatus::TypeMismatch;
+        if (snapshot != nullptr)
+            categories.emplace(category_index->second, std::move(snapshot));
     }
 
-    if (m_user_config.find(config_path) == m_user_config.end()) {
-        m_user_config[config_path] = data;
+    // The categories removed from the file go back to the defaults.
+    // A set clears the content, so the categories holding user values
+    // are checked whatever their content
+    std::shared_ptr<const ConfigSnapshot> current = m_snapshot.load();
+    size_t user = static_cast<size_t>(ConfigLayer::User);
 
-        try {
-            storeUserCofig();
+    for (size_t category = 0; category < m_categories.size(); category++) {
+        CategoryState& state = *m_categories[category];
 
-        // TODO: catch proper exception type
-        } catch (std::exception& e) {
-            // Revert any changes to the stored configuration
-            m_user_config.erase(config_path);
-           
-            spdlog::warn(
-                "setConfig failed: file error ({})",
-                e.what()
-            ); 
+        if (found.count(category) != 0)
+            continue;
 
-            return SetStatus::FileError;
-        }
-    } else {
-        // Store the old data to revert changes in case of write failure
-        nlohmann::json old_data = m_user_config[config_path];
-        
-        m_user_config[config_path] = data;
+        state.m_content.reset();
 
-        try {
-            storeUserCofig();
+        if (current->m_categories[category]->m_overrides[user].empty())
+            continue;
 
-        // TODO: catch proper exception type
-        } catch (std::exception& e) {
-            // Revert any changes to the stored configuration
-            m_user_config[config_path] = old_data;
-            
-            spdlog::warn(
-                "setConfig failed: file error ({})",
-                e.what()
-            ); 
+        auto snapshot = parseUserCategory(
+            m_user_config_path,
+            category,
+            {},
+            updated
+        );
 
-            return SetStatus::FileError;
-        }
+        if (snapshot != nullptr)
+            categories.emplace(category, std::move(snapshot));
     }
 
-    // Set was update to true and return Ok
-    m_updated = true;
-    m_updated_config.push_back(config_path);
+    // Publish all the updated categories at once and notify the change,
+    // a user value hidden by a runtime value changes nothing visible
+    if (!categories.empty())
+        publishCategories(categories, updated);
 
-    return SetStatus::Ok;
+    if (!updated.empty())
+        notifyChange(updated);
 }
 
-// If the user configuration file was update since last calling this
-// function, return a vector with all the config path that were updated 
-std::vector<ConfigParser::ConfigPath> ConfigParser::updatedConfigs()
-{
-    std::lock_guard<std::mutex> guard(m_mutex);
+// Check the user configuration file at the given path against its
+// last known good copy before it's parsed, a corrupt file is restored
+// from the copy
+void ConfigParser::checkUserFile(
+    const std::filesystem::path& path,
+    bool category
+) {
+    // A removed file is not corrupt, the user values are reset
+    if (!std::filesystem::exists(path))
+        return;
 
-    std::vector<ConfigPath> updated = m_updated_config;
-    m_updated_config.clear();
+    std::filesystem::path good_path = getGoodCopyPath(path);
+    std::optional<uint64_t> checksum = readFileChecksum(good_path);
 
-    return std::move(updated);
-}
+    try {
+        std::string data = readFile(path);
 
-// Return true if the any configuration was updated since 
-// last calling this function
-bool ConfigParser::wasUpdated() 
-{
-    std::lock_guard<std::mutex> guard(m_mutex);
+        // The file is the one we wrote, it's parsed only once
+        if (checksum.has_value() && checksumData(data) == checksum)
+            return;
 
-    // Check if the config file was updated and parse the config
-    // file if necessary
-    checkConfigFileUpdate();
+        // The file was edited or written before the copy existed,
+        // it becomes the new copy if it can be parsed
+        if (category)
+            loadUserCategory(data, m_format);
+        else
+            loadUserConfig(data, m_format);
 
-    bool was_updated = m_updated;
-    m_updated = false;
+        writeChecksummedFile(good_path, data);
+        return;
+    } catch (std::runtime_error& e) {
+        spdlog::error(
+            "User config file {} is corrupt: {}",
+            path.c_str(), e.what()
+        );
+    }
 
-    return was_updated;
-}
+    std::optional<std::string> content = readChecksummedFile(good_path);
 
-// Store the content of m_user_config to the user configuration file
-//
-// Raise an exception if the write fail
-void ConfigParser::storeUserCofig()
-{
-    // Generate the json object
-    nlohmann::json json_config;
+    if (!content.has_value()) {
+        spdlog::error(
+            "No valid last known good copy of {} to restore",
+            path.c_str()
+        );
 
-    spdlog::debug(
-        "Writing on user config file ({})",
-        m_user_config_path.c_str()
+        return;
+    }
+
+    // The file may hold edits made by hand, it's kept aside so they
+    // are not lost, for example ~/.config/coil/user.json.corrupt.<time>
+    std::filesystem::path corrupt_path = path;
+    corrupt_path += ".corrupt." + std::to_string(
+        std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()
+        ).count()
     );
 
-    for (const auto& setting : m_user_config) {
-        const ConfigPath& path = setting.first;
+    std::error_code error;
+    std::filesystem::rename(path, corrupt_path, error);
 
-        // Store the configuration data at the appropriate path
-        json_config[path.getCategory()][path.getName()] = setting.second;
+    if (error) {
+        spdlog::error(
+            "Failed to move {} aside, it's not restored: {}",
+            path.c_str(), error.message()
+        );
+
+        return;
     }
 
-    // write prettified JSON to another file
-    // Use a dedicated scope to grantee writing to the file before 
-    // filesystem last_write_time is run
-    {
-        std::string json_str = json_config.dump(4);
+    try {
+        writeFileAtomic(path, *content);
 
-        // If the configuration file doesn't exist warn that 
-        // a new one will be created
-        if (!std::filesystem::exists(m_user_config_path)) {
-            spdlog::warn(
-                "Configuration file not found, creating one at: {}",
-                m_user_config_path.c_str()
-            );
-        }
-        
-        // Enable exceptions for write failure
-        std::ofstream user_config_f(m_user_config_path);
-        user_config_f.exceptions(
-            std::ofstream::failbit | std::ofstream::badbit 
+    } catch (std::exception& e) {
+        spdlog::error(
+            "Failed to restore {}: {}",
+            path.c_str(), e.what()
         );
 
-        user_config_f << json_str << std::endl;
+        return;
     }
 
-    // Update the last write time
-    m_last_write = std::filesystem::last_write_time(m_user_config_path);
+    spdlog::warn(
+        "User config file {} restored from its last known good copy, "
+        "the corrupt file was moved to {}",
+        path.c_str(), corrupt_path.c_str()
+    );
+}
+
+// Return the path of the last known good copy of the user
+// configuration file at the given path, for example
+// ~/.config/coil/user.json.good
+std::filesystem::path ConfigParser::getGoodCopyPath(
+    const std::filesystem::path& path
+) {
+    std::filesystem::path good_path = path;
+    good_path += ".good";
+
+    return good_path;
 }
 
-// Parse the base configuration and populate m_base_config
-void ConfigParser::parseBaseConfig()
+// Parse the file of the given category if it changed since the last
+// read or write, publish the category and notify the change
+void ConfigParser::reloadCategoryFile(size_t category)
 {
-    nlohmann::json base_config;
+    std::lock_guard<std::mutex> file_guard(m_file_mutex);
 
-    spdlog::debug("Parsing base config file ({})", m_base_path.c_str());
+    CategoryState& state = *m_categories[category];
+    std::filesystem::path path = getCategoryPath(category);
+    std::optional<FileStamp> stamp = getFileStamp(path);
 
-    // If the file doesn't exist throw an exception
-    if (std::filesystem::exists(m_base_path)) {
-        try {
-            // Parse the base template json
-            std::ifstream file(m_base_path);
-            base_config = nlohmann::json::parse(file);
-        } catch (std::exception& e) {
-            spdlog::error(
-                "Exception while parsing base config file json: {}",
-                e.what()
-            );
+    // A deleted file is ignored, like the user configuration file.
+    // Our own writes are recognized by their stamp
+    if (!stamp.has_value() || stamp == state.m_last_write)
+        return;
 
-            throw std::runtime_error(
-                "Base config file parsing error"
-            );
-        }
+    spdlog::debug("Parsing user config file ({})", path.c_str());
 
-    } else {
-        throw std::runtime_error(
-            "Base config file not found"
+    ScopedTimer timer(m_metrics->m_reload);
+    state.m_last_write = stamp;
+
+    UserCategory category_config;
+
+    try {
+        category_config = loadUserCategory(readFile(path), m_format);
+    } catch (std::runtime_error& e) {
+        spdlog::error(
+            "Exception while opening user config file: {}",
+            e.what()
         );
-    }
 
-    // Iterate over all categories
-    for (auto& category: base_config.items()) {
-        std::string category_name = category.key();
+        return;
+    }
 
-        // Iterate over all settings
-        for (auto& setting: category.value().items()) {
-            std::string setting_name = setting.key();
+    if (!category_config.m_is_object) {
+        spdlog::warn(
+            "Ignoring \"{}\"; category must be an object",
+            path.c_str()
+        );
 
-            // Parse the setting field 
-            nlohmann::json default_data = setting.value()["default"];
-            nlohmann::json displayed_name = setting.value()["displayed_name"];
-            nlohmann::json description = setting.value()["description"];
+        return;
+    }
 
-            // Check if all the field exist
-            if (default_data.is_null()) {
-                spdlog::warn(
-                    "Ignoring \"{}: ({}:{})\"; missing default field",
-                    m_base_path.c_str(), category_name, setting_name
-                );
+    // The file is read and parsed before locking the category, the
+    // sets don't wait for the disk
+    std::unique_lock<std::mutex> guard = lockCategory(category);
+    std::vector<ConfigId> updated;
+    auto snapshot = parseUserCategory(
+        path,
+        category,
+        category_config.m_settings,
+        updated
+    );
 
-                continue;
-            }
-            if (displayed_name.is_null()) {
-                spdlog::warn(
-                    "Ignoring \"{}: ({}:{})\"; missing displayed_name field",
-                    m_base_path.c_str(), category_name, setting_name
-                );
+    if (snapshot == nullptr)
+        return;
 
-                continue;
-            }
-            if (description.is_null()) {
-                spdlog::warn(
-                    "Ignoring \"{}: ({}:{})\"; missing description field",
-                    m_base_path.c_str(), category_name, setting_name
-                );
+    publishCategories({{category, std::move(snapshot)}}, updated);
 
-                continue;
-            }
+    if (!updated.empty())
+        notifyChange(updated);
+}
 
-            // Check the type of each field
-            if (default_data.is_object()) {
-                spdlog::warn(
-                    "Ignoring \"{}: ({}:{})\"; default can't be an onject",
-                    m_base_path.c_str(), category_name, setting_name
-                );
+// Parse the settings of a category of the user configuration read
+// from the file at the given path. The settings of the category 
+// missing from the given settings lose their user value.
+// Settings whose merged value changed are appended to the updated vector.
+//
+// Return the new snapshot of the category
+// Return nullptr if no user value changed
+std::shared_ptr<const ConfigParser::CategorySnapshot> 
+ConfigParser::parseUserCategory(
+    const std::filesystem::path& path,
+    size_t category,
+    const std::vector<UserSetting>& settings,
+    std::vector<ConfigId>& updated
+) {
+    const ConfigTemplate& config_template = getTemplate();
+    std::string_view category_name = 
+        config_template.m_category_names[category];
+    const auto& metadatas = config_template.m_category_settings[category];
+
+    // Only the lock holder publishes the category, it can't change
+    auto snapshot = std::make_shared<CategorySnapshot>(
+        *m_snapshot.load()->m_categories[category]
+    );
+    auto& user_values = 
+        snapshot->m_overrides[static_cast<size_t>(ConfigLayer::User)];
 
-                continue;
-            }
-            if (!displayed_name.is_string()) {
-                spdlog::warn(
-                    "Ignoring \"{}: ({}:{})\"; displayed_name has wrong type",
-                    m_base_path.c_str(), category_name, setting_name
-                );
+    // Store true if any user value changed, even if it's hidden by
+    // a runtime value
+    bool changed = false;
 
-                continue;
-            }
-            if (!description.is_string()) {
-                spdlog::warn(
-                    "Ignoring \"{}: ({}:{})\"; description has wrong type",
-                    m_base_path.c_str(), category_name, setting_name
-                );
+    // Settings with a valid value in the file, indexed by position
+    std::vector<bool> parsed(metadatas.size(), false);
 
-                continue;
-            }
+    // Iterate over all settings
+    for (const auto& setting: settings) {
+        const std::string& setting_name = setting.m_name;
 
-            // Create the config path object
-            ConfigPath setting_path(category_name, setting_name);
+        std::optional<ConfigId> setting_id = 
+            getConfigId({category_name, setting_name});
 
-            // Create the base storage object
-            ConfigBaseData setting_data(
-                default_data,
-                displayed_name.get<std::string>(),
-                description.get<std::string>()
+        // Check if the setting exist in the base config
+        if (!setting_id.has_value()) {
+            spdlog::warn(
+                "Ignoring \"{}: ({}:{})\"; setting not in base config",
+                path.c_str(), category_name, setting_name
             );
 
-            // Create the base template table entry
-            m_base_config[setting_path] = setting_data;
+            continue;
+        }
 
-            // Add the setting to the configuration structure map
-            // TODO: Fix this cast to string
-            std::vector<ConfigMetadata>& metadatas = m_config_structure[
-                std::string(setting_path.getCategory())
-            ];
+        // Retrieve the base config data
+        const ConfigBaseData& base_data = 
+            config_template.m_base_config[*setting_id]; 
 
-            metadatas.emplace_back(
-                setting_path, 
-                getConfigType(default_data)
-            );
+        // The loader converted the setting, the conversion also
+        // infer the type
+        const ConfigValue& setting_data = setting.m_value;
 
-            // Log the successful setting creation
-            spdlog::debug(
-                "Found config \"{}:{}\" - {}",
+        // Check if the type of the setting is correct
+        if (base_data.getType() != getValueType(setting_data)) {
+            spdlog::warn(
+               "Ignoring \"{}: ({}:{})\"; wrong type (expected: {})",
+                path.c_str(),
                 category_name,
                 setting_name,
-                configTypeStr(getConfigType(default_data))
+                configTypeStr(base_data.getType())
             );
-        }
-    }
-}
-
-// Parse the user configuration data using the data stored in 
-// the base configuration map
-void ConfigParser::parseUserConfig()
-{
-    nlohmann::json user_config;
-
-    spdlog::debug("Parsing user config file ({})", m_user_config_path.c_str());
 
-    try {
-        // If the file doesn't exist throw an exception
-        if (std::filesystem::exists(m_user_config_path)) {
-            // Parse the user config json
-            std::ifstream file(m_user_config_path);
-            user_config = nlohmann::json::parse(file);
-        } else {
-            throw std::runtime_error(
-                "User config file not found"
-            );
+            continue;
         }
-        
-    // TODO: catch proper exception type
-    } catch (std::exception& e) {
-        spdlog::error(
-            "Exception while opening user config file: {}",
-            e.what()
-        );
-
-        return;
-    }
 
-    // Iterate over all categories
-    for (auto& category: user_config.items()) {
-        std::string category_name = category.key();
+        size_t index = config_template.m_locations[*setting_id].m_index;
+        parsed[index] = true;
 
-        // Iterate over all settings
-        for (auto& setting: category.value().items()) {
-            std::string setting_name = setting.key();
-            nlohmann::json setting_data = setting.value();
+        // Check if the setting was updated and push the id 
+        // to updated, new settings are always updated
+        auto user_value = user_values.find(index);
 
-            ConfigPath setting_path(category_name, setting_name);
+        if (user_value == user_values.end() || 
+            user_value->second != setting_data
+        ) {
+            changed = true;
 
-            // Check if the setting exist in the base config
-            if (m_base_config.find(setting_path) == m_base_config.end()) {
-                spdlog::warn(
-                    "Ignoring \"{}: ({}:{})\"; setting not in base config",
-                    m_user_config_path.c_str(), category_name, setting_name
-                );
+            // Update the user value of the category
+            user_values[index] = setting_data;
 
-                continue;
+            if (!isHidden(*snapshot, index, ConfigLayer::User)) {
+                mergeSetting(config_template, category, *snapshot, index);
+                updated.push_back(*setting_id);
             }
+        }
 
-            // Retrieve the base config data
-            const ConfigBaseData& base_data = m_base_config[setting_path]; 
+        spdlog::debug(
+            "Found user config for \"{}:{}\"",
+            category_name,
+            setting_name
+        );
+    }
 
-            // Check if the type of the setting is correct
-            if (base_data.getType() != getConfigType(setting_data)) {
-                spdlog::warn(
-                   "Ignoring \"{}: ({}:{})\"; wrong type (expected: {})",
-                    m_user_config_path.c_str(),
-                    category_name,
-                    setting_name,
-                    configTypeStr(getConfigType(setting_data))
-                );
+    // Reset the settings that are no longer in the file, they go back
+    // to the value of the system layers
+    for (auto user_value = user_values.begin(); 
+        user_value != user_values.end();
+    ) {
+        size_t index = user_value->first;
 
-                continue;
-            }
+        if (parsed[index]) {
+            ++user_value;
+            continue;
+        }
 
-            // Check if the setting was already in the user config map
-            if (m_user_config.find(setting_path) != m_user_config.end()) {
-                // Check if the setting was updated and push the path 
-                // to m_updated_config
-                nlohmann::json old_data = m_user_config[setting_path];
+        const ConfigMetadata& metadata = metadatas[index];
 
-                if (old_data != setting_data) {
-                    m_updated_config.push_back(setting_path);
-                    m_updated = true;
-                }
-            } else {
-                // If the setting is new push it to updated config
-                m_updated_config.push_back(setting_path);
-                m_updated = true;
-            }
+        spdlog::debug(
+            "User config removed for \"{}:{}\"",
+            metadata.getPath().getCategory(),
+            metadata.getPath().getName()
+        );
 
-            // Update the user config table
-            m_user_config[setting_path] = setting_data;
+        user_value = user_values.erase(user_value);
+        changed = true;
 
-            spdlog::debug(
-                "Found user config for \"{}:{}\"",
-                setting_path.getCategory(),
-                setting_path.getName()
-            );
+        if (!isHidden(*snapshot, index, ConfigLayer::User)) {
+            mergeSetting(config_template, category, *snapshot, index);
+            updated.push_back(metadata.getId());
         }
     }
+
+    if (!changed)
+        return nullptr;
+
+    // A category left without user value goes back to the shared
+    // defaults, the copy is released
+    return shareDefaults(config_template, category, std::move(snapshot));
 }
 
 // Check if the user configuration file was updated since the last
 // read and parse it again if necessary
 void ConfigParser::checkConfigFileUpdate()
 {
+    std::lock_guard<std::mutex> guard(m_file_mutex);
+
+    std::optional<FileStamp> stamp = getFileStamp(m_user_config_path);
+
     // Only check for updates if the user config file exist
     // if the file was deleted update will be ignored
-    if (std::filesystem::exists(m_user_config_path)) {
-        std::filesystem::file_time_type write_time = 
-            std::filesystem::last_write_time(m_user_config_path);
+    if (!stamp.has_value())
+        return;
 
-        // If the write time don't match an updated occurred
-        // and parse the config file
-        if (m_last_write != write_time) {
-            spdlog::debug(
-                "User config file change detected ({})",
-                m_user_config_path.c_str()
-            );
+    // If the stamp don't match an updated occurred
+    // and parse the config file
+    if (m_last_write != stamp) {
+        spdlog::debug(
+            "User config file change detected ({})",
+            m_user_config_path.c_str()
+        );
 
-            parseUserConfig();
-            m_last_write = write_time;
-        }
+        ScopedTimer timer(m_metrics->m_reload);
+
+        parseUserConfig();
+        m_last_write = stamp;
+    }
+}
+
+// Lock the mutex serializing the writers of a category, 
+// recording the wait
+std::unique_lock<std::mutex> ConfigParser::lockCategory(size_t category)
+{
+    std::mutex& mutex = m_categories[category]->m_mutex;
+
+    // Most locks are uncontended, only the failed attempts are timed
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+
+    if (lock.owns_lock()) {
+        m_metrics->m_mutex_wait.record(std::chrono::nanoseconds(0));
+        return lock;
+    }
+
+    ScopedTimer timer(m_metrics->m_mutex_wait);
+    lock.lock();
+
+    return lock;
+}
+
+// Lock the mutex of every category in index order
+std::vector<std::unique_lock<std::mutex>> ConfigParser::lockAllCategories()
+{
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(m_categories.size());
+
+    for (size_t category = 0; category < m_categories.size(); category++) {
+        locks.push_back(lockCategory(category));
     }
+
+    return locks;
 }
 
-// Return a constant reference to an entry of the base template 
-// configuration table if it exist.
-// Return nullopt if it doesn't 
-std::optional<std::reference_wrapper<const ConfigParser::ConfigBaseData>> 
-ConfigParser::getBaseConfig(
-    const ConfigPath& config_path
+// Lock the mutex of the given categories in index order
+std::vector<std::unique_lock<std::mutex>> ConfigParser::lockCategories(
+    const std::set<size_t>& categories
 ) {
-    if (m_base_config.find(config_path) != m_base_config.end()) {
-        return m_base_config[config_path];
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(categories.size());
+
+    for (size_t category : categories) {
+        locks.push_back(lockCategory(category));
     }
 
-    return std::nullopt;
+    return locks;
+}
+
+// Return the stamp of the file at the given path
+// Return nullopt if the file doesn't exist
+std::optional<ConfigParser::FileStamp> ConfigParser::getFileStamp(
+    const std::filesystem::path& path
+) {
+    struct stat file_stat;
+
+    if (stat(path.c_str(), &file_stat) != 0)
+        return std::nullopt;
+
+    FileStamp stamp;
+    stamp.m_device = file_stat.st_dev;
+    stamp.m_inode = file_stat.st_ino;
+    stamp.m_size = file_stat.st_size;
+    stamp.m_mtime_nsec = 
+        static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 +
+        file_stat.st_mtim.tv_nsec;
+
+    return stamp;
 }
 
 // Return the array type of the given json element
 // Return None if the array is not homogeneous 
 // Return None if the given object is not an array 
-ConfigParser::ConfigType ConfigParser::getArrayType(nlohmann::json data)
+ConfigParser::ConfigType ConfigParser::getArrayType(
+    const nlohmann::json& data
+)
 {
     // Check if the given object is an array
     if (data.type() != nlohmann::json::value_t::array) 
@@ -566,7 +2753,7 @@ ConfigParser::ConfigType ConfigParser::getArrayType(nlohmann::json data)
 
 // Return the setting type
 ConfigParser::ConfigType ConfigParser::getConfigType(
-    nlohmann::json data
+    const nlohmann::json& data
 ) {
     switch (data.type()) {
         case nlohmann::json::value_t::number_integer:
@@ -587,6 +2774,79 @@ ConfigParser::ConfigType ConfigParser::getConfigType(
     }
 }
 
+// Convert a json object to a setting value
+// Return monostate if the json type isn't a valid setting type
+ConfigParser::ConfigValue ConfigParser::toConfigValue(
+    const nlohmann::json& data
+) {
+    switch (getConfigType(data)) {
+        case ConfigType::Int:
+            return ConfigValue(
+                std::in_place_type<int64_t>, data.get<int64_t>()
+            );
+        case ConfigType::Bool:
+            return ConfigValue(std::in_place_type<bool>, data.get<bool>());
+        case ConfigType::Float:
+            return ConfigValue(std::in_place_type<double>, data.get<double>());
+        case ConfigType::String:
+            return ConfigValue(
+                std::in_place_type<std::string>, data.get<std::string>()
+            );
+        case ConfigType::ArrayInt:
+            return ConfigValue(
+                std::in_place_type<std::vector<int64_t>>,
+                data.get<std::vector<int64_t>>()
+            );
+        case ConfigType::ArrayFloat:
+            return ConfigValue(
+                std::in_place_type<std::vector<double>>,
+                data.get<std::vector<double>>()
+            );
+        case ConfigType::ArrayString:
+            return ConfigValue(
+                std::in_place_type<std::vector<std::string>>,
+                data.get<std::vector<std::string>>()
+            );
+
+        default:
+            return ConfigValue();
+    }
+}
+
+// Convert a setting value to a json object
+nlohmann::json ConfigParser::toJson(const ConfigValue& value)
+{
+    return std::visit([](const auto& data) -> nlohmann::json {
+        using Type = std::decay_t<decltype(data)>;
+
+        if constexpr (std::is_same<Type, std::monostate>::value) {
+            return nullptr;
+        } else {
+            return data;
+        }
+    }, value);
+}
+
+// Return a string representation of the layer
+std::string_view ConfigParser::configLayerStr(ConfigLayer layer)
+{
+    switch (layer) {
+        case ConfigLayer::Default:
+            return "Default";
+        case ConfigLayer::Vendor:
+            return "Vendor";
+        case ConfigLayer::Site:
+            return "Site";
+        case ConfigLayer::User:
+            return "User";
+        case ConfigLayer::Runtime:
+            return "Runtime";
+
+        default:
+            return "Unknow layer";
+    }
+}
+
 // Return a string representation of the type 
 std::string_view ConfigParser::configTypeStr(ConfigType type)
 {
@@ -1,17 +1,42 @@
 #ifndef COIL_CONFIG_PARSER_H
 #define COIL_CONFIG_PARSER_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
 #include <map>
+#include <set>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 #include <type_traits>
 
+#include <sys/types.h>
+
+#include "coil/settingHandle.h"
+#include "coil/userFormat.h"
+
+#include "fileWatcher.h"
+#include "journal.h"
+#include "metrics.h"
+#include "stringPool.h"
+
 namespace coil {
 
+struct TemplateSetting;
+struct UserSetting;
+
 // Json configuration parser
 class ConfigParser {
 public:
@@ -29,18 +54,93 @@ public:
         ArrayString
     };
 
+    // Store a setting value converted to its native type.
+    // The alternative index match the ConfigType value, 
+    // monostate is used for None
+    using ConfigValue = std::variant<
+        std::monostate,
+
+        int64_t,
+        bool,
+        double,
+        std::string,
+
+        std::vector<int64_t>,
+        std::vector<double>,
+        std::vector<std::string>
+    >;
+
+    // Layer of the configuration stack providing a value, a value of
+    // a layer hides the values of the layers before it.
+    // Default, Vendor and Site are read from the system files and
+    // shared by every user, User is stored in the user configuration
+    // and Runtime is only kept in memory until the daemon exits
+    enum class ConfigLayer {
+        Default = 0,
+        Vendor,
+        Site,
+        User,
+        Runtime
+    };
+
+    // Number of layers of the configuration stack
+    static constexpr size_t c_layer_count = 5;
+
+    // Dense identifier of a setting, assigned when the base template 
+    // is parsed. Used as index in the setting tables
+    using ConfigId = size_t;
+
+    // Point to the location of a setting without owning the strings,
+    // the template tables reference the strings of its pool
+    struct ConfigPathView {
+        ConfigPathView() = default;
+        ConfigPathView(
+            std::string_view category, std::string_view name
+        ) : m_category(category), m_name(name) { }
+
+        // Return the setting category
+        std::string_view getCategory() const { return m_category; }
+        // Return the setting name
+        std::string_view getName() const { return m_name; }
+
+        // Order by category then by name
+        auto operator <=>(const ConfigPathView& rhs) const = default;
+        bool operator ==(const ConfigPathView& rhs) const = default;
+
+    private:
+        // The category of the setting
+        std::string_view m_category;
+        // The name of the setting
+        std::string_view m_name;
+    };
+
+    // Hash of a path for the unordered maps
+    struct ConfigPathHash {
+        size_t operator ()(const ConfigPathView& path) const
+        {
+            size_t hash = std::hash<std::string_view>()(path.getCategory());
+
+            return hash * 31 + std::hash<std::string_view>()(path.getName());
+        }
+    };
+
     // Point to the location of a setting in the configuration files
     struct ConfigPath {
         ConfigPath() : m_category(), m_name() { }
         ConfigPath(
             std::string_view category, std::string_view name
         ) : m_category(category), m_name(name) { }
+        explicit ConfigPath(ConfigPathView path) : 
+            m_category(path.getCategory()), m_name(path.getName()) { }
 
         // Return the setting category
         std::string_view getCategory() const { return m_category; }
         // Return the setting name
         std::string_view getName() const { return m_name; }
 
+        // Return a view of the path, it's valid as long as the path
+        operator ConfigPathView() const { return {m_category, m_name}; }
+
         // Ordering operator for usage in map
         bool operator <(const ConfigPath& rhs) const
         {
@@ -62,22 +162,63 @@ public:
     struct ConfigMetadata {
         ConfigMetadata() { }
         ConfigMetadata(
-            ConfigPath path, ConfigType type
-        ) : m_path(path), m_type(type) { }
+            ConfigPathView path, ConfigType type, ConfigId id
+        ) : m_path(path), m_type(type), m_id(id) { }
 
-        // Get the configuration path
-        const ConfigPath& getPath() const { return m_path; } 
+        // Get the configuration path, its strings belong to the template
+        const ConfigPathView& getPath() const { return m_path; } 
         // Get the configuration type
         ConfigType getType() const { return m_type; }
+        // Get the configuration id
+        ConfigId getId() const { return m_id; }
 
     private:
         // Configuration path
-        ConfigPath m_path;
+        ConfigPathView m_path;
         // Configuration type
         ConfigType m_type;
+        // Configuration id
+        ConfigId m_id;
+    };
+
+    // Text of a setting only shown to the users, stored apart from the
+    // tables used to read and write the values
+    struct ConfigDescription {
+        // Displayed name
+        std::string_view m_displayed_name;
+        // Description
+        std::string_view m_description;
+    };
+
+    // Immutable values of the settings of a category, indexed by the 
+    // position of the setting in the category. A write copies only
+    // the snapshot of its own category. The categories without user 
+    // or runtime value share the default snapshot of the template
+    struct CategorySnapshot {
+        // Merged value of every setting, taken from the last layer
+        // holding one. Only the changed settings are merged again
+        std::vector<ConfigValue> m_values;
+        // Layer providing the merged value of every setting
+        std::vector<ConfigLayer> m_layers;
+        // Values of every layer after Default, keyed by setting position.
+        // Only the settings set by the layer are stored
+        std::array<std::map<size_t, ConfigValue>, c_layer_count> m_overrides;
     };
 
 private:
+    // Identify a version of the user configuration file.
+    // The modification time has the granularity of the kernel clock tick,
+    // the inode and the size are compared as well to tell apart writes
+    // happening in the same tick
+    struct FileStamp {
+        dev_t m_device = 0;
+        ino_t m_inode = 0;
+        off_t m_size = 0;
+        int64_t m_mtime_nsec = 0;
+
+        bool operator ==(const FileStamp& rhs) const = default;
+    };
+
     // Report the status of a set operation
     enum class SetStatus {
         Ok = 0,
@@ -89,60 +230,449 @@ private:
     // Configuration base template data storage
     struct ConfigBaseData {
         ConfigBaseData() { };
-        ConfigBaseData(
-            nlohmann::json default_config,
-            std::string_view displayed_name,
-            std::string_view description
-        ) :
-            m_default(default_config),
-            m_type(getConfigType(default_config)),
-            m_displayed_name(displayed_name),
-            m_description(description)
+        explicit ConfigBaseData(ConfigValue default_config) :
+            m_default(std::move(default_config)),
+            m_type(getValueType(m_default))
         { };
 
-        // Return the settings type
-        nlohmann::json getDefault() const { return m_default; }
+        // Return the settings default value
+        const ConfigValue& getDefault() const { return m_default; }
 
         // Return the settings type
         ConfigType getType() const { return m_type; }
 
-        // Return the settings displayed name
-        std::string_view getDisplayedName() const { return m_displayed_name; }
-        // Return the settings description
-        std::string_view getDescription() const { return m_description; }
-
     private:
         // Store the default configuration
-        nlohmann::json m_default;
+        ConfigValue m_default;
 
-        // The configuration json type
+        // The configuration type
         ConfigType m_type;
+    };
 
-        // Displayed name
-        std::string m_displayed_name;
-        // Description
-        std::string m_description;
+    // Position of a setting in the category tables
+    struct SettingLocation {
+        // Index of the category of the setting
+        size_t m_category;
+        // Index of the setting in its category
+        size_t m_index;
+    };
+
+    // Merged base template of all the sources. A template is never 
+    // modified once published, adding a fragment publishes a new one
+    struct ConfigTemplate {
+        // Strings of the paths and descriptions of the settings. The pool
+        // is shared by the templates merged from this one, a merge only
+        // appends to it
+        std::shared_ptr<StringPool> m_strings = 
+            std::make_shared<StringPool>();
+
+        // Store the base configuration data, indexed by config id
+        std::vector<ConfigBaseData> m_base_config;
+        // Store the position of every setting, indexed by config id
+        std::vector<SettingLocation> m_locations;
+        // Store the displayed text of every setting, indexed by config id.
+        // Never read by the value accesses
+        std::vector<ConfigDescription> m_descriptions;
+        // Map the settings path to their id, only used when a setting
+        // is identified by name
+        std::unordered_map<ConfigPathView, ConfigId, ConfigPathHash> 
+            m_config_ids;
+
+        // Store the meta data of the settings of every category in 
+        // the category order, indexed by category index
+        std::vector<std::vector<ConfigMetadata>> m_category_settings;
+
+        // Name of every category, indexed by category index.
+        // Categories are indexed in the order they are added
+        std::vector<std::string_view> m_category_names;
+        // Map the category names to their index, sorted by name
+        std::map<std::string_view, size_t, std::less<>> m_category_indexes;
+
+        // Snapshot of every category holding only the values of the
+        // Default, Vendor and Site layers, indexed by category index.
+        // Shared by the snapshots of every parser using the template
+        std::vector<std::shared_ptr<const CategorySnapshot>> m_defaults;
     };
 
 public:
-    // Create a configuration parser from the given template 
-    // and user configuration files
+    // Immutable merged view of the base and user configuration.
+    // Readers load the current snapshot without locking, writers build
+    // a new one sharing the snapshots of the other categories
+    struct ConfigSnapshot {
+        // Template locating the settings in the categories
+        const ConfigTemplate* m_template;
+        // Snapshot of every category, indexed by category index
+        std::vector<std::shared_ptr<const CategorySnapshot>> m_categories;
+
+        // Generation of the snapshot, increased by every publication
+        uint64_t m_generation = 0;
+        // Generation of the last publication of every category, indexed
+        // by category index
+        std::vector<uint64_t> m_category_generations;
+
+        // Return the value of the setting with the given id
+        // The id must be lower than size()
+        const ConfigValue& operator [](ConfigId config_id) const
+        {
+            const SettingLocation& location = 
+                m_template->m_locations[config_id];
+
+            return m_categories[location.m_category]->m_values[
+                location.m_index
+            ];
+        }
+
+        // Return the meta data of the setting with the given id, taken
+        // from the template of the snapshot
+        // The id must be lower than size()
+        const ConfigMetadata& getMetadata(ConfigId config_id) const
+        {
+            return findMetadata(*m_template, config_id);
+        }
+
+        // Return the meta data of the settings of the given category,
+        // taken from the template of the snapshot
+        // Return a empty list if the category doesn't exist
+        const std::vector<ConfigMetadata>& getMetadatas(
+            std::string_view category
+        ) const {
+            return findMetadatas(*m_template, category);
+        }
+
+        // Return a list of all the category of the template of the
+        // snapshot
+        std::vector<std::string> getCategories() const
+        {
+            return listCategories(*m_template);
+        }
+
+        // Return the id of the setting at the given path in the template
+        // of the snapshot
+        // Return nullopt if the setting is not in the template
+        std::optional<ConfigId> getConfigId(ConfigPathView config_path) const
+        {
+            auto config_id = m_template->m_config_ids.find(config_path);
+
+            if (config_id == m_template->m_config_ids.end())
+                return std::nullopt;
+
+            return config_id->second;
+        }
+
+        // Return the number of settings
+        size_t size() const { return m_template->m_locations.size(); }
+    };
+
+    // Settings changed after a generation, returned by changesSince
+    struct ChangeSet {
+        // Snapshot the changes were read from, the values of the
+        // settings must be read from it
+        std::shared_ptr<const ConfigSnapshot> m_snapshot;
+        // Generation of the snapshot, to be given to the next call
+        uint64_t m_generation = 0;
+        // Store false if the log no longer holds the changes after the
+        // requested generation, the ids then hold every setting
+        bool m_complete = false;
+        // Changed settings, sorted and without duplicates
+        std::vector<ConfigId> m_config_ids;
+    };
+
+    // Group of changes applied at once. The changes are staged in 
+    // memory and validated by the commit, either all of them are
+    // applied or none, with a single write and a single notification.
+    // Nothing is visible to the readers before the commit
+    class Transaction {
+    public:
+        // Create an empty transaction on the given layer of the parser
+        explicit Transaction(
+            ConfigParser& parser,
+            ConfigLayer layer = ConfigLayer::User
+        ) : m_parser(parser), m_layer(layer) { }
+
+        // Stage a change of the setting at the given path
+        //
+        // Raise an exception if the given config path isn't valid.
+        template <typename Type>
+        void set(ConfigPathView config_path, const Type& data);
+
+        // Stage a change of the setting with the given id
+        template <typename Type>
+        void set(ConfigId config_id, const Type& data);
+
+        // Stage a change of the setting with the given id, the last
+        // change of a setting wins
+        void setValue(ConfigId config_id, ConfigValue value);
+
+        // Stage the removal of the value of the layer of the setting 
+        // with the given id, it goes back to the previous layers
+        void resetValue(ConfigId config_id);
+
+        // Return true if no change is staged
+        bool empty() const { return m_values.empty(); }
+
+        // Apply the staged changes, the transaction is empty afterward
+        //
+        // Raise an exception if any config id isn't valid. 
+        // Raise an exception if any value type doesn't match the 
+        // setting type.
+        // Raise an exception if an error occurred during file writing. 
+        // None of the changes is applied then
+        void commit();
+
+        // Discard the staged changes
+        void abort() { m_values.clear(); }
+
+    private:
+        // Parser the changes are applied to
+        ConfigParser& m_parser;
+        // Layer the changes are applied to
+        ConfigLayer m_layer;
+        // Staged changes in order, monostate removes the user value
+        std::vector<std::pair<ConfigId, ConfigValue>> m_values;
+    };
+
+    // Merged base template of the base file and the fragments. The
+    // parsers of several users can share one store, the template is
+    // then parsed and held in memory once
+    class TemplateStore {
+    public:
+        // Parse the base template and the fragments.
+        // If cache is not empty the validated base template is loaded
+        // from this binary cache when it is up to date, and stored there
+        // otherwise.
+        // If fragments is not empty the json files of this directory are
+        // parsed in parallel and merged with the base template, each
+        // category belongs to the first source defining it.
+        // The vendor and site files hold the values of the Vendor and 
+        // Site layers, like a user configuration in json. They are 
+        // optional and read once.
+        //
+        // Raise exception if neither the base file nor a fragment is found
+        TemplateStore(
+            std::filesystem::path base,
+            std::filesystem::path cache = {},
+            std::filesystem::path fragments = {},
+            std::filesystem::path vendor = {},
+            std::filesystem::path site = {}
+        );
+
+        TemplateStore(const TemplateStore&) = delete;
+        TemplateStore& operator=(const TemplateStore&) = delete;
+
+        // Return a list of all the category of the current template
+        std::vector<std::string> getCategories() const
+        {
+            return listCategories(getTemplate());
+        }
+
+        // Return a list of meta data for the settings in the give category
+        // of the current template
+        // Return a empty list if the category doesn't exist
+        const std::vector<ConfigMetadata>& getMetadatas(
+            std::string_view category
+        ) const {
+            return findMetadatas(getTemplate(), category);
+        }
+
+        // Return the file descriptor notifying changes in the template
+        // fragments directory, to be used in poll. Negative if no
+        // fragments directory is used.
+        // When it becomes readable processFragmentEvents must be called
+        int getFragmentWatchFd() const;
+
+        // Read the pending fragment events and merge the new fragments
+        // in a new template. Changes to an already loaded fragment are
+        // ignored, existing categories can't change while the daemon runs.
+        // The parsers use the new template once updateTemplate is called
+        //
+        // Return the categories that were added
+        std::vector<std::string> processFragmentEvents();
+
+    private:
+        friend class ConfigParser;
+
+        // Parse the base configuration file and the fragments on a thread
+        // pool and publish the merged template
+        // Raise exception if neither the base file nor a fragment is found
+        void parseBaseConfig();
+
+        // Return the validated settings of a template source, loaded from
+        // its cache when it is up to date. The cache is refreshed
+        // otherwise. Safe to call from any thread
+        //
+        // Raise exception if the file can't be parsed
+        std::vector<TemplateSetting> loadTemplateSource(
+            const std::filesystem::path& source,
+            const std::filesystem::path& cache
+        ) const;
+
+        // Parse and validate the template json file at the given path
+        // Raise exception if the file can't be parsed
+        static std::vector<TemplateSetting> readBaseTemplate(
+            const std::filesystem::path& path
+        );
+
+        // Return the cache path of the given fragment, empty if the
+        // cache is disabled
+        std::filesystem::path getFragmentCachePath(
+            const std::filesystem::path& fragment
+        ) const;
+
+        // Return the json files of the fragments directory sorted by name
+        std::vector<std::filesystem::path> listFragments() const;
+
+        // Add the settings of a template source to the template.
+        // The categories already defined by another source are ignored
+        static void addTemplateSettings(
+            ConfigTemplate& config_template,
+            std::vector<TemplateSetting> settings,
+            const std::filesystem::path& source
+        );
+
+        // Add a validated setting of the base template to the tables
+        static void addBaseSetting(
+            ConfigTemplate& config_template,
+            TemplateSetting setting
+        );
+
+        // Read the values of a system layer from the file at the given
+        // path, a missing file leaves the layer empty
+        void readLayerFile(
+            ConfigLayer layer,
+            const std::filesystem::path& path
+        );
+
+        // Build the default snapshot of the categories of the given
+        // template that don't have one yet, merging the values of 
+        // the system layers. The values with the wrong type are ignored
+        void addCategoryDefaults(ConfigTemplate& config_template) const;
+
+        // Publish the given template, it's kept alive until the store
+        // is destroyed so the references to it remain valid
+        void publishTemplate(std::unique_ptr<ConfigTemplate> config_template);
+
+        // Return the current template
+        const ConfigTemplate& getTemplate() const
+        {
+            return *m_template.load(std::memory_order_acquire);
+        }
+
+        // Every template published, the last one is the current. Adding
+        // a fragment is rare, keeping the old ones lets the readers use
+        // the template without locking
+        std::vector<std::unique_ptr<const ConfigTemplate>> m_templates;
+        // Current template
+        std::atomic<const ConfigTemplate*> m_template;
+
+        // Path to configuration base template and default configuration
+        std::filesystem::path m_base_path;
+        // Path to the base template binary cache, empty if disabled
+        std::filesystem::path m_cache_path;
+        // Path to the template fragments directory, empty if disabled
+        std::filesystem::path m_fragments_path;
+
+        // Watch the fragments directory for new fragments
+        std::optional<FileWatcher> m_fragment_watcher;
+        // File name of the fragments merged in the template
+        std::set<std::string> m_loaded_fragments;
+
+        // Values of the Vendor and Site layers by setting path, indexed
+        // by layer. Kept to merge them in the categories of the
+        // fragments added later
+        std::array<
+            std::map<ConfigPath, ConfigValue, std::less<>>,
+            c_layer_count
+        > m_layer_values;
+    };
+
+    // Create a configuration parser from the given template
+    // and user configuration files.
+    // If write_delay is not zero the changes are written to the user
+    // configuration file after the delay, coalescing all the sets done
+    // in the meantime in a single write.
+    // The cache and fragments are used to build the template like
+    // TemplateStore does.
+    // If split is true each category is stored in its own file named
+    // after the category, in the directory of config. A write then
+    // only rewrites the file of its category.
+    // The user configuration is stored in the given format, the category
+    // files are named with the extension of the format.
+    // If journal is true and the writes are delayed, every change is
+    // appended to a journal next to config before being published, the
+    // changes not written before a crash are replayed by the next start
     //
-    // Raise exception if the base file is not found
+    // Raise exception if neither the base file nor a fragment is found
+    ConfigParser(
+        std::filesystem::path base,
+        std::filesystem::path config,
+        std::chrono::milliseconds write_delay = std::chrono::milliseconds(0),
+        std::filesystem::path cache = {},
+        std::filesystem::path fragments = {},
+        bool split = false,
+        UserFormat format = UserFormat::Json,
+        bool journal = false
+    );
+
+    // Create a configuration parser of the given user configuration
+    // file using the template of the given store, the other arguments
+    // are the same as above.
+    // Only the categories with user values use memory of their own, the
+    // others share the defaults of the template.
+    // The statistics are recorded in metrics, new ones are created 
+    // if it's null
     ConfigParser(
-        std::filesystem::path base, 
-        std::filesystem::path config 
+        std::shared_ptr<TemplateStore> templates,
+        std::filesystem::path config,
+        std::chrono::milliseconds write_delay = std::chrono::milliseconds(0),
+        bool split = false,
+        UserFormat format = UserFormat::Json,
+        bool journal = false,
+        std::shared_ptr<Metrics> metrics = nullptr
     );
+    ~ConfigParser();
 
     // Return the configuration stored at the given path.
     // Settings are retrieved from the configuration files according
-    // to they name and category
+    // to they name and category.
+    // The value is read from the current snapshot, it never blocks
     //
     // Raise an exception if the given config path isn't valid. 
     // Raise an exception if the requested type doesn't match the 
     // setting type.
     template <typename Type>
-    Type get(const ConfigPath& config_path);
+    Type get(ConfigPathView config_path);
+
+    // Return the configuration with the given id.
+    // The value is read from the current snapshot, it never blocks
+    //
+    // Raise an exception if the given config id isn't valid. 
+    // Raise an exception if the requested type doesn't match the 
+    // setting type.
+    template <typename Type>
+    Type get(ConfigId config_id);
+
+    // Return the configuration of the given handle, generated from the
+    // base template at build time. The value is read by id from the 
+    // current snapshot, without lookup and without type check
+    //
+    // Raise an exception if the handle wasn't generated from the base
+    // template of the parser
+    template <typename Type>
+    Type get(const SettingHandle<Type>& handle);
+
+    // Return the value of the configuration with the given id without
+    // copying it. The returned pointer keeps the snapshot it belong
+    // to alive, the value is not affected by later changes
+    //
+    // Return nullptr if the given config id isn't valid
+    std::shared_ptr<const ConfigValue> getValue(ConfigId config_id) const;
+
+    // Return the current snapshot, used to read many settings from
+    // the same consistent state
+    std::shared_ptr<const ConfigSnapshot> getSnapshot() const
+    {
+        return m_snapshot.load();
+    }
 
     // Set the configuration stored at the given path with the provided data
     // Settings are retrieved from the configuration files according
@@ -152,117 +682,677 @@ public:
     // Raise an exception if the requested type doesn't match the 
     // setting type.
     // Raise an exception if an error occurred during file writing. 
+    // When the writes are delayed the error of a failed delayed write 
+    // is reported by the next set
     template <typename Type>
-    void set(const ConfigPath& config_path, const Type& data);
+    void set(ConfigPathView config_path, const Type& data);
+
+    // Set the configuration with the given id with the provided data
+    //
+    // Raise an exception if the given config id isn't valid. 
+    // Raise an exception if the requested type doesn't match the 
+    // setting type.
+    // Raise an exception if an error occurred during file writing. 
+    template <typename Type>
+    void set(ConfigId config_id, const Type& data);
+
+    // Set the configuration with the given id with the provided data
+    // and publish it without writing it. Only the lock of the category
+    // is taken, never for a disk access. The change must then be 
+    // committed with commitDeferred away from the caller, until then it
+    // only lives in memory and is lost if the daemon stops
+    //
+    // Raise an exception if the given config id isn't valid. 
+    // Raise an exception if the requested type doesn't match the 
+    // setting type.
+    template <typename Type>
+    void setDeferred(ConfigId config_id, const Type& data);
+
+    // Commit a change of the setting with the given id done with 
+    // setDeferred. Without write delay the pending changes are written.
+    // Otherwise the category is journaled, if the journal is enabled,
+    // and the write is left to the write timer
+    //
+    // Raise an exception if the change can't be journaled or written
+    void commitDeferred(ConfigId config_id);
+
+    // Set many configurations of the given layer at once with a single
+    // write of the user configuration file and a single change 
+    // notification. Either all the values are set or none of them.
+    // Only the User and Runtime layers can be set, the Runtime layer
+    // is never written to a file. A monostate value removes the value
+    // of the layer
+    //
+    // Raise an exception if any config id isn't valid. 
+    // Raise an exception if any value type doesn't match the 
+    // setting type.
+    // Raise an exception if the layer can't be set.
+    // Raise an exception if an error occurred during file writing. 
+    void setValues(
+        std::vector<std::pair<ConfigId, ConfigValue>> values,
+        ConfigLayer layer = ConfigLayer::User
+    );
+
+    // Remove the values of the given layer of many configurations at
+    // once, they go back to the value of the previous layers.
+    // The settings without value in the layer are ignored
+    //
+    // Raise an exception if any config id isn't valid. 
+    // Raise an exception if the layer can't be set.
+    // Raise an exception if an error occurred during file writing. 
+    void resetValues(
+        const std::vector<ConfigId>& config_ids,
+        ConfigLayer layer = ConfigLayer::User
+    );
+
+    // Return the layer providing the value of the setting with the 
+    // given id in the current snapshot
+    // The id must be valid
+    ConfigLayer getLayer(ConfigId config_id) const;
+
+    // Return true if any setting has a value of the Runtime layer, 
+    // it would be lost if the parser was destroyed
+    bool hasRuntimeValues() const;
+
+    // Return an empty transaction on the given layer, the changes staged
+    // in it are applied at once by its commit
+    Transaction begin(ConfigLayer layer = ConfigLayer::User)
+    {
+        return Transaction(*this, layer);
+    }
 
     // Return a list of all the category in the configuration structure
     std::vector<std::string> getCategories() const;
 
     // Return a list of meta data for the settings in the give category
     // Return a empty list if the category doesn't exist
-    const std::vector<ConfigMetadata>& getMetadatas(std::string_view category);
+    const std::vector<ConfigMetadata>& getMetadatas(
+        std::string_view category
+    ) const;
+
+    // Return the id of the setting at the given path
+    // Return nullopt if the setting is not in the base template
+    std::optional<ConfigId> getConfigId(ConfigPathView config_path) const;
+
+    // Return the meta data of the setting with the given id
+    // The id must be valid
+    const ConfigMetadata& getMetadata(ConfigId config_id) const;
+
+    // Return the displayed name and description of the setting with
+    // the given id
+    // The id must be valid
+    const ConfigDescription& getDescription(ConfigId config_id) const
+    {
+        return getTemplate().m_descriptions[config_id];
+    }
+
+    // Return the generation of the current snapshot. The generations
+    // only increase, every publication of new values increases it
+    uint64_t getGeneration() const { return m_snapshot.load()->m_generation; }
+
+    // Return the generation of the last change of the given category
+    // Return nullopt if the category doesn't exist
+    std::optional<uint64_t> getCategoryGeneration(
+        std::string_view category
+    ) const;
+
+    // Return the settings whose value changed after the given 
+    // generation, up to the generation of the current snapshot.
+    // Unlike updatedConfigs it can be called by any number of readers.
+    // If the generation is older than the change log, or wasn't 
+    // returned by this parser, every setting is returned as changed
+    ChangeSet changesSince(uint64_t generation) const;
 
     // Return true if the any configuration was updated since 
     // last calling this function
     bool wasUpdated();
 
+    // Return a file descriptor that becomes readable when a configuration
+    // is updated, to be used in poll.
+    // It's cleared by calling wasUpdated
+    int getChangeFd() const { return m_change_fd; }
+
     // If the user configuration file was update since last calling this
-    // function, return a vector with all the config path that were updated 
-    std::vector<ConfigPath> updatedConfigs();
+    // function, return a vector with all the config id that were updated,
+    // sorted and without duplicates.
+    // It doesn't wait for a writer in progress
+    std::vector<ConfigId> updatedConfigs();
 
-private:
-    // Return the json object associated with the requested setting.
-    // Settings are retrieved from the configuration files according
-    // to they name and category
+    // Return the file descriptor notifying changes in the user
+    // configuration directory, to be used in poll.
+    // When it becomes readable processWatchEvents must be called
+    int getWatchFd() const { return m_watcher.getFd(); }
+
+    // Read the pending file change events and parse the user
+    // configuration file again if it was modified
+    void processWatchEvents();
+
+    // Write the pending changes to the user configuration file
     //
-    // nullopt if the requested setting is not found 
-    // in the base template configuration
-    std::optional<nlohmann::json> getConfigJson(const ConfigPath& config_path);
+    // Raise an exception if the write fail
+    void flush();
 
-    // Return the json object associated with the requested setting.
-    // Settings are retrieved from the configuration files according
-    // to they name and category.
+    // Return the file descriptor of the delayed write timer, to be used 
+    // in poll. When it becomes readable processWriteTimer must be called
+    int getWriteFd() const { return m_write_fd; }
+
+    // Read the expired write timer and write the pending changes
+    void processWriteTimer();
+
+    // Switch to the current template of the template store once it
+    // merged new fragments. The new categories start with the defaults
+    // and their user values are read from the user configuration
+    void updateTemplate();
+
+    // Return the runtime statistics of the configuration, the D-Bus
+    // server records its own statistics in it too
+    Metrics& getMetrics() { return *m_metrics; }
+
+    // Return the type of the stored value
+    static ConfigType getValueType(const ConfigValue& value)
+    {
+        return static_cast<ConfigType>(value.index());
+    }
+
+    // Convert a json object to a setting value
+    // Return monostate if the json type isn't a valid setting type
+    static ConfigValue toConfigValue(const nlohmann::json& data);
+
+    // Convert a setting value to a json object
+    static nlohmann::json toJson(const ConfigValue& value);
+
+    // Convert a c++ value to a setting value
+    template <typename Type>
+    static ConfigValue toConfigValue(const Type& data);
+
+    // Convert a setting value to the c++ type
+    // The value must hold the alternative matching getConfigType<Type>()
+    template <typename Type>
+    static Type fromConfigValue(const ConfigValue& value);
+
+    // Return a string representation of the type 
+    static std::string_view configTypeStr(ConfigType type);
+
+    // Return a string representation of the layer
+    static std::string_view configLayerStr(ConfigLayer layer);
+
+private:
+    // Set the values of the given layer associated with the requested
+    // settings, a monostate value removes the value of the layer.
+    // The values are validated before any of them is applied, either 
+    // all the values are set or none of them.
     //
     // Return Ok if the operation was successful 
-    // Return NotFound if the requested setting is not found 
+    // Return NotFound if a requested setting is not found 
     // in the base template configuration.
-    // Return TypeMismatch if the type of the given json object doesn't match
+    // Return TypeMismatch if the type of a given value doesn't match
     // the type of the settings in the base template configuration.
     // Return FileError if writing to the config file failed.
-    SetStatus setConfigJson(
-        const ConfigPath& config_path,
-        nlohmann::json data
+    //
+    // If defer_write is true the user values are published and left
+    // pending without touching the disk, for commitDeferred
+    SetStatus setConfigValues(
+        std::vector<std::pair<ConfigId, ConfigValue>> values,
+        ConfigLayer layer = ConfigLayer::User,
+        bool defer_write = false
+    );
+
+    // Raise an exception if the values of the layer can't be set
+    static void checkWritableLayer(ConfigLayer layer);
+
+    // Merge again the value of the setting at the given position of
+    // a category from the values of its layers
+    static void mergeSetting(
+        const ConfigTemplate& config_template,
+        size_t category,
+        CategorySnapshot& snapshot,
+        size_t index
+    );
+
+    // Return true if a layer after the given one holds a value of the
+    // setting at the given position, the value of the layer is hidden
+    static bool isHidden(
+        const CategorySnapshot& snapshot,
+        size_t index,
+        ConfigLayer layer
+    );
+
+    // Return the snapshot of the category to publish, the default 
+    // snapshot of the template if the category has no user or runtime
+    // value so the copy is released
+    static std::shared_ptr<const CategorySnapshot> shareDefaults(
+        const ConfigTemplate& config_template,
+        size_t category,
+        std::shared_ptr<const CategorySnapshot> snapshot
+    );
+
+    // Raise the exception associated with the set status if it isn't Ok
+    static void checkSetStatus(SetStatus status);
+
+    // Compare the fingerprint of the setting handles with the one of
+    // the first count settings of the template, the handles with the
+    // same fingerprint are then used without check
+    //
+    // Raise an exception if the fingerprints don't match
+    void checkHandles(size_t count, uint64_t fingerprint);
+
+    // Return the current template
+    const ConfigTemplate& getTemplate() const
+    {
+        return *m_template.load(std::memory_order_acquire);
+    }
+
+    // Return a list of all the category of the given template
+    static std::vector<std::string> listCategories(
+        const ConfigTemplate& config_template
+    );
+
+    // Return a list of meta data for the settings in the give category
+    // of the given template
+    // Return a empty list if the category doesn't exist
+    static const std::vector<ConfigMetadata>& findMetadatas(
+        const ConfigTemplate& config_template,
+        std::string_view category
     );
 
-    // Parse the base configuration and populate m_base_config
-    // Raise exception if the base config file is not found
-    void parseBaseConfig();
+    // Return the meta data of the setting with the given id in the
+    // given template
+    // The id must be valid
+    static const ConfigMetadata& findMetadata(
+        const ConfigTemplate& config_template,
+        ConfigId config_id
+    )
+    {
+        const SettingLocation& location = 
+            config_template.m_locations[config_id];
+
+        return config_template.m_category_settings[location.m_category][
+            location.m_index
+        ];
+    }
+
+    // Create the writer state of the categories of the given template
+    // that don't have one yet
+    void addCategoryStates(const ConfigTemplate& config_template);
+
+    // Parse the user configuration of every category again, the
+    // categories whose content didn't change are skipped
+    void reloadUserConfig();
 
     // Parse the user configuration data using the data stored in 
-    // the base configuration map
-    // If any configuration changed in from the last parse, the config
-    // path is appended to the m_updated_config vector.
-    // On first run all the setting are appended to m_updated_config.
+    // the base configuration map, publish the updated categories and
+    // notify the change.
+    // The caller must hold m_file_mutex, the categories are locked once
+    // the file is parsed
+    //
+    // Categories whose content didn't change since the last parse
+    // are skipped without converting their settings. Settings removed
+    // from the file go back to the default.
     void parseUserConfig();
 
-    // Store the content of m_user_config to the user configuration file
+    // Check the user configuration file at the given path against its
+    // last known good copy before it's parsed. Only the checksum is
+    // compared when the file is the one we wrote. Otherwise a file that
+    // can't be parsed is restored from the copy and a file that parses
+    // becomes the new copy. A category file holds a single category
+    void checkUserFile(const std::filesystem::path& path, bool category);
+
+    // Return the path of the last known good copy of the user
+    // configuration file at the given path
+    static std::filesystem::path getGoodCopyPath(
+        const std::filesystem::path& path
+    );
+
+    // Parse the file of the given category if it changed since the last
+    // read or write, publish the category and notify the change.
+    // Only used when each category is stored in its own file
+    void reloadCategoryFile(size_t category);
+
+    // Parse the settings of a category of the user configuration read
+    // from the file at the given path. The settings of the category 
+    // missing from the given settings lose their user value.
+    // Settings whose merged value changed are appended to the updated
+    // vector. The caller must hold the lock of the category
+    //
+    // Return the new snapshot of the category
+    // Return nullptr if no user value changed
+    std::shared_ptr<const CategorySnapshot> parseUserCategory(
+        const std::filesystem::path& path,
+        size_t category,
+        const std::vector<UserSetting>& settings,
+        std::vector<ConfigId>& updated
+    );
+
+    // Snapshots of some categories replacing the current ones,
+    // keyed by category index
+    using CategoryUpdates =
+        std::map<size_t, std::shared_ptr<const CategorySnapshot>>;
+
+    // Return a snapshot equal to the given one except for the
+    // given categories
+    static std::shared_ptr<const ConfigSnapshot> applyCategories(
+        const ConfigSnapshot& snapshot,
+        const CategoryUpdates& categories
+    );
+
+    // Build a new snapshot for the given template and publish it.
+    // The categories already published keep their values, the new ones
+    // start with the defaults
+    void publishSnapshot(const ConfigTemplate& config_template);
+
+    // Publish a new snapshot equal to the current one except for the
+    // given categories, in a new generation recording the given 
+    // updated settings in the change log
+    void publishCategories(
+        const CategoryUpdates& categories,
+        const std::vector<ConfigId>& updated
+    );
+
+    // Append the updated settings of a generation to the change log,
+    // dropping the oldest changes beyond its size.
+    // The caller must hold m_publish_mutex
+    void logChanges(uint64_t generation, const std::vector<ConfigId>& updated);
+
+    // Return the snapshots of the categories of the given values with
+    // the values of the layer applied to the current snapshot. Only the
+    // settings whose value is not hidden by a later layer are updated,
+    // they are appended to the updated vector.
+    // The caller must hold the lock of the categories
+    CategoryUpdates applyValues(
+        const ConfigTemplate& config_template,
+        const std::vector<std::pair<ConfigId, ConfigValue>>& values,
+        ConfigLayer layer,
+        std::vector<ConfigId>& updated
+    );
+
+    // Write the given user values to the user configuration, or journal
+    // them if the writes are delayed, and publish them.
+    // Either all the values are written or none of them.
+    // The category locks are only held to apply and publish the values,
+    // a category published in the meantime gets the values applied again
+    //
+    // Return Ok if the write was successful or scheduled
+    // Return FileError if writing to the config file failed
+    SetStatus commitValues(
+        const ConfigTemplate& config_template,
+        const std::vector<std::pair<ConfigId, ConfigValue>>& values,
+        const std::set<size_t>& categories
+    );
+
+    // Flag the changes of the given categories as not written, their
+    // parsed content is reset. The caller must hold the lock of the
+    // categories
+    void markPending(const std::set<size_t>& categories);
+
+    // Return true if the last write of a pending change failed
+    bool hasFailedWrite() const;
+
+    // Arm the write timer if it isn't already armed
+    void scheduleWrite();
+
+    // Arm the write timer to retry a failed write, after the retry
+    // delay even without write delay
+    void scheduleRetry();
+
+    // Arm the write timer to expire after the given delay, it must not
+    // be zero
+    void armWriteTimer(std::chrono::milliseconds delay);
+
+    // Write the pending changes to the user configuration files.
+    // On failure the changes stay pending and the timer is armed
+    // again to retry the write.
+    //
+    // Return Ok if nothing was pending or the write was successful
+    // Return FileError if writing to a config file failed
+    SetStatus writePending();
+
+    // Write the pending changes to the user configuration files.
+    // The caller must hold m_file_mutex
+    //
+    // Return Ok if nothing was pending or the write was successful
+    // Return FileError if writing to a config file failed
+    SetStatus writePendingFiles();
+
+    // Write the pending changes to the user configuration file, from
+    // the published snapshot. The caller must hold m_file_mutex
+    //
+    // Return Ok if nothing was pending or the write was successful
+    // Return FileError if writing to the config file failed
+    SetStatus writeFilePending();
+
+    // Write the pending changes of a category to its file, from the
+    // published snapshot. The caller must hold m_file_mutex
+    //
+    // Return Ok if nothing was pending or the write was successful
+    // Return FileError if writing to the config file failed
+    SetStatus writeCategoryPending(size_t category);
+
+    // Return the position of the journal and the snapshot, taken 
+    // together so the records before the position are in the snapshot
+    std::pair<Journal::Mark, std::shared_ptr<const ConfigSnapshot>>
+    getWrittenState();
+
+    // Discard the journal records before the given position, once
+    // their changes are written to the user configuration
+    void discardJournal(const Journal::Mark& mark);
+
+    // Apply the changes of the journal records left by a previous run
+    // and write them to the user configuration
+    void replayJournal();
+
+    // Return the journal record of the given categories, a single line
+    // json object holding the user values of each category
+    std::string getJournalRecord(const CategoryUpdates& categories) const;
+
+    // Store the user values of the given snapshot to the user 
+    // configuration file. The caller must hold m_file_mutex
     //
     // Raise an exception if the write fail
-    void storeUserCofig();
+    void storeUserCofig(const ConfigSnapshot& snapshot);
 
-    // Return a constant reference to an entry of the base template 
-    // configuration table if it exist.
-    // Return nullopt if it doesn't 
-    std::optional<std::reference_wrapper<const ConfigParser::ConfigBaseData>> 
-    getBaseConfig(const ConfigPath& config_path);
+    // Store the user values of a category to its own file.
+    // The caller must hold m_file_mutex
+    //
+    // Raise an exception if the write fail
+    void storeCategoryConfig(
+        size_t category,
+        const CategorySnapshot& snapshot
+    );
+
+    // Replace the content of a user configuration file and its last
+    // known good copy, then update its stamp so our own write is not
+    // detected as a change
+    //
+    // Raise an exception if the write fail
+    void writeUserFile(
+        const std::filesystem::path& path,
+        const std::string& content,
+        std::optional<FileStamp>& stamp
+    );
+
+    // Return the content of a user configuration file holding the given
+    // json in the storage format
+    std::string encodeUserFile(const nlohmann::json& json) const;
+
+    // Return the user values of a category as a json object
+    static nlohmann::json categoryToJson(
+        const ConfigTemplate& config_template,
+        size_t category,
+        const CategorySnapshot& snapshot
+    );
+
+    // Return the path of the file storing the given category when
+    // each category is stored in its own file
+    std::filesystem::path getCategoryPath(size_t category) const;
+
+    // Return the id of the setting at the given path, log a warning
+    // naming the failed operation if the setting doesn't exist
+    // Return nullopt if the setting is not in the base template
+    std::optional<ConfigId> lookupConfigId(
+        ConfigPathView config_path,
+        std::string_view operation
+    ) const;
+
+    // Hand the updated config id to updatedConfigs and signal the change
+    // file descriptor that a configuration was updated
+    void notifyChange(const std::vector<ConfigId>& updated);
+
+    // Lock the mutex serializing the writers of a category, 
+    // recording the wait
+    std::unique_lock<std::mutex> lockCategory(size_t category);
+
+    // Lock the mutex of every category in index order
+    std::vector<std::unique_lock<std::mutex>> lockAllCategories();
+
+    // Lock the mutex of the given categories in index order
+    std::vector<std::unique_lock<std::mutex>> lockCategories(
+        const std::set<size_t>& categories
+    );
 
     // Check if the user configuration file was updated since the last
-    // read and parse it again if necessary
+    // read and parse it again if necessary.
+    // Only called when the watcher report a change, it's never run
+    // on the get and set path
     void checkConfigFileUpdate();
 
+    // Writer side state of a category
+    struct CategoryState {
+        // Serialize the writers of the category
+        std::mutex m_mutex;
+
+        // Tokens of the category object of the user configuration
+        // file at the last parse, used to skip the unchanged categories
+        std::optional<std::string> m_content;
+
+        // The following are only used when each category is stored
+        // in its own file
+        // Category file stamp at the last read or write, protected
+        // by m_file_mutex
+        std::optional<FileStamp> m_last_write;
+        // Store true if there are changes not written to the file
+        std::atomic<bool> m_write_pending = false;
+        // Store true if the last delayed write failed
+        std::atomic<bool> m_write_failed = false;
+    };
+
+    // Return the stamp of the file at the given path
+    // Return nullopt if the file doesn't exist
+    static std::optional<FileStamp> getFileStamp(
+        const std::filesystem::path& path
+    );
+
     // Return the config type associated with the given c++ type
     template <typename Type>
     static constexpr ConfigType getConfigType();
 
     // Return the setting type
-    static ConfigType getConfigType(nlohmann::json data);
+    static ConfigType getConfigType(const nlohmann::json& data);
 
     // Return the array type of the given json element
     // Return None if the array is not homogeneous 
     // Return None if the given object is not an array 
-    static ConfigType getArrayType(nlohmann::json data);
+    static ConfigType getArrayType(const nlohmann::json& data);
 
-    // Return a string representation of the type 
-    static std::string_view configTypeStr(ConfigType type);
 
 private:
-    // Store the base configuration data
-    std::map<ConfigPath, ConfigBaseData> m_base_config;
-    // Store the user configuration data
-    std::map<ConfigPath, nlohmann::json> m_user_config;
-
-    // Store a representation of the full configuration structure
-    // Key is the category name, Item is a list of config metadata
-    // for the category
-    std::map<std::string, std::vector<ConfigMetadata>> m_config_structure;
-
-    // Path to configuration base template and default configuration
-    std::filesystem::path m_base_path;
-    // Path to user configuration file
-    std::filesystem::path m_user_config_path;
+    // Store owning the templates, possibly shared with other parsers
+    std::shared_ptr<TemplateStore> m_template_store;
+    // Template of the store used by the parser, read without holding
+    // the mutex. Replaced by updateTemplate
+    std::atomic<const ConfigTemplate*> m_template;
 
-    // User configuration last edit time, used to check if the user
-    // configuration file was update since the last read
-    std::filesystem::file_time_type m_last_write;
+    // Writer side state of every category, indexed by category index.
+    // Only grows, with m_structure_mutex held exclusively
+    std::vector<std::unique_ptr<CategoryState>> m_categories;
 
-    // Store the config path that were updated since
+    // Path to user configuration file
+    std::filesystem::path m_user_config_path;
+    // Directory of the user configuration, holding the category files
+    std::filesystem::path m_user_config_dir;
+    // Store true if each category is stored in its own file
+    bool m_split;
+    // Storage format of the user configuration files
+    UserFormat m_format;
+
+    // User configuration file stamp at the last read or write, used to 
+    // ignore the change events generated by our own writes
+    std::optional<FileStamp> m_last_write;
+
+    // Watch the user configuration directory for changes
+    FileWatcher m_watcher;
+    // Protect m_watcher, the writers restore the watch after a write
+    std::mutex m_watcher_mutex;
+
+    // Current merged configuration, read without holding the mutex
+    std::atomic<std::shared_ptr<const ConfigSnapshot>> m_snapshot;
+
+    // Store the config id that were updated since
     // last calling updatedConfigs
-    std::vector<ConfigPath> m_updated_config;
-    // Store true if the configuration was updated since calling wasUpdated
-    bool m_updated;
-
-    // Mutex for thread safety
-    std::mutex m_mutex;
+    std::vector<ConfigId> m_notified_config;
+    // Protect m_notified_config, taken last so collecting the changes
+    // doesn't wait for a file write
+    std::mutex m_notify_mutex;
+    // eventfd signaled when a configuration is updated, it's readable
+    // until wasUpdated is called
+    int m_change_fd;
+
+    // Delay between a set and the write of the user configuration file,
+    // zero if the file is written by every set
+    std::chrono::milliseconds m_write_delay;
+    // timerfd expiring when the pending changes must be written
+    int m_write_fd;
+    // Store true if the write timer is armed
+    std::atomic<bool> m_write_scheduled;
+    // Store true if there are changes not written to the file, set
+    // after the changes are published and cleared before a write
+    std::atomic<bool> m_write_pending;
+    // Store true if the last delayed write failed
+    std::atomic<bool> m_write_failed;
+
+    // The locks are taken in this order: m_structure_mutex, m_file_mutex,
+    // the category mutexes by increasing index, m_journal_mutex,
+    // m_publish_mutex, m_change_log_mutex.
+    // Readers use m_snapshot and don't lock.
+    //
+    // Held shared by every operation on the categories and exclusively
+    // to add categories
+    std::shared_mutex m_structure_mutex;
+    // Serialize the reads and writes of the user configuration files
+    // and the journal appends, and protect the stamps of the files. 
+    // The category locks are never held across a disk access, the sets
+    // that don't write wait for the category locks only
+    std::mutex m_file_mutex;
+    // Protect m_journal. A record is appended and published holding it,
+    // the writers read the journal position and the snapshot with it
+    std::mutex m_journal_mutex;
+    // Serialize the publication of the snapshots, held only to swap
+    // the snapshot of some categories
+    std::mutex m_publish_mutex;
+    // Protect the change log, held only to append or read it
+    mutable std::mutex m_change_log_mutex;
+
+    // Maximum number of changes kept in the change log
+    static constexpr size_t c_change_log_size = 4096;
+
+    // Minimum delay before retrying a failed write of the pending changes
+    static constexpr std::chrono::milliseconds c_write_retry_delay{1000};
+
+    // Settings updated by the last publications with their generation,
+    // in generation order
+    std::deque<std::pair<uint64_t, ConfigId>> m_change_log;
+    // The log holds every change after this generation
+    uint64_t m_change_log_start;
+
+    // Journal of the changes waiting for the delayed write, empty if
+    // the journal is disabled
+    std::optional<Journal> m_journal;
+
+    // Runtime statistics, possibly shared with other parsers
+    std::shared_ptr<Metrics> m_metrics;
+
+    // Fingerprint of the setting handles matching the template, 
+    // zero until a handle is used
+    std::atomic<uint64_t> m_handle_fingerprint;
 };
 
 // Return the config type associated with the given c++ type
@@ -333,30 +1423,72 @@ constexpr ConfigParser::ConfigType ConfigParser::getConfigType()
 // Raise an exception if the requested type doesn't match the 
 // setting type.
 template <typename Type>
-Type ConfigParser::get(const ConfigPath& config_path)
+Type ConfigParser::get(ConfigPathView config_path)
 {
-    std::lock_guard<std::mutex> guard(m_mutex);
+    std::optional<ConfigId> config_id = lookupConfigId(
+        config_path, "getConfig"
+    );
+
+    // Check if the config exist
+    if (!config_id.has_value()) {
+        throw std::runtime_error("The requested setting doesn't exist");
+    }
+
+    return get<Type>(config_id.value());
+}
 
+// Return the configuration with the given id.
+// The value is read from the current snapshot, it never blocks
+//
+// Raise an exception if the given config id isn't valid. 
+// Raise an exception if the requested type doesn't match the 
+// setting type.
+template <typename Type>
+Type ConfigParser::get(ConfigId config_id)
+{
     // Check for type at compile time
     if constexpr (getConfigType<Type>() == ConfigType::None) 
         static_assert(false, "Configuration type not supported");
 
-    auto json_config_opt = getConfigJson(config_path);
+    // Hold a reference to the current snapshot, it remains valid
+    // even if a writer publish a new one in the meantime
+    std::shared_ptr<const ConfigSnapshot> snapshot = m_snapshot.load();
 
     // Check if the config exist
-    if (!json_config_opt.has_value()) {
+    if (config_id >= snapshot->size()) {
         throw std::runtime_error("The requested setting doesn't exist");
     }
 
-    nlohmann::json json_config = json_config_opt.value();
+    // The snapshot already contains the user value or the default
+    const ConfigValue& value = (*snapshot)[config_id];
 
     // Check if the type of the setting match the template specialization
-    if (getConfigType(json_config) != getConfigType<Type>()) {
+    if (getValueType(value) != getConfigType<Type>()) {
         throw std::runtime_error("The requested setting has the wrong type");
     }
 
-    // Cast the json  
-    return json_config;
+    return fromConfigValue<Type>(value);
+}
+
+// Return the configuration of the given handle, generated from the
+// base template at build time
+//
+// Raise an exception if the handle wasn't generated from the base
+// template of the parser
+template <typename Type>
+Type ConfigParser::get(const SettingHandle<Type>& handle)
+{
+    // The template only grows, the ids of the handles stay valid once
+    // their fingerprint matched
+    if (m_handle_fingerprint.load(std::memory_order_relaxed) != 
+        handle.m_fingerprint
+    ) {
+        checkHandles(handle.m_count, handle.m_fingerprint);
+    }
+
+    std::shared_ptr<const ConfigSnapshot> snapshot = m_snapshot.load();
+
+    return fromConfigValue<Type>((*snapshot)[handle.m_id]);
 }
 
 // Set the configuration stored at the given path with the provided data
@@ -368,31 +1500,152 @@ Type ConfigParser::get(const ConfigPath& config_path)
 // setting type.
 // Raise an exception if an error occurred during file writing. 
 template <typename Type>
-void ConfigParser::set(const ConfigPath& config_path, const Type& data)
+void ConfigParser::set(ConfigPathView config_path, const Type& data)
 {
-    std::lock_guard<std::mutex> guard(m_mutex);
+    std::optional<ConfigId> config_id = lookupConfigId(
+        config_path, "setConfig"
+    );
+
+    // Check if the config exist
+    if (!config_id.has_value()) {
+        throw std::runtime_error("Config set not found");
+    }
+
+    set<Type>(config_id.value(), data);
+}
 
+// Set the configuration with the given id with the provided data
+//
+// Raise an exception if the given config id isn't valid. 
+// Raise an exception if the requested type doesn't match the 
+// setting type.
+// Raise an exception if an error occurred during file writing. 
+template <typename Type>
+void ConfigParser::set(ConfigId config_id, const Type& data)
+{
     // Check for type at compile time
     if constexpr (getConfigType<Type>() == ConfigType::None) 
         static_assert(false, "Configuration type not supported");
 
     // Attempt to set the variable and get the status of the change
-    nlohmann::json json_data = data;
-    SetStatus status = setConfigJson(config_path, data);
-
-    // Check the status
-    if (status != SetStatus::Ok) {
-        switch (status) {
-            case SetStatus::NotFound:
-                throw std::runtime_error("Config set not found");
-            case SetStatus::TypeMismatch:
-                throw std::runtime_error("Config set type mismatch");
-            case SetStatus::FileError:
-                throw std::runtime_error("Config set file error");
-
-            default:
-                throw std::runtime_error("Unknown error");
-        }
+    SetStatus status = setConfigValues({
+        {config_id, toConfigValue<Type>(data)}
+    });
+
+    checkSetStatus(status);
+}
+
+// Set the configuration with the given id with the provided data
+// and publish it without writing it
+//
+// Raise an exception if the given config id isn't valid. 
+// Raise an exception if the requested type doesn't match the 
+// setting type.
+template <typename Type>
+void ConfigParser::setDeferred(ConfigId config_id, const Type& data)
+{
+    // Check for type at compile time
+    if constexpr (getConfigType<Type>() == ConfigType::None) 
+        static_assert(false, "Configuration type not supported");
+
+    SetStatus status = setConfigValues(
+        {{config_id, toConfigValue<Type>(data)}},
+        ConfigLayer::User,
+        true
+    );
+
+    checkSetStatus(status);
+}
+
+// Stage a change of the setting at the given path
+//
+// Raise an exception if the given config path isn't valid.
+template <typename Type>
+void ConfigParser::Transaction::set(
+    ConfigPathView config_path,
+    const Type& data
+) {
+    std::optional<ConfigId> config_id = m_parser.lookupConfigId(
+        config_path, "setConfig"
+    );
+
+    // Check if the config exist
+    if (!config_id.has_value()) {
+        throw std::runtime_error("Config set not found");
+    }
+
+    set<Type>(config_id.value(), data);
+}
+
+// Stage a change of the setting with the given id
+template <typename Type>
+void ConfigParser::Transaction::set(ConfigId config_id, const Type& data)
+{
+    // Check for type at compile time
+    if constexpr (getConfigType<Type>() == ConfigType::None) 
+        static_assert(false, "Configuration type not supported");
+
+    setValue(config_id, toConfigValue<Type>(data));
+}
+
+// Convert a c++ value to a setting value
+template <typename Type>
+ConfigParser::ConfigValue ConfigParser::toConfigValue(const Type& data)
+{
+    constexpr ConfigType type = getConfigType<Type>();
+
+    if constexpr (type == ConfigType::Int) {
+        return ConfigValue(
+            std::in_place_type<int64_t>, static_cast<int64_t>(data)
+        );
+    } else if constexpr (type == ConfigType::Bool) {
+        return ConfigValue(std::in_place_type<bool>, data);
+    } else if constexpr (type == ConfigType::Float) {
+        return ConfigValue(
+            std::in_place_type<double>, static_cast<double>(data)
+        );
+    } else if constexpr (type == ConfigType::String) {
+        return ConfigValue(std::in_place_type<std::string>, data);
+    } else if constexpr (type == ConfigType::ArrayInt) {
+        return ConfigValue(
+            std::in_place_type<std::vector<int64_t>>, data.begin(), data.end()
+        );
+    } else if constexpr (type == ConfigType::ArrayFloat) {
+        return ConfigValue(
+            std::in_place_type<std::vector<double>>, data.begin(), data.end()
+        );
+    } else if constexpr (type == ConfigType::ArrayString) {
+        return ConfigValue(std::in_place_type<std::vector<std::string>>, data);
+    } else {
+        return ConfigValue();
+    }
+}
+
+// Convert a setting value to the c++ type
+// The value must hold the alternative matching getConfigType<Type>()
+template <typename Type>
+Type ConfigParser::fromConfigValue(const ConfigValue& value)
+{
+    constexpr ConfigType type = getConfigType<Type>();
+
+    if constexpr (type == ConfigType::Int) {
+        return static_cast<Type>(*std::get_if<int64_t>(&value));
+    } else if constexpr (type == ConfigType::Bool) {
+        return *std::get_if<bool>(&value);
+    } else if constexpr (type == ConfigType::Float) {
+        return static_cast<Type>(*std::get_if<double>(&value));
+    } else if constexpr (type == ConfigType::String) {
+        return *std::get_if<std::string>(&value);
+    } else if constexpr (type == ConfigType::ArrayInt) {
+        const auto& array = *std::get_if<std::vector<int64_t>>(&value);
+        return Type(array.begin(), array.end());
+    } else if constexpr (type == ConfigType::ArrayFloat) {
+        const auto& array = *std::get_if<std::vector<double>>(&value);
+        return Type(array.begin(), array.end());
+    } else if constexpr (type == ConfigType::ArrayString) {
+        return *std::get_if<std::vector<std::string>>(&value);
+    } else {
+        return Type();
     }
 }
 
@@ -1,9 +1,17 @@
-#include <chrono>
-#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
+#include <fnmatch.h>
 #include <poll.h>
 #include <signal.h>
 #include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 #include <sdbus-c++/Types.h>
 #include <sdbus-c++/IObject.h>
@@ -13,8 +21,6 @@
 
 namespace coil {
 
-constexpr int c_loop_sleep_millis = 10;
-
 // Store true if the server and the main thread need to run
 static std::atomic<bool> g_running = true;
 
@@ -24,16 +30,102 @@ static std::atomic<bool> g_running = true;
 // Raise an exception if the base config file is not found
 DbusServer::DbusServer(
     std::filesystem::path base, 
-    std::filesystem::path config 
+    std::filesystem::path config,
+    std::chrono::milliseconds write_delay,
+    std::filesystem::path cache,
+    std::filesystem::path fragments,
+    std::filesystem::path vendor,
+    std::filesystem::path site,
+    bool split,
+    UserFormat format,
+    bool journal,
+    std::filesystem::path users,
+    std::chrono::seconds idle_timeout,
+    size_t dispatch_threads
 ) :
-    m_config_parser(base, config)
+    m_template_store(
+        std::make_shared<ConfigParser::TemplateStore>(
+            base, cache, fragments, vendor, site
+        )
+    ),
+    m_metrics(std::make_shared<Metrics>()),
+    m_config_path(config),
+    m_write_delay(write_delay),
+    m_split(split),
+    m_format(format),
+    m_journal(journal),
+    m_users_path(users),
+    m_idle_timeout(idle_timeout),
+    m_worker(std::make_unique<ThreadPool>(1)),
+    m_dispatcher(std::make_unique<ThreadPool>(dispatch_threads)),
+    m_wake_fd(-1),
+    m_evict_fd(-1),
+    m_debounce_fd(-1),
+    m_next_subscription(0)
 {
+    m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (m_wake_fd < 0) {
+        throw std::runtime_error(
+            std::string("eventfd failed: ") + std::strerror(errno)
+        );
+    }
+
+    m_evict_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    m_debounce_fd = timerfd_create(
+        CLOCK_MONOTONIC,
+        TFD_NONBLOCK | TFD_CLOEXEC
+    );
+
+    if (m_evict_fd < 0 || m_debounce_fd < 0) {
+        throw std::runtime_error(
+            std::string("timerfd_create failed: ") + std::strerror(errno)
+        );
+    }
+
     // Create D-Bus connection to bus and requests a well-known name on it.
     sdbus::ServiceName service_name{
         std::string(c_dbus_service_name) +
         c_dbus_service_version
     };
-    m_connection = sdbus::createBusConnection(service_name);
+
+    if (m_users_path.empty()) {
+        // The daemon user is the only user, its configuration is
+        // loaded right away
+        m_users.emplace(getuid(), std::make_shared<UserStore>(
+            m_template_store,
+            m_config_path,
+            m_write_delay,
+            m_split,
+            m_format,
+            m_journal,
+            m_metrics
+        ));
+
+        m_connection = sdbus::createBusConnection(service_name);
+    } else {
+        spdlog::info(
+            "Serving every user, configurations stored in \"{}\"",
+            m_users_path.c_str()
+        );
+
+        m_connection = sdbus::createSystemBusConnection(service_name);
+
+        // Check the idle stores every idle timeout, a store is unloaded
+        // between one and two timeouts after its last use
+        if (m_idle_timeout.count() > 0) {
+            struct itimerspec timer_spec = {};
+            timer_spec.it_value.tv_sec = m_idle_timeout.count();
+            timer_spec.it_interval.tv_sec = m_idle_timeout.count();
+
+            if (timerfd_settime(m_evict_fd, 0, &timer_spec, nullptr) < 0) {
+                spdlog::warn(
+                    "Failed to arm the eviction timer: {}",
+                    std::strerror(errno)
+                );
+            }
+        }
+    }
 
     // Create the root D-Bus object.
     sdbus::ObjectPath root_object_path{c_dbus_root_object};
@@ -42,12 +134,35 @@ DbusServer::DbusServer(
         std::move(root_object_path)
     );
 
-    // Create the configuration objects
-    for (auto& category : m_config_parser.getCategories()) {
+    // Let the clients discover every category object and its 
+    // properties with a single GetManagedObjects call
+    m_root_object->addObjectManager();
+
+    createRootMethods();
+    createStatsMethods();
+
+    // Create the configuration objects, they are shared by every user
+    for (auto& category : m_template_store->getCategories()) {
         createCategoryObject(category);
     }
 }
 
+// Wait for the queued configuration updates to complete
+DbusServer::~DbusServer()
+{
+    // The tasks reply on the connection and wake up the main loop,
+    // stop the threads before the rest is destroyed
+    m_dispatcher.reset();
+    m_worker.reset();
+
+    // Write the pending changes of every user
+    m_users.clear();
+
+    close(m_wake_fd);
+    close(m_evict_fd);
+    close(m_debounce_fd);
+}
+
 // Run the D-Bus service main loop 
 void DbusServer::run()
 {
@@ -59,8 +174,22 @@ void DbusServer::run()
         g_running = false;
     }); 
 
-    // Launch the signal loop
-    std::thread signal_thread(&DbusServer::signalChangeLoop, this); 
+    // Descriptors polled whatever the number of users, after the two
+    // descriptors of the bus. The descriptors of each user follow them
+    constexpr size_t c_fragment_fd = 2;
+    constexpr size_t c_wake_fd = 3;
+    constexpr size_t c_evict_fd = 4;
+    constexpr size_t c_debounce_fd = 5;
+    constexpr size_t c_user_fds = 6;
+
+    // Descriptors of a user, from the first one of the user
+    constexpr size_t c_watch_fd = 0;
+    constexpr size_t c_change_fd = 1;
+    constexpr size_t c_write_fd = 2;
+    constexpr size_t c_fds_per_user = 3;
+
+    std::vector<struct pollfd> fds;
+    std::vector<std::shared_ptr<UserStore>> stores;
 
     // Launch D-Bus service loop
     while (g_running) {
@@ -68,16 +197,44 @@ void DbusServer::run()
         sdbus::IConnection::PollData poll_data =
             m_connection->getEventLoopPollData();
 
-        struct pollfd fds[] = {
+        fds = {
             {poll_data.fd, poll_data.events, 0},
-            {poll_data.eventFd, POLLIN, 0}
+            {poll_data.eventFd, POLLIN, 0},
+            {m_template_store->getFragmentWatchFd(), POLLIN, 0},
+            {m_wake_fd, POLLIN, 0},
+            {m_evict_fd, POLLIN, 0},
+            {m_debounce_fd, POLLIN, 0}
         };
-        constexpr auto fds_count = sizeof(fds)/sizeof(fds[0]);
+
+        // The stores can be loaded or unloaded while processing the
+        // events, the polled ones are kept alive until they are processed.
+        // A pass interrupted before the processing leaves them filled
+        stores.clear();
+
+        for (const auto& [uid, store] : m_users) {
+            ConfigParser& config_parser = store->m_config_parser;
+
+            // The descriptors handled by a worker task stay readable until
+            // the task completes, a negative descriptor is ignored by poll
+            fds.push_back({
+                store->m_watch_busy ? -1 : config_parser.getWatchFd(),
+                POLLIN,
+                0
+            });
+            fds.push_back({config_parser.getChangeFd(), POLLIN, 0});
+            fds.push_back({
+                store->m_write_busy ? -1 : config_parser.getWriteFd(),
+                POLLIN,
+                0
+            });
+
+            stores.push_back(store);
+        }
 
         int timeout = poll_data.getPollTimeout();
 
         // Perform the poll operation
-        int r = poll(fds, fds_count, timeout);
+        int r = poll(fds.data(), fds.size(), timeout);
 
         // A signal was caught during poll try again
         if (r < 0 && errno == EINTR) {
@@ -90,16 +247,247 @@ void DbusServer::run()
             continue;
         }
 
+        m_metrics->m_wakeups.fetch_add(1, std::memory_order_relaxed);
+
+        // A worker task completed, its descriptor is polled again
+        if (fds[c_wake_fd].revents & POLLIN) {
+            uint64_t counter;
+
+            if (read(m_wake_fd, &counter, sizeof(counter)) < 0) {
+                spdlog::debug("Spurious wake up of the D-Bus main loop");
+            }
+        }
+
+        for (size_t i = 0; i < stores.size(); i++) {
+            const struct pollfd* user_fds = 
+                &fds[c_user_fds + i * c_fds_per_user];
+            std::shared_ptr<UserStore> store = stores[i];
+
+            // Reload the user configuration if the file changed
+            if (user_fds[c_watch_fd].revents & POLLIN) {
+                runOnWorker(store->m_watch_busy, [store]() {
+                    store->m_config_parser.processWatchEvents();
+                });
+            }
+
+            // Write the delayed changes to the user configuration file
+            if (user_fds[c_write_fd].revents & POLLIN) {
+                runOnWorker(store->m_write_busy, [store]() {
+                    store->m_config_parser.processWriteTimer();
+                });
+            }
+        }
+
+        // Add the template fragments installed while running
+        if (fds[c_fragment_fd].revents & POLLIN) {
+            addFragments();
+        }
+
         // Process the pending event on the bus
         m_connection->processPendingEvent();
 
-        // Send the property change signals if necessary
-        sendChangeSignals();
+        // The matches of the clients that left are removed out of
+        // their own handler
+        for (const auto& client : m_left_clients) {
+            m_client_matches.erase(client);
+            m_client_uids.erase(client);
+        }
+
+        m_left_clients.clear();
+
+        // Send the property change signals if necessary, a change done 
+        // while processing the bus event makes the next poll return
+        // immediately
+        for (size_t i = 0; i < stores.size(); i++) {
+            const struct pollfd* user_fds = 
+                &fds[c_user_fds + i * c_fds_per_user];
+
+            if (user_fds[c_change_fd].revents & POLLIN) {
+                sendChangeSignals(*stores[i]);
+            }
+        }
+
+        // Send the changes of the subscriptions at the end of their window
+        if (fds[c_debounce_fd].revents & POLLIN) {
+            processDebounceTimer();
+        }
+
+        // Only the map references the stores now, except the ones used
+        // by a worker task
+        stores.clear();
+
+        // Unload the configuration of the users gone idle
+        if (fds[c_evict_fd].revents & POLLIN) {
+            evictIdleUsers();
+        }
     }
 
     spdlog::debug("Leaving D-Bus loop");
+}
 
-    signal_thread.join();
+// Make the main loop return, can be called from any thread
+void DbusServer::stop()
+{
+    g_running = false;
+    wakeUp();
+}
+
+// Register the methods of the root object on the config interface
+void DbusServer::createRootMethods()
+{
+    sdbus::InterfaceName interface_name{
+        std::string(c_dbus_interface_name) +
+        c_dbus_interface_version
+    };
+
+    m_root_object->addVTable(
+        // Return every setting grouped by category
+        sdbus::registerMethod("GetAllConfig")
+            .withOutputParamNames("config")
+            .implementedAs([&](
+                sdbus::Result<
+                    std::map<
+                        std::string, std::map<std::string, sdbus::Variant>
+                    >
+                >&& result
+            ) {
+                dispatchRead(
+                    std::move(result),
+                    [&, store = getCallerStore()]() {
+                        return getAllValues(*store);
+                });
+        }),
+        // Return the current generation and the settings changed after
+        // the given one, every setting if the changes are too old
+        sdbus::registerMethod("GetChangesSince")
+            .withInputParamNames("generation")
+            .withOutputParamNames("generation", "complete", "config")
+            .implementedAs([&](
+                sdbus::Result<
+                    uint64_t,
+                    bool,
+                    std::map<
+                        std::string, std::map<std::string, sdbus::Variant>
+                    >
+                >&& result,
+                uint64_t generation
+            ) {
+                dispatchRead(
+                    std::move(result),
+                    [&, generation, store = getCallerStore()]() {
+                        return getChangesSince(*store, generation);
+                });
+        }),
+        // Return a read-only descriptor of the shared memory segment
+        sdbus::registerMethod("GetSharedMemory")
+            .withOutputParamNames("fd")
+            .implementedAs([&]() {
+                SharedConfig& shared_config = 
+                    getSharedConfig(*getCallerStore());
+
+                return sdbus::UnixFd(shared_config.getFd());
+        }),
+        // Set settings of several categories at once, either all of
+        // them are set or none
+        sdbus::registerMethod("Apply")
+            .withInputParamNames("config")
+            .implementedAs([&](
+                sdbus::Result<>&& result,
+                const std::map<
+                    std::string, std::map<std::string, sdbus::Variant>
+                >& config
+            ) {
+                applyValues(getCallerStore(), std::move(result), config);
+        }),
+        // Set settings of the runtime layer, they hide the user values
+        // until they are reset or the daemon exits
+        sdbus::registerMethod("SetRuntime")
+            .withInputParamNames("config")
+            .implementedAs([&](
+                sdbus::Result<>&& result,
+                const std::map<
+                    std::string, std::map<std::string, sdbus::Variant>
+                >& config
+            ) {
+                applyValues(
+                    getCallerStore(),
+                    std::move(result),
+                    config,
+                    ConfigParser::ConfigLayer::Runtime
+                );
+        }),
+        // Remove runtime values, the names are grouped by category
+        sdbus::registerMethod("ResetRuntime")
+            .withInputParamNames("names")
+            .implementedAs([&](
+                sdbus::Result<>&& result,
+                const std::map<std::string, std::vector<std::string>>& names
+            ) {
+                resetRuntimeValues(getCallerStore(), std::move(result), names);
+        }),
+        // Subscribe to the settings matching the patterns, the changes
+        // are sent to the caller by the returned object once per
+        // debounce window
+        sdbus::registerMethod("Subscribe")
+            .withInputParamNames("patterns", "debounce_ms")
+            .withOutputParamNames("subscription")
+            .implementedAs([&](
+                const std::vector<std::string>& patterns,
+                uint32_t debounce_ms
+            ) {
+                return subscribe(
+                    *getCallerStore(),
+                    patterns,
+                    std::chrono::milliseconds(debounce_ms)
+                );
+        }),
+        // Remove a subscription of the caller
+        sdbus::registerMethod("Unsubscribe")
+            .withInputParamNames("subscription")
+            .implementedAs([&](const sdbus::ObjectPath& subscription) {
+                unsubscribe(*getCallerStore(), subscription);
+        }),
+        // Write the delayed changes immediately, the reply is sent
+        // by the worker once the file is written
+        sdbus::registerMethod("Flush")
+            .implementedAs([&](sdbus::Result<>&& result) {
+                m_worker->submit([
+                    result = std::move(result),
+                    store = getCallerStore()
+                ]() mutable {
+                    try {
+                        store->m_config_parser.flush();
+                        result.returnResults();
+                    } catch (std::exception& e) {
+                        result.returnError(createError("FileError", e.what()));
+                    }
+                });
+        })
+    ).forInterface(interface_name);
+}
+
+// Register the methods of the root object on the statistics interface
+void DbusServer::createStatsMethods()
+{
+    sdbus::InterfaceName interface_name{
+        std::string(c_dbus_stats_interface_name) +
+        c_dbus_stats_interface_version
+    };
+
+    m_root_object->addVTable(
+        // Return the statistics fields by metric name
+        sdbus::registerMethod("GetStats")
+            .withOutputParamNames("stats")
+            .implementedAs([&]() {
+                return m_metrics->getStats();
+        }),
+        // Return the statistics in the Prometheus text format
+        sdbus::registerMethod("GetPrometheus")
+            .withOutputParamNames("text")
+            .implementedAs([&]() {
+                return m_metrics->getPrometheusText();
+        })
+    ).forInterface(interface_name);
 }
 
 // Create a object representing the given category and populate it 
@@ -108,9 +496,14 @@ void DbusServer::createCategoryObject(std::string_view category_name)
 {
     spdlog::debug("Creating object for category: {}", category_name);
 
+    static sdbus::InterfaceName interface_name{
+        std::string(c_dbus_interface_name) +
+        c_dbus_interface_version
+    };
+
     // Gather the settings metadata 
     const std::vector<ConfigParser::ConfigMetadata>& metadatas = 
-        m_config_parser.getMetadatas(category_name);
+        m_template_store->getMetadatas(category_name);
 
     // If the metadata list is empty return without creating the object
     if (metadatas.empty())
@@ -129,20 +522,338 @@ void DbusServer::createCategoryObject(std::string_view category_name)
         std::move(object_path)
     );
 
-    // Populate the object with the configuration properties
+    // Build the whole v-table of the category and register it at once,
+    // a single registration per object keeps the startup time and
+    // the memory low with large templates
+    std::vector<sdbus::VTableItem> vtable;
+    vtable.reserve(metadatas.size() + 2);
+
+    CategoryMetrics& metrics = m_metrics->getCategory(category_name);
+
     for (const auto& metadata: metadatas) {
-        createConfigProperty(object.get(), metadata);
+        createConfigProperty(vtable, metadata, metrics);
     }
 
+    createCategoryMethods(vtable, std::string(category_name), metrics);
+
+    object->addVTable(interface_name, std::move(vtable));
+
     // Store the object in the category object map
     m_category_objects[std::string(category_name)] = std::move(object); 
 }
 
-// Create a property in the category object on the config interface
+// Add the bulk access methods of a category object to the
+// v-table of the config interface
+void DbusServer::createCategoryMethods(
+    std::vector<sdbus::VTableItem>& vtable,
+    const std::string& category_name,
+    CategoryMetrics& metrics
+) {
+    CategoryMetrics* category_metrics = &metrics;
+
+    // Return the requested settings, all of them if the list is empty
+    vtable.push_back(
+        sdbus::registerMethod("GetMany")
+            .withInputParamNames("names")
+            .withOutputParamNames("values")
+            .implementedAs([&, category_name, category_metrics](
+                sdbus::Result<std::map<std::string, sdbus::Variant>>&& result,
+                const std::vector<std::string>& names
+            ) {
+                dispatchRead(std::move(result), [
+                    &,
+                    category_name,
+                    category_metrics,
+                    names,
+                    store = getCallerStore()
+                ]() {
+                    ScopedTimer timer(category_metrics->m_get);
+
+                    return getCategoryValues(*store, category_name, names);
+                });
+        })
+    );
+
+    // Set many settings with a single write, replied once written
+    vtable.push_back(
+        sdbus::registerMethod("SetMany")
+            .withInputParamNames("values")
+            .implementedAs([&, category_name, category_metrics](
+                sdbus::Result<>&& result,
+                const std::map<std::string, sdbus::Variant>& values
+            ) {
+                setCategoryValues(
+                    getCallerStore(),
+                    std::move(result),
+                    category_name,
+                    values,
+                    *category_metrics
+                );
+        })
+    );
+}
+
+// Return the values of the given settings of a category, 
+// all the settings of the category if the list is empty
+//
+// Raise a D-Bus error if a setting doesn't exist
+std::map<std::string, sdbus::Variant> DbusServer::getCategoryValues(
+    UserStore& store,
+    const std::string& category_name,
+    const std::vector<std::string>& names
+) {
+    // Read all the values from the same snapshot, the settings are
+    // located with its template as the template may be replaced meanwhile
+    auto snapshot = store.m_config_parser.getSnapshot();
+    std::map<std::string, sdbus::Variant> values;
+
+    if (names.empty()) {
+        for (const auto& metadata : snapshot->getMetadatas(category_name)) {
+            values.emplace(
+                metadata.getPath().getName(),
+                toVariant((*snapshot)[metadata.getId()])
+            );
+        }
+
+        return values;
+    }
+
+    for (const auto& name : names) {
+        auto config_id = snapshot->getConfigId({category_name, name});
+
+        if (!config_id.has_value()) {
+            throwError(
+                "NotFound", 
+                "Setting not found: " + category_name + ":" + name
+            );
+        }
+
+        values.emplace(name, toVariant((*snapshot)[*config_id]));
+    }
+
+    return values;
+}
+
+// Set the given settings of a category with a single write done
+// on the worker thread, the reply is sent once the file is written
+//
+// Raise a D-Bus error if a setting doesn't exist or if a value has
+// the wrong type, a failed write is reported in the reply
+void DbusServer::setCategoryValues(
+    std::shared_ptr<UserStore> store,
+    sdbus::Result<>&& result,
+    const std::string& category_name,
+    const std::map<std::string, sdbus::Variant>& values,
+    CategoryMetrics& metrics
+) {
+    ConfigParser& config_parser = store->m_config_parser;
+
+    std::vector<std::pair<ConfigParser::ConfigId, ConfigParser::ConfigValue>>
+        config_values;
+    config_values.reserve(values.size());
+
+    // Convert every value before setting any of them
+    for (const auto& [name, variant] : values) {
+        auto config_id = config_parser.getConfigId({category_name, name});
+
+        if (!config_id.has_value()) {
+            throwError(
+                "NotFound", 
+                "Setting not found: " + category_name + ":" + name
+            );
+        }
+
+        const ConfigParser::ConfigMetadata& metadata = 
+            config_parser.getMetadata(*config_id);
+
+        config_values.emplace_back(
+            *config_id,
+            fromVariant(variant, metadata.getType())
+        );
+    }
+
+    // The values were validated against the template, only the write
+    // can fail on the worker
+    m_worker->submit([
+        category_metrics = &metrics,
+        store = std::move(store),
+        result = std::move(result),
+        config_values = std::move(config_values)
+    ]() mutable {
+        ScopedTimer timer(category_metrics->m_set);
+
+        try {
+            store->m_config_parser.setValues(std::move(config_values));
+            result.returnResults();
+        } catch (std::exception& e) {
+            result.returnError(createError("FileError", e.what()));
+        }
+    });
+}
+
+// Return the values of all the settings grouped by category
+std::map<std::string, std::map<std::string, sdbus::Variant>> 
+DbusServer::getAllValues(UserStore& store)
+{
+    // Read all the values from the same snapshot, the settings are
+    // located with its template as the template may be replaced meanwhile
+    auto snapshot = store.m_config_parser.getSnapshot();
+    std::map<std::string, std::map<std::string, sdbus::Variant>> config;
+
+    for (const auto& category : snapshot->getCategories()) {
+        std::map<std::string, sdbus::Variant>& values = config[category];
+
+        for (const auto& metadata : snapshot->getMetadatas(category)) {
+            values.emplace(
+                metadata.getPath().getName(),
+                toVariant((*snapshot)[metadata.getId()])
+            );
+        }
+    }
+
+    return config;
+}
+
+// Return the current generation of the configuration of the store,
+// if the log holds every change after the given generation and the
+// values of the settings changed after it grouped by category
+std::tuple<
+    uint64_t,
+    bool,
+    std::map<std::string, std::map<std::string, sdbus::Variant>>
+> DbusServer::getChangesSince(UserStore& store, uint64_t generation)
+{
+    ConfigParser& config_parser = store.m_config_parser;
+    ConfigParser::ChangeSet changes = config_parser.changesSince(generation);
+
+    // The values and the paths are read from the snapshot of the
+    // returned generation, the template may be replaced meanwhile
+    const ConfigParser::ConfigSnapshot& snapshot = *changes.m_snapshot;
+    std::map<std::string, std::map<std::string, sdbus::Variant>> config;
+
+    for (auto config_id : changes.m_config_ids) {
+        ConfigParser::ConfigPathView path =
+            snapshot.getMetadata(config_id).getPath();
+
+        config[std::string(path.getCategory())].emplace(
+            path.getName(),
+            toVariant(snapshot[config_id])
+        );
+    }
+
+    return {changes.m_generation, changes.m_complete, std::move(config)};
+}
+
+// Set the given settings of any category in a single transaction
+// of the given layer done on the worker thread, the reply is sent
+// once it's committed
+//
+// Raise a D-Bus error if a setting doesn't exist or if a value has
+// the wrong type, a failed write is reported in the reply
+void DbusServer::applyValues(
+    std::shared_ptr<UserStore> store,
+    sdbus::Result<>&& result,
+    const std::map<std::string, std::map<std::string, sdbus::Variant>>&
+        config,
+    ConfigParser::ConfigLayer layer
+) {
+    ConfigParser& config_parser = store->m_config_parser;
+    ConfigParser::Transaction transaction = config_parser.begin(layer);
+
+    // Convert every value before staging the transaction
+    for (const auto& [category_name, values] : config) {
+        for (const auto& [name, variant] : values) {
+            auto config_id = config_parser.getConfigId(
+                {category_name, name}
+            );
+
+            if (!config_id.has_value()) {
+                throwError(
+                    "NotFound", 
+                    "Setting not found: " + category_name + ":" + name
+                );
+            }
+
+            const ConfigParser::ConfigMetadata& metadata = 
+                config_parser.getMetadata(*config_id);
+
+            transaction.setValue(
+                *config_id,
+                fromVariant(variant, metadata.getType())
+            );
+        }
+    }
+
+    // The values were validated against the template, only the write
+    // can fail on the worker
+    // The transaction refers to the parser, the store is kept alive
+    // until it's committed
+    m_worker->submit([
+        store = std::move(store),
+        result = std::move(result),
+        transaction = std::move(transaction)
+    ]() mutable {
+        try {
+            transaction.commit();
+            result.returnResults();
+        } catch (std::exception& e) {
+            result.returnError(createError("FileError", e.what()));
+        }
+    });
+}
+
+// Remove the runtime values of the given settings of any category
+// on the worker thread
+//
+// Raise a D-Bus error if a setting doesn't exist
+void DbusServer::resetRuntimeValues(
+    std::shared_ptr<UserStore> store,
+    sdbus::Result<>&& result,
+    const std::map<std::string, std::vector<std::string>>& names
+) {
+    ConfigParser& config_parser = store->m_config_parser;
+    ConfigParser::Transaction transaction = 
+        config_parser.begin(ConfigParser::ConfigLayer::Runtime);
+
+    for (const auto& [category_name, category_names] : names) {
+        for (const auto& name : category_names) {
+            auto config_id = config_parser.getConfigId(
+                {category_name, name}
+            );
+
+            if (!config_id.has_value()) {
+                throwError(
+                    "NotFound", 
+                    "Setting not found: " + category_name + ":" + name
+                );
+            }
+
+            transaction.resetValue(*config_id);
+        }
+    }
+
+    // The runtime layer is never written, the commit can't fail
+    m_worker->submit([
+        store = std::move(store),
+        result = std::move(result),
+        transaction = std::move(transaction)
+    ]() mutable {
+        try {
+            transaction.commit();
+            result.returnResults();
+        } catch (std::exception& e) {
+            result.returnError(createError("FileError", e.what()));
+        }
+    });
+}
+
+// Add a property to the v-table of the config interface 
 // representing a config at the given path.
+// The accesses are recorded in the metrics of its category
 void DbusServer::createConfigProperty(
-    sdbus::IObject* category_object_p,
-    const ConfigParser::ConfigMetadata& config_metadata
+    std::vector<sdbus::VTableItem>& vtable,
+    const ConfigParser::ConfigMetadata& config_metadata,
+    CategoryMetrics& metrics
 ) {
     spdlog::debug(
         "Creating property for config: \"{}:{}\"",
@@ -156,38 +867,38 @@ void DbusServer::createConfigProperty(
     // Add the property to the v-table using the appropriate type
     switch (type) {
         case ConfigParser::ConfigType::Bool:
-            addPropertyToVTable<bool>(category_object_p, config_metadata);
+            addPropertyToVTable<bool>(vtable, config_metadata, metrics);
             break;
         
         case ConfigParser::ConfigType::Int:
-            addPropertyToVTable<int>(category_object_p, config_metadata);
+            addPropertyToVTable<int>(vtable, config_metadata, metrics);
             break;
 
         case ConfigParser::ConfigType::Float:
-            addPropertyToVTable<double>(category_object_p, config_metadata);
+            addPropertyToVTable<double>(vtable, config_metadata, metrics);
             break;
 
         case ConfigParser::ConfigType::String:
             addPropertyToVTable<std::string>(
-                category_object_p, config_metadata
+                vtable, config_metadata, metrics
             );
             break;
 
         case ConfigParser::ConfigType::ArrayInt:
             addPropertyToVTable<std::vector<int>>(
-                category_object_p, config_metadata
+                vtable, config_metadata, metrics
             );
             break;
 
         case ConfigParser::ConfigType::ArrayFloat:
             addPropertyToVTable<std::vector<double>>(
-                category_object_p, config_metadata
+                vtable, config_metadata, metrics
             );
             break;
 
         case ConfigParser::ConfigType::ArrayString:
             addPropertyToVTable<std::vector<std::string>>(
-                category_object_p, config_metadata
+                vtable, config_metadata, metrics
             );
             break;
         
@@ -198,8 +909,9 @@ void DbusServer::createConfigProperty(
     }
 }
 
-// Send property change signal if changes occurred in the config parser  
-void DbusServer::sendChangeSignals()
+// Send property change signal if changes occurred in the config
+// parser of the given store
+void DbusServer::sendChangeSignals(UserStore& store)
 {
     // The interface name will remain unchanged during the entire execution
     // of the program, declaring it as static to avoid recalculating it
@@ -209,38 +921,698 @@ void DbusServer::sendChangeSignals()
         c_dbus_interface_version
     };
 
-    if (m_config_parser.wasUpdated()) {
-        // Send a signal for each update config
-        for (auto& config : m_config_parser.updatedConfigs()) {
-            // Get the configuration object
-            std::string category(config.getCategory());
-            std::string name(config.getName());
-            auto& object = m_category_objects[category];
+    static sdbus::InterfaceName properties_interface{
+        c_dbus_properties_interface
+    };
+    static sdbus::SignalName properties_changed{c_dbus_properties_changed};
+
+    ConfigParser& config_parser = store.m_config_parser;
+
+    if (!config_parser.wasUpdated())
+        return;
+
+    // Group the updated properties by category with their new value, 
+    // all the values are read from the same snapshot. The snapshot is
+    // taken after collecting the ids, a worker publishes the values
+    // before handing their id
+    std::vector<ConfigParser::ConfigId> config_ids = 
+        config_parser.updatedConfigs();
+    auto snapshot = config_parser.getSnapshot();
+
+    // Update the shared memory before waking up the clients
+    if (store.m_shared_config) {
+        try {
+            store.m_shared_config->update(config_ids);
+        } catch (std::exception& e) {
+            spdlog::error("Failed to update the shared config: {}", e.what());
+        }
+    }
+
+    queueSubscriptionChanges(store, config_ids);
+
+    std::map<std::string, std::map<std::string, sdbus::Variant>> updated;
 
-            // Emit the signal
-            sdbus::PropertyName property_name {name};
+    for (auto config_id : config_ids) {
+        ConfigParser::ConfigPathView config = 
+            snapshot->getMetadata(config_id).getPath();
 
-            object->emitPropertiesChangedSignal(
-                interface_name, 
-                { property_name }
+        updated[std::string(config.getCategory())].emplace(
+            config.getName(),
+            toVariant((*snapshot)[config_id])
+        );
+    }
+
+    // In multi-user mode the values of a user are only sent to its
+    // clients, the signal is broadcast otherwise
+    std::vector<std::string> destinations;
+
+    if (m_users_path.empty()) {
+        destinations.emplace_back();
+    } else {
+        destinations.assign(store.m_clients.begin(), store.m_clients.end());
+    }
+
+    // Send a single signal for each updated category. The signal is built
+    // manually to include the values in the changed properties, this way
+    // the subscribers don't need to read them back
+    for (const auto& [category, values] : updated) {
+        auto object = m_category_objects.find(category);
+
+        if (object == m_category_objects.end())
+            continue;
+
+        for (const auto& destination : destinations) {
+            sdbus::Signal signal = object->second->createSignal(
+                properties_interface,
+                properties_changed
             );
+
+            if (!destination.empty())
+                signal.setDestination(destination);
+
+            signal << std::string(interface_name);
+            signal << values;
+            signal << std::vector<std::string>();
+
+            object->second->emitSignal(signal);
+
+            m_metrics->m_signals.fetch_add(1, std::memory_order_relaxed);
         }
     }
 }
 
-// Property change 
-void DbusServer::signalChangeLoop()
+// Create a subscription of the caller to the settings matching 
+// the patterns, with the given debounce window. Return the path of
+// the object emitting its change signal
+//
+// Raise a D-Bus error if no pattern is given or if the caller has
+// too many subscriptions
+sdbus::ObjectPath DbusServer::subscribe(
+    UserStore& store,
+    const std::vector<std::string>& patterns,
+    std::chrono::milliseconds debounce
+) {
+    static sdbus::InterfaceName interface_name{
+        std::string(c_dbus_subscription_interface_name) +
+        c_dbus_subscription_interface_version
+    };
+
+    if (patterns.empty())
+        throwError("InvalidPattern", "No pattern given");
+
+    for (const auto& pattern : patterns) {
+        if (pattern.empty())
+            throwError("InvalidPattern", "Empty pattern");
+    }
+
+    sdbus::Message message = m_connection->getCurrentlyProcessedMessage();
+    std::string client = message.getSender();
+
+    size_t client_subscriptions = 0;
+
+    for (const auto& [path, subscription] : store.m_subscriptions) {
+        if (subscription.m_client == client)
+            client_subscriptions++;
+    }
+
+    if (client_subscriptions >= c_max_client_subscriptions) {
+        throwError(
+            "TooManySubscriptions",
+            "The client has too many subscriptions"
+        );
+    }
+
+    std::string path = 
+        std::string(c_dbus_subscription_object) + "/" + 
+        std::to_string(m_next_subscription++);
+
+    Subscription subscription;
+    subscription.m_client = client;
+    subscription.m_patterns = patterns;
+    subscription.m_debounce = debounce;
+
+    matchSubscription(store.m_config_parser, subscription);
+    watchClient(client);
+
+    subscription.m_object = sdbus::createObject(
+        *m_connection,
+        sdbus::ObjectPath{path}
+    );
+
+    subscription.m_object->addVTable(
+        // Changed settings by category:name, with their current value
+        sdbus::registerSignal(c_dbus_subscription_changed)
+            .withParameters<std::map<std::string, sdbus::Variant>>("values")
+    ).forInterface(interface_name);
+
+    spdlog::debug(
+        "Client {} subscribed to {} settings at {}",
+        client,
+        std::count(
+            subscription.m_matches.begin(),
+            subscription.m_matches.end(),
+            true
+        ),
+        path
+    );
+
+    store.m_subscriptions.emplace(path, std::move(subscription));
+
+    return sdbus::ObjectPath{path};
+}
+
+// Remove the subscription of the caller at the given path
+//
+// Raise a D-Bus error if the caller has no subscription at the path
+void DbusServer::unsubscribe(UserStore& store, const std::string& path)
 {
-    while (g_running) {
-        sendChangeSignals();
+    sdbus::Message message = m_connection->getCurrentlyProcessedMessage();
+    auto subscription = store.m_subscriptions.find(path);
+
+    // The subscriptions of the other clients are reported as unknown too
+    if (subscription == store.m_subscriptions.end() ||
+        subscription->second.m_client != message.getSender()
+    ) {
+        throwError("UnknownSubscription", "Unknown subscription: " + path);
+    }
+
+    store.m_subscriptions.erase(subscription);
+}
+
+// Watch a client so its state is removed when it leaves the bus,
+// only the NameOwnerChanged signal of its name is received
+void DbusServer::watchClient(const std::string& client)
+{
+    if (m_client_matches.count(client) != 0)
+        return;
+
+    std::string match =
+        "type='signal',sender='org.freedesktop.DBus',"
+        "interface='org.freedesktop.DBus',member='NameOwnerChanged',"
+        "arg0='" + client + "'";
+
+    // The bus daemon announces that the client left with an empty
+    // new owner
+    m_client_matches.emplace(
+        client,
+        m_connection->addMatch(match, [&](sdbus::Message message) {
+            std::string name;
+            std::string old_owner;
+            std::string new_owner;
+
+            message >> name >> old_owner >> new_owner;
+
+            if (new_owner.empty())
+                removeClient(name);
+        })
+    );
+}
+
+// Remove the subscriptions of a client that left the bus
+void DbusServer::removeClient(const std::string& client)
+{
+    for (const auto& [uid, store] : m_users) {
+        store->m_clients.erase(client);
+
+        std::erase_if(store->m_subscriptions, [&](const auto& subscription) {
+            return subscription.second.m_client == client;
+        });
+    }
+
+    m_left_clients.push_back(client);
+}
+
+// Match the patterns of the subscription against every setting
+// of the configuration
+void DbusServer::matchSubscription(
+    const ConfigParser& config_parser,
+    Subscription& subscription
+) {
+    subscription.m_matches.clear();
+
+    for (const auto& category : config_parser.getCategories()) {
+        for (const auto& metadata : config_parser.getMetadatas(category)) {
+            ConfigParser::ConfigPathView config = metadata.getPath();
+            std::string name = 
+                std::string(config.getCategory()) + ":" + 
+                std::string(config.getName());
+
+            bool match = std::any_of(
+                subscription.m_patterns.begin(),
+                subscription.m_patterns.end(),
+                [&](const std::string& pattern) {
+                    return fnmatch(pattern.c_str(), name.c_str(), 0) == 0;
+                }
+            );
+
+            if (!match)
+                continue;
+
+            if (subscription.m_matches.size() <= metadata.getId())
+                subscription.m_matches.resize(metadata.getId() + 1);
+
+            subscription.m_matches[metadata.getId()] = true;
+        }
+    }
+}
+
+// Add the given updated settings to the subscriptions of the store
+// matching them, they are sent at the end of the debounce window
+void DbusServer::queueSubscriptionChanges(
+    UserStore& store,
+    const std::vector<ConfigParser::ConfigId>& config_ids
+) {
+    bool window_started = false;
+
+    for (auto& [path, subscription] : store.m_subscriptions) {
+        bool was_pending = !subscription.m_pending.empty();
+
+        for (auto config_id : config_ids) {
+            if (config_id < subscription.m_matches.size() &&
+                subscription.m_matches[config_id]
+            ) {
+                subscription.m_pending.insert(config_id);
+            }
+        }
+
+        if (subscription.m_pending.empty() || was_pending)
+            continue;
+
+        if (subscription.m_debounce.count() == 0) {
+            sendSubscriptionChanges(store, subscription);
+            continue;
+        }
+
+        // The window starts with the first change, the later changes
+        // don't extend it so a busy setting can't delay the signal
+        subscription.m_deadline = 
+            std::chrono::steady_clock::now() + subscription.m_debounce;
+        window_started = true;
+    }
+
+    if (window_started)
+        armDebounceTimer();
+}
+
+// Send the pending changes of a subscription in a single signal
+void DbusServer::sendSubscriptionChanges(
+    UserStore& store,
+    Subscription& subscription
+) {
+    static sdbus::InterfaceName interface_name{
+        std::string(c_dbus_subscription_interface_name) +
+        c_dbus_subscription_interface_version
+    };
+    static sdbus::SignalName changed{c_dbus_subscription_changed};
+
+    ConfigParser& config_parser = store.m_config_parser;
+
+    // The values are read when sent, a setting changed several times
+    // during the window is sent once with its last value
+    auto snapshot = config_parser.getSnapshot();
+    std::map<std::string, sdbus::Variant> values;
+
+    for (auto config_id : subscription.m_pending) {
+        ConfigParser::ConfigPathView config = 
+            snapshot->getMetadata(config_id).getPath();
+
+        values.emplace(
+            std::string(config.getCategory()) + ":" + 
+            std::string(config.getName()),
+            toVariant((*snapshot)[config_id])
+        );
+    }
+
+    subscription.m_pending.clear();
+
+    sdbus::Signal signal = subscription.m_object->createSignal(
+        interface_name,
+        changed
+    );
+
+    signal.setDestination(subscription.m_client);
+    signal << values;
+
+    subscription.m_object->emitSignal(signal);
+
+    m_metrics->m_signals.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Send the changes of the subscriptions whose debounce window ended
+void DbusServer::processDebounceTimer()
+{
+    uint64_t expirations;
+
+    if (read(m_debounce_fd, &expirations, sizeof(expirations)) < 0)
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+
+    for (const auto& [uid, store] : m_users) {
+        for (auto& [path, subscription] : store->m_subscriptions) {
+            if (!subscription.m_pending.empty() &&
+                subscription.m_deadline <= now
+            ) {
+                sendSubscriptionChanges(*store, subscription);
+            }
+        }
+    }
+
+    armDebounceTimer();
+}
+
+// Arm the debounce timer to the end of the earliest window,
+// disarm it if no change is pending
+void DbusServer::armDebounceTimer()
+{
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+
+    for (const auto& [uid, store] : m_users) {
+        for (const auto& [path, subscription] : store->m_subscriptions) {
+            if (subscription.m_pending.empty())
+                continue;
+
+            if (!deadline || subscription.m_deadline < *deadline)
+                deadline = subscription.m_deadline;
+        }
+    }
+
+    // A zero value disarms the timer, an ended window expires in 
+    // a nanosecond
+    struct itimerspec timer_spec = {};
+
+    if (deadline) {
+        auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            *deadline - std::chrono::steady_clock::now()
+        );
+        delay = std::max(delay, std::chrono::nanoseconds(1));
+
+        timer_spec.it_value.tv_sec = delay.count() / 1000000000;
+        timer_spec.it_value.tv_nsec = delay.count() % 1000000000;
+    }
+
+    if (timerfd_settime(m_debounce_fd, 0, &timer_spec, nullptr) < 0) {
+        spdlog::warn(
+            "Failed to arm the debounce timer: {}",
+            std::strerror(errno)
+        );
+    }
+}
+
+// Merge the new template fragments and create the objects of
+// the categories they add
+void DbusServer::addFragments()
+{
+    std::vector<std::string> categories = 
+        m_template_store->processFragmentEvents();
+
+    if (categories.empty())
+        return;
+
+    // The loaded users read their values of the new categories, the
+    // patterns of the subscriptions can match the new settings
+    for (const auto& [uid, store] : m_users) {
+        store->m_config_parser.updateTemplate();
+
+        for (auto& [path, subscription] : store->m_subscriptions) {
+            matchSubscription(store->m_config_parser, subscription);
+        }
+    }
+
+    // The existing objects are left untouched
+    for (const auto& category : categories) {
+        createCategoryObject(category);
+
+        // Announce the new object to the object manager clients
+        auto object = m_category_objects.find(category);
+
+        if (object != m_category_objects.end())
+            object->second->emitInterfacesAddedSignal();
+    }
+
+    // The shared memory needs entries for the new settings
+    for (const auto& [uid, store] : m_users) {
+        if (!store->m_shared_config)
+            continue;
+
+        try {
+            store->m_shared_config->update({});
+        } catch (std::exception& e) {
+            spdlog::error("Failed to update the shared config: {}", e.what());
+        }
+    }
+}
+
+// Return the store of the caller of the D-Bus request being
+// processed, loading it if needed. In single user mode it's always
+// the only store
+//
+// Raise a D-Bus error if the configuration of the caller can't
+// be loaded
+std::shared_ptr<DbusServer::UserStore> DbusServer::getCallerStore()
+{
+    if (m_users_path.empty())
+        return m_users.begin()->second;
+
+    sdbus::Message message = m_connection->getCurrentlyProcessedMessage();
+    std::string sender = message.getSender();
+    auto client = m_client_uids.find(sender);
+
+    // The bus daemon provides the credentials of the sender, a user
+    // can't ask for the configuration of another one. They cost a call
+    // to the bus daemon, it's asked once per client as a unique name is
+    // never reused
+    if (client == m_client_uids.end()) {
+        client = m_client_uids.emplace(sender, message.getCredsUid()).first;
+        watchClient(sender);
+    }
+
+    uid_t uid = client->second;
+
+    std::shared_ptr<UserStore> store;
+
+    try {
+        store = getUserStore(uid);
+    } catch (std::exception& e) {
+        spdlog::error(
+            "Failed to load the configuration of user {}: {}",
+            uid,
+            e.what()
+        );
+
+        throwError("LoadError", e.what());
+    }
+
+    store->m_last_access = std::chrono::steady_clock::now();
+
+    store->m_clients.insert(sender);
+
+    return store;
+}
+
+// Return the store of the given user, loading it if needed
+//
+// Raise an exception if the configuration can't be loaded
+std::shared_ptr<DbusServer::UserStore> DbusServer::getUserStore(uid_t uid)
+{
+    auto user = m_users.find(uid);
+
+    if (user != m_users.end())
+        return user->second;
+
+    // Each user has its own directory, watched for changes and 
+    // holding its category files in split mode
+    std::filesystem::path user_path = m_users_path / std::to_string(uid);
+
+    std::filesystem::create_directories(user_path);
+    std::filesystem::permissions(
+        user_path,
+        std::filesystem::perms::owner_all,
+        std::filesystem::perm_options::replace
+    );
+
+    spdlog::info("Loading the configuration of user {}", uid);
+
+    auto store = std::make_shared<UserStore>(
+        m_template_store,
+        user_path / m_config_path.filename(),
+        m_write_delay,
+        m_split,
+        m_format,
+        m_journal,
+        m_metrics
+    );
+
+    m_users.emplace(uid, store);
+
+    return store;
+}
+
+// Unload the stores unused for the idle timeout. The pending
+// changes are written before
+void DbusServer::evictIdleUsers()
+{
+    uint64_t expirations;
+
+    if (read(m_evict_fd, &expirations, sizeof(expirations)) < 0)
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+
+    for (auto user = m_users.begin(); user != m_users.end();) {
+        const UserStore& store = *user->second;
+
+        // A store referenced by a worker task is still in use, the
+        // runtime values would be lost by unloading it and the
+        // subscribed clients still wait for changes
+        bool idle = 
+            now - store.m_last_access >= m_idle_timeout &&
+            !store.m_watch_busy &&
+            !store.m_write_busy &&
+            user->second.use_count() == 1 &&
+            !store.m_config_parser.hasRuntimeValues() &&
+            store.m_subscriptions.empty();
+
+        if (!idle) {
+            user++;
+            continue;
+        }
+
+        spdlog::info("Unloading the configuration of user {}", user->first);
+
+        // The parser writes its pending changes when destroyed
+        user = m_users.erase(user);
+    }
+}
+
+// Return the shared memory copy of the configuration of the
+// given store, created on first use
+//
+// Raise an exception if the segment can't be created
+SharedConfig& DbusServer::getSharedConfig(UserStore& store)
+{
+    if (!store.m_shared_config) {
+        store.m_shared_config = 
+            std::make_unique<SharedConfig>(store.m_config_parser);
+    }
+
+    return *store.m_shared_config;
+}
+
+// Queue a configuration update on the worker thread. The busy flag
+// is set until the task completes, the main loop doesn't poll
+// the descriptor of the task meanwhile
+void DbusServer::runOnWorker(
+    std::atomic<bool>& busy,
+    std::function<void()> task
+) {
+    busy = true;
+
+    m_worker->submit([&, task = std::move(task)]() {
+        try {
+            task();
+        } catch (std::exception& e) {
+            spdlog::error("Configuration update failed: {}", e.what());
+        }
 
-        // Sleep before the next iteration
-        std::this_thread::sleep_for(
-            std::chrono::milliseconds(c_loop_sleep_millis)
-        );    
+        busy = false;
+        wakeUp();
+    });
+}
+
+// Wake up the main loop waiting in poll
+void DbusServer::wakeUp()
+{
+    uint64_t increment = 1;
+
+    if (write(m_wake_fd, &increment, sizeof(increment)) < 0) {
+        spdlog::warn(
+            "Failed to wake up the D-Bus main loop: {}",
+            std::strerror(errno)
+        );
     }
+}
 
-    spdlog::debug("Leaving signal loop");
+// Convert a setting value to a D-Bus variant, integers are sent 
+// as int32 like the properties
+sdbus::Variant DbusServer::toVariant(const ConfigParser::ConfigValue& value)
+{
+    switch (ConfigParser::getValueType(value)) {
+        case ConfigParser::ConfigType::Bool:
+            return sdbus::Variant(ConfigParser::fromConfigValue<bool>(value));
+        case ConfigParser::ConfigType::Int:
+            return sdbus::Variant(ConfigParser::fromConfigValue<int>(value));
+        case ConfigParser::ConfigType::Float:
+            return sdbus::Variant(
+                ConfigParser::fromConfigValue<double>(value)
+            );
+        case ConfigParser::ConfigType::String:
+            return sdbus::Variant(
+                ConfigParser::fromConfigValue<std::string>(value)
+            );
+        case ConfigParser::ConfigType::ArrayInt:
+            return sdbus::Variant(
+                ConfigParser::fromConfigValue<std::vector<int>>(value)
+            );
+        case ConfigParser::ConfigType::ArrayFloat:
+            return sdbus::Variant(
+                ConfigParser::fromConfigValue<std::vector<double>>(value)
+            );
+        case ConfigParser::ConfigType::ArrayString:
+            return sdbus::Variant(
+                ConfigParser::fromConfigValue<std::vector<std::string>>(value)
+            );
+
+        default:
+            return sdbus::Variant();
+    }
+}
+
+// Convert a D-Bus variant to a setting value of the given type
+//
+// Raise a D-Bus error if the variant doesn't hold the expected type
+ConfigParser::ConfigValue DbusServer::fromVariant(
+    const sdbus::Variant& variant,
+    ConfigParser::ConfigType type
+) {
+    switch (type) {
+        case ConfigParser::ConfigType::Bool:
+            return fromVariant<bool>(variant);
+        case ConfigParser::ConfigType::Int:
+            return fromVariant<int>(variant);
+        case ConfigParser::ConfigType::Float:
+            return fromVariant<double>(variant);
+        case ConfigParser::ConfigType::String:
+            return fromVariant<std::string>(variant);
+        case ConfigParser::ConfigType::ArrayInt:
+            return fromVariant<std::vector<int>>(variant);
+        case ConfigParser::ConfigType::ArrayFloat:
+            return fromVariant<std::vector<double>>(variant);
+        case ConfigParser::ConfigType::ArrayString:
+            return fromVariant<std::vector<std::string>>(variant);
+
+        default:
+            throwError("TypeMismatch", "The setting has an unknown type");
+    }
+}
+
+// Return a D-Bus error with the given name suffix and message
+sdbus::Error DbusServer::createError(
+    std::string_view name,
+    const std::string& message
+) {
+    return sdbus::Error(
+        sdbus::Error::Name{
+            std::string(c_dbus_error_name) + "." + std::string(name)
+        },
+        message
+    );
+}
+
+// Raise a D-Bus error with the given name suffix and message
+void DbusServer::throwError(std::string_view name, const std::string& message)
+{
+    throw createError(name, message);
 }
 
 } // namespace coil
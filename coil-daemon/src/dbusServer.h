@@ -1,13 +1,29 @@
 #ifndef COIL_DBUS_SERVER_H
 #define COIL_DBUS_SERVER_H
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <map>
 #include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <sys/types.h>
 
 #include <sdbus-c++/IConnection.h>
 #include <sdbus-c++/IObject.h>
+#include <sdbus-c++/Types.h>
+
+#include "spdlog/spdlog.h"
 
 #include "configParser.h"
+#include "sharedConfig.h"
+#include "threadPool.h"
 
 namespace coil {
 
@@ -24,88 +40,546 @@ constexpr const char* c_dbus_interface_name = "org.sparkplug.coil.config";
 // D-Bus config interface version  
 constexpr const char* c_dbus_interface_version = "1";
 
+// D-Bus statistics interface name of the root object
+constexpr const char* c_dbus_stats_interface_name = "org.sparkplug.coil.stats";
+// D-Bus statistics interface version
+constexpr const char* c_dbus_stats_interface_version = "1";
+
+// D-Bus standard properties interface and its change signal
+constexpr const char* c_dbus_properties_interface = 
+    "org.freedesktop.DBus.Properties";
+constexpr const char* c_dbus_properties_changed = "PropertiesChanged";
+
+// D-Bus subscription interface name, implemented by the objects
+// returned by Subscribe, and its change signal
+constexpr const char* c_dbus_subscription_interface_name = 
+    "org.sparkplug.coil.subscription";
+// D-Bus subscription interface version
+constexpr const char* c_dbus_subscription_interface_version = "1";
+constexpr const char* c_dbus_subscription_changed = "Changed";
+
+// D-Bus path of the subscription objects, followed by their number
+constexpr const char* c_dbus_subscription_object = 
+    "/org/sparkplug/coil/subscription";
+
+// Maximum number of subscriptions of a client
+constexpr size_t c_max_client_subscriptions = 64;
+
+// D-Bus error name prefix
+constexpr const char* c_dbus_error_name = "org.sparkplug.coil.Error";
+
 class DbusServer {
 public:
     // Create the D-Bus server and parse the config files at the
     // given paths.
+    // Changes are written to the user config file after write_delay, 
+    // zero write the file on every set.
+    // The validated base template is cached at the cache path,
+    // an empty path disables the cache.
+    // The template fragments of the fragments directory are merged with
+    // the base template, new fragments are added while running.
+    // The vendor and site files hold the values of the Vendor and Site
+    // layers, between the defaults of the template and the user values.
+    // If split is true each category is stored in its own file in the
+    // directory of the config file.
+    // The user configuration is stored in the given format.
+    // If journal is true the delayed changes are journaled.
+    // If users is not empty the server runs on the system bus and serves
+    // the configuration of every user, identified by the uid of the
+    // caller. The configuration of a user is stored in users/<uid>/,
+    // in a file named like config. It's loaded on the first request of
+    // the user and unloaded once unused for idle_timeout, zero keeps
+    // it loaded. The base template is parsed and held once for all 
+    // the users.
+    // The read requests are answered in parallel by dispatch_threads
+    // threads, zero starts one per hardware thread
     // 
-    // Raise an exception if the base config file is not found.
+    // Raise an exception if neither the base config file nor
+    // a fragment is found.
     DbusServer(
         std::filesystem::path base, 
-        std::filesystem::path config 
+        std::filesystem::path config,
+        std::chrono::milliseconds write_delay,
+        std::filesystem::path cache,
+        std::filesystem::path fragments,
+        std::filesystem::path vendor,
+        std::filesystem::path site,
+        bool split = false,
+        UserFormat format = UserFormat::Json,
+        bool journal = false,
+        std::filesystem::path users = {},
+        std::chrono::seconds idle_timeout = std::chrono::seconds(0),
+        size_t dispatch_threads = 0
     );
 
+    // Wait for the queued configuration updates to complete
+    ~DbusServer();
+
     // Run the D-Bus service main loop 
     void run();
 
+    // Make the main loop return, can be called from any thread
+    void stop();
+
 private:
+    // Subscription of a client to the settings matching its patterns,
+    // the changes are sent to it in a single signal per debounce window
+    struct Subscription {
+        // Object emitting the change signal of the subscription
+        std::unique_ptr<sdbus::IObject> m_object;
+        // Unique bus name of the client, the only receiver of the signal
+        std::string m_client;
+        // Glob patterns matched against the category:name of the settings
+        std::vector<std::string> m_patterns;
+        // Store true at the id of each setting matching a pattern
+        std::vector<bool> m_matches;
+
+        // Time the changes are held before being sent, zero sends them
+        // right away
+        std::chrono::milliseconds m_debounce;
+        // Updated settings not sent yet and the time they are sent at,
+        // set by the first change of the window
+        std::set<ConfigParser::ConfigId> m_pending;
+        std::chrono::steady_clock::time_point m_deadline;
+    };
+
+    // Configuration of a user served by the daemon, with the state of
+    // the main loop for it
+    struct UserStore {
+        UserStore(
+            std::shared_ptr<ConfigParser::TemplateStore> templates,
+            std::filesystem::path config,
+            std::chrono::milliseconds write_delay,
+            bool split,
+            UserFormat format,
+            bool journal,
+            std::shared_ptr<Metrics> metrics
+        ) :
+            m_config_parser(
+                templates, config, write_delay, split, format, journal, metrics
+            ),
+            m_watch_busy(false),
+            m_write_busy(false),
+            m_last_access(std::chrono::steady_clock::now())
+        {
+        }
+
+        // Store the configuration data
+        ConfigParser m_config_parser;
+
+        // Shared memory copy of the configuration for local clients,
+        // created by the first request for it
+        std::unique_ptr<SharedConfig> m_shared_config;
+
+        // Store true while the user file changes or the delayed write
+        // are processed by the worker
+        std::atomic<bool> m_watch_busy;
+        std::atomic<bool> m_write_busy;
+
+        // The following are only used in multi-user mode, by the main loop
+        // Time of the last request of the user
+        std::chrono::steady_clock::time_point m_last_access;
+        // Unique bus name of the clients of the user, the change
+        // signals are sent only to them
+        std::set<std::string> m_clients;
+
+        // Subscriptions of the clients of the user by object path
+        std::map<std::string, Subscription> m_subscriptions;
+    };
+
+    // Return the store of the caller of the D-Bus request being
+    // processed, loading it if needed. In single user mode it's always
+    // the only store. Must be called from the main loop
+    //
+    // Raise a D-Bus error if the configuration of the caller can't
+    // be loaded
+    std::shared_ptr<UserStore> getCallerStore();
+
+    // Return the store of the given user, loading it if needed
+    //
+    // Raise an exception if the configuration can't be loaded
+    std::shared_ptr<UserStore> getUserStore(uid_t uid);
+
+    // Unload the stores unused for the idle timeout. The pending
+    // changes are written before
+    void evictIdleUsers();
+
+    // Return the shared memory copy of the configuration of the
+    // given store, created on first use
+    //
+    // Raise an exception if the segment can't be created
+    SharedConfig& getSharedConfig(UserStore& store);
+
+    // Register the methods of the root object on the config interface
+    void createRootMethods();
+
+    // Register the methods of the root object on the statistics interface
+    void createStatsMethods();
+
     // Create a object representing the given category and populate it 
     // with a property for each configuration
     void createCategoryObject(std::string_view category_name);
 
-    // Create a property in the category object on the config interface
+    // Add the bulk access methods of a category object to the
+    // v-table of the config interface
+    void createCategoryMethods(
+        std::vector<sdbus::VTableItem>& vtable,
+        const std::string& category_name,
+        CategoryMetrics& metrics
+    );
+
+    // Return the values of the given settings of a category, 
+    // all the settings of the category if the list is empty.
+    // Can be called from any thread
+    //
+    // Raise a D-Bus error if a setting doesn't exist
+    std::map<std::string, sdbus::Variant> getCategoryValues(
+        UserStore& store,
+        const std::string& category_name,
+        const std::vector<std::string>& names
+    );
+
+    // Set the given settings of a category with a single write done
+    // on the worker thread, the reply is sent once the file is written
+    //
+    // Raise a D-Bus error if a setting doesn't exist or if a value has
+    // the wrong type, a failed write is reported in the reply
+    void setCategoryValues(
+        std::shared_ptr<UserStore> store,
+        sdbus::Result<>&& result,
+        const std::string& category_name,
+        const std::map<std::string, sdbus::Variant>& values,
+        CategoryMetrics& metrics
+    );
+
+    // Return the values of all the settings grouped by category.
+    // Can be called from any thread
+    std::map<std::string, std::map<std::string, sdbus::Variant>> 
+    getAllValues(UserStore& store);
+
+    // Return the current generation of the configuration of the store,
+    // if the log holds every change after the given generation and the
+    // values of the settings changed after it grouped by category.
+    // Every setting is returned if the log doesn't hold the changes.
+    // Can be called from any thread
+    std::tuple<
+        uint64_t,
+        bool,
+        std::map<std::string, std::map<std::string, sdbus::Variant>>
+    > getChangesSince(UserStore& store, uint64_t generation);
+
+    // Set the given settings of any category in a single transaction
+    // of the given layer done on the worker thread, the reply is sent
+    // once it's committed
+    //
+    // Raise a D-Bus error if a setting doesn't exist or if a value has
+    // the wrong type, a failed write is reported in the reply
+    void applyValues(
+        std::shared_ptr<UserStore> store,
+        sdbus::Result<>&& result,
+        const std::map<std::string, std::map<std::string, sdbus::Variant>>&
+            config,
+        ConfigParser::ConfigLayer layer = ConfigParser::ConfigLayer::User
+    );
+
+    // Remove the runtime values of the given settings of any category
+    // on the worker thread, they go back to the user values or the
+    // defaults. The names are grouped by category
+    //
+    // Raise a D-Bus error if a setting doesn't exist
+    void resetRuntimeValues(
+        std::shared_ptr<UserStore> store,
+        sdbus::Result<>&& result,
+        const std::map<std::string, std::vector<std::string>>& names
+    );
+
+    // Add a property to the v-table of the config interface 
     // representing a config at the given path.
+    // The accesses are recorded in the metrics of its category
     void createConfigProperty(
-        sdbus::IObject* category_object_p,
-        const ConfigParser::ConfigMetadata& config_metadata
+        std::vector<sdbus::VTableItem>& vtable,
+        const ConfigParser::ConfigMetadata& config_metadata,
+        CategoryMetrics& metrics
     );
 
-    // Add a property to the object v-table on the config interface
+    // Add a property of the given type to the v-table
     template <typename Type>
     void addPropertyToVTable(
-        sdbus::IObject* category_object_p,
-        const ConfigParser::ConfigMetadata& config_metadata
+        std::vector<sdbus::VTableItem>& vtable,
+        const ConfigParser::ConfigMetadata& config_metadata,
+        CategoryMetrics& metrics
+    );
+
+    // Send property change signal if changes occurred in the config
+    // parser of the given store
+    void sendChangeSignals(UserStore& store);
+
+    // Create a subscription of the caller to the settings matching 
+    // the patterns, with the given debounce window. Return the path of
+    // the object emitting its change signal
+    //
+    // Raise a D-Bus error if no pattern is given or if the caller has
+    // too many subscriptions
+    sdbus::ObjectPath subscribe(
+        UserStore& store,
+        const std::vector<std::string>& patterns,
+        std::chrono::milliseconds debounce
+    );
+
+    // Remove the subscription of the caller at the given path
+    //
+    // Raise a D-Bus error if the caller has no subscription at the path
+    void unsubscribe(UserStore& store, const std::string& path);
+
+    // Watch a client so its state is removed when it leaves the bus,
+    // only the NameOwnerChanged signal of its name is received
+    void watchClient(const std::string& client);
+
+    // Remove the subscriptions of a client that left the bus, its
+    // match is removed by the main loop
+    void removeClient(const std::string& client);
+
+    // Match the patterns of the subscription against every setting
+    // of the configuration
+    static void matchSubscription(
+        const ConfigParser& config_parser,
+        Subscription& subscription
+    );
+
+    // Add the given updated settings to the subscriptions of the store
+    // matching them, they are sent at the end of the debounce window
+    void queueSubscriptionChanges(
+        UserStore& store,
+        const std::vector<ConfigParser::ConfigId>& config_ids
     );
 
-    // Send property change signal if changes occurred in the config parser  
-    void sendChangeSignals();
+    // Send the pending changes of a subscription in a single signal
+    void sendSubscriptionChanges(UserStore& store, Subscription& subscription);
+
+    // Send the changes of the subscriptions whose debounce window ended
+    void processDebounceTimer();
+
+    // Arm the debounce timer to the end of the earliest window,
+    // disarm it if no change is pending
+    void armDebounceTimer();
+
+    // Merge the new template fragments and create the objects of
+    // the categories they add
+    void addFragments();
 
-    // Property change 
-    void signalChangeLoop();
+    // Answer a read request on the dispatch threads, the reply holds
+    // the value returned by the function or the error it raised. A
+    // function answering several values returns them in a tuple.
+    // The function must only read the snapshots of the store
+    template <typename... Types, typename Function>
+    void dispatchRead(sdbus::Result<Types...>&& result, Function&& function);
+
+    // Queue a configuration update on the worker thread. The busy flag
+    // is set until the task completes, the main loop doesn't poll
+    // the descriptor of the task meanwhile
+    void runOnWorker(std::atomic<bool>& busy, std::function<void()> task);
+
+    // Wake up the main loop waiting in poll
+    void wakeUp();
+
+    // Convert a setting value to a D-Bus variant, integers are sent 
+    // as int32 like the properties
+    static sdbus::Variant toVariant(const ConfigParser::ConfigValue& value);
+
+    // Convert a D-Bus variant to a setting value of the given type
+    //
+    // Raise a D-Bus error if the variant doesn't hold the expected type
+    static ConfigParser::ConfigValue fromVariant(
+        const sdbus::Variant& variant,
+        ConfigParser::ConfigType type
+    );
+
+    // Convert a D-Bus variant holding the given c++ type to 
+    // a setting value
+    //
+    // Raise a D-Bus error if the variant doesn't hold the expected type
+    template <typename Type>
+    static ConfigParser::ConfigValue fromVariant(
+        const sdbus::Variant& variant
+    );
+
+    // Return a D-Bus error with the given name suffix and message
+    static sdbus::Error createError(
+        std::string_view name,
+        const std::string& message
+    );
+
+    // Raise a D-Bus error with the given name suffix and message
+    [[noreturn]] static void throwError(
+        std::string_view name,
+        const std::string& message
+    );
 
 private:
     // D-Bus connection 
     std::unique_ptr<sdbus::IConnection> m_connection;
     // D-Bus root object
     std::unique_ptr<sdbus::IObject> m_root_object;
+    // Match of the NameOwnerChanged signal of every watched client,
+    // by unique name
+    std::map<std::string, sdbus::Slot> m_client_matches;
+    // Uid of the clients of the system bus, by unique name
+    std::map<std::string, uid_t> m_client_uids;
+    // Clients that left the bus, their match is removed after the
+    // processing of the bus event
+    std::vector<std::string> m_left_clients;
 
     // Store the D-Bus object associated to each category
     std::map<std::string, std::unique_ptr<sdbus::IObject>> m_category_objects;
 
-    // Store the configuration data
-    ConfigParser m_config_parser;
+    // Base template shared by the configuration of every user
+    std::shared_ptr<ConfigParser::TemplateStore> m_template_store;
+
+    // Runtime statistics shared by the configuration of every user
+    std::shared_ptr<Metrics> m_metrics;
+
+    // Parameters of the configuration of the users
+    std::filesystem::path m_config_path;
+    std::chrono::milliseconds m_write_delay;
+    bool m_split;
+    UserFormat m_format;
+    bool m_journal;
+
+    // Directory holding the configuration of every user, empty in
+    // single user mode
+    std::filesystem::path m_users_path;
+    // Time after which an unused store is unloaded, zero to keep them
+    std::chrono::seconds m_idle_timeout;
+
+    // Loaded configuration of every user by uid. In single user mode
+    // it holds only the store of the daemon user
+    std::map<uid_t, std::shared_ptr<UserStore>> m_users;
+
+    // Single worker thread running the updates of the configuration,
+    // the main loop only reads the snapshots and never waits for 
+    // a file write. One thread keeps the updates in the request order
+    std::unique_ptr<ThreadPool> m_worker;
+
+    // Threads answering the read requests, they only read the published
+    // snapshots so the reads run in parallel with each other and with
+    // the updates. The bus messages are still received by the main loop
+    std::unique_ptr<ThreadPool> m_dispatcher;
+
+    // eventfd waking up the main loop when a worker task completes
+    int m_wake_fd;
+
+    // timerfd expiring periodically to unload the idle stores,
+    // only armed in multi-user mode
+    int m_evict_fd;
+
+    // timerfd expiring at the end of the earliest debounce window of
+    // the subscriptions
+    int m_debounce_fd;
+
+    // Number of the next subscription object
+    uint64_t m_next_subscription;
 };
 
 
-// Add a property to the object v-table on the config interface
+// Add a property of the given type to the v-table
 template <typename Type>
 void DbusServer::addPropertyToVTable(
-    sdbus::IObject* category_object_p,
-    const ConfigParser::ConfigMetadata& config_metadata
+    std::vector<sdbus::VTableItem>& vtable,
+    const ConfigParser::ConfigMetadata& config_metadata,
+    CategoryMetrics& metrics
 ) {
-    // The interface name will remain unchanged during the entire execution
-    // of the program, declaring it as static to avoid recalculating it
-    // every time the function is called
-    static sdbus::InterfaceName interface_name{
-        std::string(c_dbus_interface_name) +
-        c_dbus_interface_version
-    };
-
-    // Get the config path and name from the metadata
-    ConfigParser::ConfigPath config_path = config_metadata.getPath();
-    std::string config_name = std::string(config_path.getName());
+    // Get the config id and name from the metadata, the id is captured
+    // so the accessors don't need to look up the path
+    ConfigParser::ConfigId config_id = config_metadata.getId();
+    std::string config_name = std::string(
+        config_metadata.getPath().getName()
+    );
+    CategoryMetrics* category_metrics = &metrics;
 
     // Add the object to the v-table using the getter and setter
-    // of the appropriate type
-    category_object_p->addVTable(
+    // of the appropriate type. The getter reads the current snapshot
+    // of the caller. The setter publishes the value before returning so
+    // a following read sees it, the journal append and the file write
+    // are queued on the worker. The set is acknowledged before either,
+    // a crash in between loses it. A property set can't be replied later
+    // so a failed write is only logged, it's retried by the write timer
+    vtable.push_back(
         sdbus::registerProperty(config_name)
-            .withGetter([&, config_path]() { 
-                return m_config_parser.get<Type>(config_path);
+            .withGetter([&, config_id, category_metrics]() {
+                ScopedTimer timer(category_metrics->m_get);
+
+                return getCallerStore()->m_config_parser.get<Type>(config_id);
         })
-            .withSetter([&, config_path](const Type& data) {
-                m_config_parser.set<Type>(config_path, data);
+            .withSetter([&, config_id, category_metrics](const Type& data) {
+                ScopedTimer timer(category_metrics->m_set);
+                std::shared_ptr<UserStore> store = getCallerStore();
+
+                try {
+                    store->m_config_parser.setDeferred<Type>(config_id, data);
+                } catch (std::exception& e) {
+                    throwError("FileError", e.what());
+                }
+
+                // The sets published before the write runs are
+                // written once
+                m_worker->submit([config_id, store = std::move(store)]() {
+                    ConfigParser& config_parser = store->m_config_parser;
+
+                    try {
+                        config_parser.commitDeferred(config_id);
+                    } catch (std::exception& e) {
+                        ConfigParser::ConfigPathView path =
+                            config_parser.getMetadata(config_id).getPath();
+
+                        spdlog::error(
+                            "Failed to set {}:{}: {}",
+                            path.getCategory(), path.getName(), e.what()
+                        );
+                    }
+                });
         })
-    ).forInterface(interface_name);
+    );
+}
+
+// Answer a read request on the dispatch threads, the reply holds
+// the value returned by the function or the error it raised
+template <typename... Types, typename Function>
+void DbusServer::dispatchRead(
+    sdbus::Result<Types...>&& result,
+    Function&& function
+) {
+    m_dispatcher->submit([
+        result = std::move(result),
+        function = std::forward<Function>(function)
+    ]() mutable {
+        try {
+            if constexpr (sizeof...(Types) == 1) {
+                result.returnResults(function());
+            } else {
+                std::apply([&](const auto&... values) {
+                    result.returnResults(values...);
+                }, function());
+            }
+        } catch (sdbus::Error& e) {
+            result.returnError(e);
+        } catch (std::exception& e) {
+            result.returnError(createError("ReadError", e.what()));
+        }
+    });
+}
+
+// Convert a D-Bus variant holding the given c++ type to a setting value
+//
+// Raise a D-Bus error if the variant doesn't hold the expected type
+template <typename Type>
+ConfigParser::ConfigValue DbusServer::fromVariant(
+    const sdbus::Variant& variant
+) {
+    if (!variant.containsValueOfType<Type>()) {
+        throwError("TypeMismatch", "The value has the wrong type");
+    }
+
+    return ConfigParser::toConfigValue<Type>(variant.get<Type>());
 }
 
 } // namespace coil
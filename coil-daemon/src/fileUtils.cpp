@@ -0,0 +1,287 @@
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "coil/settingHandle.h"
+
+#include "fileUtils.h"
+
+namespace coil {
+
+// Number of hex digits of the checksum line, without the new line
+constexpr size_t c_checksum_digits = 16;
+
+// Raise an exception describing the failed operation on the file at
+// the given path and the errno value
+[[noreturn]] void throwFileError(
+    std::string_view operation,
+    const std::filesystem::path& path
+) {
+    throw std::runtime_error(
+        std::string(operation) + " failed on \"" + path.string() + "\": " + 
+        std::strerror(errno)
+    );
+}
+
+// Replace the content of the file at the given path atomically.
+//
+// Raise an exception if any step of the write fail
+void writeFileAtomic(
+    const std::filesystem::path& path,
+    std::string_view content
+) {
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+
+    int fd = open(
+        temp_path.c_str(),
+        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        0644
+    );
+
+    if (fd < 0)
+        throwFileError("open", temp_path);
+
+    // Write the whole content, write can be partial
+    const char* data = content.data();
+    size_t remaining = content.size();
+
+    while (remaining > 0) {
+        ssize_t written = write(fd, data, remaining);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+
+            close(fd);
+            unlink(temp_path.c_str());
+            throwFileError("write", temp_path);
+        }
+
+        data += written;
+        remaining -= written;
+    }
+
+    // The data must be on disk before the rename, otherwise a crash
+    // can leave an empty file at the destination
+    if (fsync(fd) != 0) {
+        close(fd);
+        unlink(temp_path.c_str());
+        throwFileError("fsync", temp_path);
+    }
+
+    close(fd);
+
+    if (rename(temp_path.c_str(), path.c_str()) != 0) {
+        unlink(temp_path.c_str());
+        throwFileError("rename", path);
+    }
+
+    // Sync the directory to persist the rename, failing here doesn't
+    // invalidate the write
+    std::filesystem::path directory = 
+        path.has_parent_path() ? path.parent_path() : ".";
+
+    int dir_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+}
+
+// Return the checksum of the given data, a 64 bits FNV-1a hash
+uint64_t checksumData(std::string_view data)
+{
+    return fingerprintBytes(c_fingerprint_basis, data);
+}
+
+// Replace the content of the file at the given path atomically, the
+// content is preceded by a line holding its checksum
+//
+// Raise an exception if any step of the write fail
+void writeChecksummedFile(
+    const std::filesystem::path& path,
+    std::string_view content
+) {
+    char checksum[c_checksum_digits + 1];
+    std::snprintf(
+        checksum, sizeof(checksum), "%016llx",
+        static_cast<unsigned long long>(checksumData(content))
+    );
+
+    std::string data;
+    data.reserve(c_checksum_digits + 1 + content.size());
+    data.append(checksum, c_checksum_digits);
+    data += '\n';
+    data.append(content);
+
+    writeFileAtomic(path, data);
+}
+
+// Return the checksum stored in the given data of a file written by
+// writeChecksummedFile
+// Return nullopt if the data doesn't start with a checksum line
+static std::optional<uint64_t> parseChecksum(std::string_view data)
+{
+    if (data.size() <= c_checksum_digits || data[c_checksum_digits] != '\n')
+        return std::nullopt;
+
+    uint64_t checksum;
+    const char* end = data.data() + c_checksum_digits;
+    auto result = std::from_chars(data.data(), end, checksum, 16);
+
+    if (result.ec != std::errc() || result.ptr != end)
+        return std::nullopt;
+
+    return checksum;
+}
+
+// Return the checksum stored in the file written by
+// writeChecksummedFile at the given path, only the first line is read.
+// Return nullopt if the file can't be read or has no checksum line
+std::optional<uint64_t> readFileChecksum(const std::filesystem::path& path)
+{
+    try {
+        // Only the pages of the first line are read from the mapping
+        MappedFile file(path);
+        return parseChecksum(file.getData());
+
+    } catch (std::exception&) {
+        return std::nullopt;
+    }
+}
+
+// Return the content of the file written by writeChecksummedFile at
+// the given path
+// Return nullopt if the file can't be read or its content doesn't
+// match the checksum
+std::optional<std::string> readChecksummedFile(
+    const std::filesystem::path& path
+) {
+    try {
+        MappedFile file(path);
+        std::string_view data = file.getData();
+        std::optional<uint64_t> checksum = parseChecksum(data);
+
+        if (!checksum.has_value())
+            return std::nullopt;
+
+        std::string_view content = data.substr(c_checksum_digits + 1);
+
+        if (checksumData(content) != *checksum)
+            return std::nullopt;
+
+        return std::string(content);
+
+    } catch (std::exception&) {
+        return std::nullopt;
+    }
+}
+
+// Return the content of the file at the given path, copied in memory
+//
+// Raise an exception if the file can't be opened or read
+std::string readFile(const std::filesystem::path& path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        throwFileError("open", path);
+
+    struct stat file_stat;
+
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throwFileError("stat", path);
+    }
+
+    // The size is only a hint, the file may change while it's read
+    std::string content;
+    content.resize(file_stat.st_size + 1);
+    size_t size = 0;
+
+    while (true) {
+        if (size == content.size())
+            content.resize(content.size() * 2);
+
+        ssize_t count = read(
+            fd,
+            content.data() + size,
+            content.size() - size
+        );
+
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+
+            close(fd);
+            throwFileError("read", path);
+        }
+
+        if (count == 0)
+            break;
+
+        size += count;
+    }
+
+    close(fd);
+    content.resize(size);
+
+    return content;
+}
+
+// Map the file at the given path
+//
+// Raise an exception if the file can't be opened or mapped
+MappedFile::MappedFile(const std::filesystem::path& path) :
+    m_data(nullptr),
+    m_size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        throwFileError("open", path);
+
+    struct stat file_stat;
+
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throwFileError("stat", path);
+    }
+
+    m_size = file_stat.st_size;
+
+    // An empty mapping is not allowed
+    if (m_size == 0) {
+        close(fd);
+        return;
+    }
+
+    void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+        throwFileError("mmap", path);
+
+    // The file is parsed once from the start to the end
+    madvise(mapping, m_size, MADV_SEQUENTIAL);
+
+    m_data = static_cast<const char*>(mapping);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data != nullptr)
+        munmap(const_cast<char*>(m_data), m_size);
+}
+
+} // namespace coil
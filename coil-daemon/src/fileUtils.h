@@ -0,0 +1,91 @@
+#ifndef COIL_FILE_UTILS_H
+#define COIL_FILE_UTILS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace coil {
+
+// Raise an exception describing the failed operation on the file at
+// the given path and the errno value
+[[noreturn]] void throwFileError(
+    std::string_view operation,
+    const std::filesystem::path& path
+);
+
+// Replace the content of the file at the given path atomically.
+// The data is written to a temporary file in the same directory, synced
+// to disk and renamed over the destination, a crash during the write
+// leaves either the old or the new file.
+//
+// Raise an exception if any step of the write fail
+void writeFileAtomic(
+    const std::filesystem::path& path,
+    std::string_view content
+);
+
+// Return the checksum of the given data, a 64 bits FNV-1a hash
+uint64_t checksumData(std::string_view data);
+
+// Replace the content of the file at the given path atomically like
+// writeFileAtomic, the content is preceded by a line holding its
+// checksum so a corrupt file is detected when it's read back
+//
+// Raise an exception if any step of the write fail
+void writeChecksummedFile(
+    const std::filesystem::path& path,
+    std::string_view content
+);
+
+// Return the checksum stored in the file written by
+// writeChecksummedFile at the given path, only the first line is read.
+// Return nullopt if the file can't be read or has no checksum line
+std::optional<uint64_t> readFileChecksum(const std::filesystem::path& path);
+
+// Return the content of the file written by writeChecksummedFile at
+// the given path
+// Return nullopt if the file can't be read or its content doesn't
+// match the checksum
+std::optional<std::string> readChecksummedFile(
+    const std::filesystem::path& path
+);
+
+// Return the content of the file at the given path, copied in memory.
+// Unlike a mapping the copy can't fault if the file is truncated while
+// it's parsed, for the files edited by other processes
+//
+// Raise an exception if the file can't be opened or read
+std::string readFile(const std::filesystem::path& path);
+
+// Map a file read only in memory, the mapping is released when the
+// object is destroyed. The files replaced with writeFileAtomic can be
+// mapped safely, the mapping keeps the old file. A file truncated in
+// place while mapped raises SIGBUS, use readFile for the others
+class MappedFile {
+public:
+    // Map the file at the given path
+    //
+    // Raise an exception if the file can't be opened or mapped
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Return the content of the file
+    std::string_view getData() const { return {m_data, m_size}; }
+
+private:
+    // Start of the mapping, nullptr for an empty file
+    const char* m_data;
+    // Size of the file
+    size_t m_size;
+};
+
+} // namespace coil
+
+#endif
@@ -0,0 +1,100 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+#include "fileWatcher.h"
+
+namespace coil {
+
+// Events that mark a file as changed. IN_MOVED_TO is required to catch
+// editors that write a temporary file and rename it over the original
+constexpr uint32_t c_watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+// Create a watcher for the given directory.
+//
+// Raise an exception if the inotify instance can't be created.
+FileWatcher::FileWatcher(std::filesystem::path directory) :
+    m_directory(directory),
+    m_fd(-1),
+    m_watch(-1)
+{
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (m_fd < 0) {
+        throw std::runtime_error(
+            std::string("inotify_init1 failed: ") + std::strerror(errno)
+        );
+    }
+
+    addWatch();
+}
+
+FileWatcher::~FileWatcher()
+{
+    close(m_fd);
+}
+
+// Start watching the directory if it isn't already watched
+// Return true on success
+bool FileWatcher::addWatch()
+{
+    if (m_watch >= 0)
+        return true;
+
+    m_watch = inotify_add_watch(m_fd, m_directory.c_str(), c_watch_mask);
+
+    if (m_watch < 0) {
+        spdlog::warn(
+            "Couldn't watch directory \"{}\": {}",
+            m_directory.c_str(),
+            std::strerror(errno)
+        );
+
+        return false;
+    }
+
+    spdlog::debug("Watching directory \"{}\"", m_directory.c_str());
+
+    return true;
+}
+
+// Read all the pending events without blocking.
+std::vector<std::string> FileWatcher::readEvents()
+{
+    std::vector<std::string> files;
+
+    // Buffer aligned as required by the inotify_event structure
+    alignas(struct inotify_event) char buffer[4096];
+
+    while (true) {
+        ssize_t len = read(m_fd, buffer, sizeof(buffer));
+
+        // No more events to read
+        if (len <= 0)
+            break;
+
+        for (char* ptr = buffer; ptr < buffer + len; ) {
+            const struct inotify_event* event =
+                reinterpret_cast<const struct inotify_event*>(ptr);
+
+            // The watched directory was removed, the watch is
+            // no longer valid
+            if (event->mask & IN_IGNORED) {
+                m_watch = -1;
+            } else if (event->len > 0) {
+                files.emplace_back(event->name);
+            }
+
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return files;
+}
+
+} // namespace coil
@@ -0,0 +1,53 @@
+#ifndef COIL_FILE_WATCHER_H
+#define COIL_FILE_WATCHER_H
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace coil {
+
+// Watch a directory for files written or moved into it using inotify.
+// The file descriptor can be added to a poll set, when it becomes readable
+// readEvents return the name of the files that changed
+class FileWatcher {
+public:
+    // Create a watcher for the given directory.
+    //
+    // Raise an exception if the inotify instance can't be created.
+    // If the directory doesn't exist the watcher is created without a
+    // watch, use addWatch to retry once the directory exist
+    FileWatcher(std::filesystem::path directory);
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Return the inotify file descriptor to be used in poll
+    int getFd() const { return m_fd; }
+
+    // Return true if the directory is currently watched
+    bool isWatching() const { return m_watch >= 0; }
+
+    // Start watching the directory if it isn't already watched
+    // Return true on success
+    bool addWatch();
+
+    // Read all the pending events without blocking.
+    // Return the name of the files that were written or moved
+    // into the watched directory
+    std::vector<std::string> readEvents();
+
+private:
+    // The watched directory
+    std::filesystem::path m_directory;
+
+    // inotify instance file descriptor
+    int m_fd;
+    // inotify watch descriptor, negative if the directory isn't watched
+    int m_watch;
+};
+
+} // namespace coil
+
+#endif
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cerrno>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+#include "fileUtils.h"
+#include "journal.h"
+
+namespace coil {
+
+// Open the journal at the given path, creating it if needed.
+// A record left incomplete by a crash is removed
+//
+// Raise an exception if the file can't be opened
+Journal::Journal(std::filesystem::path path) :
+    m_path(std::move(path)),
+    m_fd(openFile()),
+    m_records(0),
+    m_size(0)
+{
+    std::vector<std::string> records;
+
+    try {
+        records = readRecords();
+    } catch (...) {
+        close(m_fd);
+        throw;
+    }
+
+    for (const auto& record : records) {
+        m_records++;
+        m_size += record.size() + 1;
+    }
+
+    // Drop the end of a record whose append was interrupted
+    if (ftruncate(m_fd, m_size) != 0) {
+        close(m_fd);
+        throwFileError("ftruncate", m_path);
+    }
+}
+
+Journal::~Journal()
+{
+    close(m_fd);
+}
+
+// Return the records of the journal in the append order
+//
+// Raise an exception if the file can't be read
+std::vector<std::string> Journal::readRecords() const
+{
+    MappedFile file(m_path);
+    std::string_view data = file.getData();
+    std::vector<std::string> records;
+
+    // The last line is incomplete if it has no new line
+    size_t end;
+
+    while ((end = data.find('\n')) != std::string_view::npos) {
+        records.emplace_back(data.substr(0, end));
+        data.remove_prefix(end + 1);
+    }
+
+    return records;
+}
+
+// Append a record and sync it to disk
+//
+// Raise an exception if the write fail, the record is not
+// in the journal then
+void Journal::append(std::string_view record)
+{
+    std::string line;
+    line.reserve(record.size() + 1);
+    line += record;
+    line += '\n';
+
+    // Write the whole record, write can be partial
+    const char* data = line.data();
+    size_t remaining = line.size();
+
+    while (remaining > 0) {
+        ssize_t written = write(m_fd, data, remaining);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+
+            abortAppend("write");
+        }
+
+        data += written;
+        remaining -= written;
+    }
+
+    if (fdatasync(m_fd) != 0)
+        abortAppend("fdatasync");
+
+    m_records++;
+    m_size += line.size();
+}
+
+// Return the position after the last record
+Journal::Mark Journal::getMark() const
+{
+    return {
+        m_discarded.m_records + m_records,
+        m_discarded.m_bytes + m_size
+    };
+}
+
+// Remove the records appended before the given position
+//
+// Raise an exception if the file can't be rewritten
+void Journal::discard(const Mark& mark)
+{
+    if (mark.m_records <= m_discarded.m_records)
+        return;
+
+    uint64_t records = std::min(
+        mark.m_records - m_discarded.m_records,
+        m_records
+    );
+    uint64_t bytes = std::min(mark.m_bytes - m_discarded.m_bytes, m_size);
+
+    if (records == m_records) {
+        // Nothing to keep, a truncation not yet on disk at the time of
+        // a crash only makes the records be replayed again
+        if (ftruncate(m_fd, 0) != 0)
+            throwFileError("ftruncate", m_path);
+    } else {
+        // Keep the records appended after the mark
+        std::string tail(m_size - bytes, '\0');
+        size_t read_size = 0;
+
+        while (read_size < tail.size()) {
+            ssize_t len = pread(
+                m_fd,
+                tail.data() + read_size,
+                tail.size() - read_size,
+                bytes + read_size
+            );
+
+            if (len < 0 && errno == EINTR)
+                continue;
+            if (len <= 0)
+                throwFileError("read", m_path);
+
+            read_size += len;
+        }
+
+        // The file is replaced, the descriptor must follow it
+        writeFileAtomic(m_path, tail);
+
+        int fd = openFile();
+        close(m_fd);
+        m_fd = fd;
+    }
+
+    m_records -= records;
+    m_size -= bytes;
+    m_discarded.m_records += records;
+    m_discarded.m_bytes += bytes;
+}
+
+// Remove the part of the record already written and raise an exception
+// describing the failed operation
+void Journal::abortAppend(std::string_view operation)
+{
+    int error = errno;
+
+    // If this fails too the next open still drops an incomplete record
+    if (ftruncate(m_fd, m_size) != 0)
+        spdlog::warn("Couldn't truncate \"{}\"", m_path.c_str());
+
+    errno = error;
+    throwFileError(operation, m_path);
+}
+
+// Open the journal file for appending
+//
+// Raise an exception if the file can't be opened
+int Journal::openFile() const
+{
+    int fd = open(
+        m_path.c_str(),
+        O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+        0644
+    );
+
+    if (fd < 0)
+        throwFileError("open", m_path);
+
+    return fd;
+}
+
+} // namespace coil
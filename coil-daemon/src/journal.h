@@ -0,0 +1,82 @@
+#ifndef COIL_JOURNAL_H
+#define COIL_JOURNAL_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace coil {
+
+// Append only log of the changes committed but not yet written to the
+// user configuration. Each record is a line, it's synced to disk before
+// the change is published so a crash during the write delay doesn't
+// lose it. The records written to the configuration are discarded.
+//
+// The journal is not thread safe, the caller serializes the accesses
+class Journal {
+public:
+    // Position in the journal, counted from the creation of the object
+    // so it stays valid when records are discarded
+    struct Mark {
+        uint64_t m_records = 0;
+        uint64_t m_bytes = 0;
+    };
+
+    // Open the journal at the given path, creating it if needed.
+    // A record left incomplete by a crash is removed
+    //
+    // Raise an exception if the file can't be opened
+    explicit Journal(std::filesystem::path path);
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Return the records of the journal in the append order
+    //
+    // Raise an exception if the file can't be read
+    std::vector<std::string> readRecords() const;
+
+    // Append a record and sync it to disk, the record must not
+    // contain a new line
+    //
+    // Raise an exception if the write fail, the record is not
+    // in the journal then
+    void append(std::string_view record);
+
+    // Return the position after the last record
+    Mark getMark() const;
+
+    // Remove the records appended before the given position
+    //
+    // Raise an exception if the file can't be rewritten
+    void discard(const Mark& mark);
+
+private:
+    // Remove the part of the record already written and raise an
+    // exception describing the failed operation
+    [[noreturn]] void abortAppend(std::string_view operation);
+
+    // Open the journal file for appending
+    //
+    // Raise an exception if the file can't be opened
+    int openFile() const;
+
+    // Path to the journal file
+    std::filesystem::path m_path;
+    // Journal file descriptor, opened in append mode
+    int m_fd;
+
+    // Number of records and bytes in the file
+    uint64_t m_records;
+    uint64_t m_size;
+
+    // Number of records and bytes discarded since the creation
+    Mark m_discarded;
+};
+
+} // namespace coil
+
+#endif
@@ -0,0 +1,1022 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+#include <nlohmann/json.hpp>
+
+#include "spdlog/spdlog.h"
+
+#include "jsonLoader.h"
+
+namespace coil {
+
+using ConfigType = ConfigParser::ConfigType;
+using ConfigValue = ConfigParser::ConfigValue;
+
+// Base of the streaming handlers. The arrays are converted to setting
+// values like ConfigParser::toConfigValue and delivered as a single
+// value, the containers skipped by the derived handler are filtered
+class SaxHandler : public nlohmann::json_sax<nlohmann::json> {
+public:
+    bool null() override { return value(ConfigValue(), true); }
+
+    bool boolean(bool data) override
+    {
+        return value(ConfigValue(std::in_place_type<bool>, data), false);
+    }
+
+    bool number_integer(number_integer_t data) override
+    {
+        return value(ConfigValue(std::in_place_type<int64_t>, data), false);
+    }
+
+    bool number_unsigned(number_unsigned_t data) override
+    {
+        return value(
+            ConfigValue(std::in_place_type<int64_t>, data),
+            false
+        );
+    }
+
+    bool number_float(number_float_t data, const string_t&) override
+    {
+        return value(ConfigValue(std::in_place_type<double>, data), false);
+    }
+
+    bool string(string_t& data) override
+    {
+        return value(
+            ConfigValue(std::in_place_type<std::string>, std::move(data)),
+            false
+        );
+    }
+
+    // Binary values only exist in the binary formats
+    bool binary(binary_t&) override { return value(ConfigValue(), false); }
+
+    bool start_object(std::size_t) override
+    {
+        if (m_skip_depth > 0 || m_array.has_value()) {
+            startNested();
+            return true;
+        }
+
+        return onStartObject();
+    }
+
+    bool key(string_t& key) override
+    {
+        if (m_skip_depth > 0)
+            return true;
+
+        return onKey(std::move(key));
+    }
+
+    bool end_object() override { return end(); }
+
+    bool start_array(std::size_t) override
+    {
+        if (m_skip_depth > 0 || m_array.has_value()) {
+            startNested();
+            return true;
+        }
+
+        m_array.emplace();
+
+        return true;
+    }
+
+    bool end_array() override { return end(); }
+
+    bool parse_error(
+        std::size_t,
+        const std::string&,
+        const nlohmann::detail::exception& exception
+    ) override {
+        m_error = exception.what();
+
+        return false;
+    }
+
+    // Return the error that stopped the parse
+    const std::string& getError() const { return m_error; }
+
+protected:
+    // Called for every value outside of an array, is_null is true for
+    // a json null. An invalid array is delivered as monostate
+    virtual bool onValue(ConfigValue data, bool is_null) = 0;
+    // Called when an object starts outside of an array
+    virtual bool onStartObject() = 0;
+    // Called for every key of the objects not skipped
+    virtual bool onKey(std::string key) = 0;
+    // Called when an object not skipped ends
+    virtual bool onEndObject() = 0;
+
+    // Skip the content of the object that was just started
+    void skipObject() { m_skip_depth = 1; }
+
+    // Stop the parse with the given error
+    bool fail(std::string error)
+    {
+        m_error = std::move(error);
+
+        return false;
+    }
+
+private:
+    // Elements of the array being read
+    struct ArrayData {
+        // Type of the elements, None before the first element
+        ConfigType m_type = ConfigType::None;
+        // Store false if the array isn't a valid setting value
+        bool m_valid = true;
+
+        std::vector<int64_t> m_ints;
+        std::vector<double> m_floats;
+        std::vector<std::string> m_strings;
+    };
+
+    // Handle a scalar value
+    bool value(ConfigValue data, bool is_null)
+    {
+        if (m_skip_depth > 0)
+            return true;
+
+        if (m_array.has_value()) {
+            addElement(std::move(data));
+            return true;
+        }
+
+        return onValue(std::move(data), is_null);
+    }
+
+    // Add an element to the array being read, only the arrays of
+    // numbers or strings of the same type are valid
+    void addElement(ConfigValue data)
+    {
+        ArrayData& array = *m_array;
+        ConfigType type = ConfigParser::getValueType(data);
+
+        if (!array.m_valid)
+            return;
+
+        if (type != ConfigType::Int && type != ConfigType::Float &&
+            type != ConfigType::String
+        ) {
+            array.m_valid = false;
+            return;
+        }
+
+        if (array.m_type != ConfigType::None && array.m_type != type) {
+            array.m_valid = false;
+            return;
+        }
+
+        array.m_type = type;
+
+        switch (type) {
+            case ConfigType::Int:
+                array.m_ints.push_back(std::get<int64_t>(data));
+                break;
+            case ConfigType::Float:
+                array.m_floats.push_back(std::get<double>(data));
+                break;
+            default:
+                array.m_strings.push_back(
+                    std::move(std::get<std::string>(data))
+                );
+                break;
+        }
+    }
+
+    // Start a container that is skipped, a container nested in an
+    // array makes the array invalid
+    void startNested()
+    {
+        if (m_skip_depth == 0)
+            m_array->m_valid = false;
+
+        m_skip_depth++;
+    }
+
+    // Handle the end of a container
+    bool end()
+    {
+        if (m_skip_depth > 0) {
+            m_skip_depth--;
+            return true;
+        }
+
+        if (!m_array.has_value())
+            return onEndObject();
+
+        ArrayData array = std::move(*m_array);
+        m_array.reset();
+
+        // An empty array has no type
+        ConfigValue data;
+
+        if (array.m_valid) {
+            switch (array.m_type) {
+                case ConfigType::Int:
+                    data = std::move(array.m_ints);
+                    break;
+                case ConfigType::Float:
+                    data = std::move(array.m_floats);
+                    break;
+                case ConfigType::String:
+                    data = std::move(array.m_strings);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        return onValue(std::move(data), false);
+    }
+
+    // Depth of the containers being skipped, zero if not skipping
+    size_t m_skip_depth = 0;
+    // Array being read, nullopt outside of an array
+    std::optional<ArrayData> m_array;
+
+    // Error that stopped the parse
+    std::string m_error;
+};
+
+// Read the settings of a base template:
+// {"category": {"setting": {"default": ..., "displayed_name": ...,
+// "description": ...}}}
+class TemplateHandler : public SaxHandler {
+public:
+    explicit TemplateHandler(const std::filesystem::path& path) :
+        m_path(path)
+    {
+    }
+
+    // Return the settings read
+    std::vector<TemplateSetting>& getSettings() { return m_settings; }
+
+protected:
+    bool onValue(ConfigValue data, bool is_null) override
+    {
+        switch (m_depth) {
+            case 0:
+                return fail("The base template must be an object");
+
+            case 1:
+                spdlog::warn(
+                    "Ignoring \"{}: {}\"; category must be an object",
+                    m_path.c_str(), m_category
+                );
+
+                return true;
+
+            case 2:
+                spdlog::warn(
+                    "Ignoring \"{}: ({}:{})\"; setting must be an object",
+                    m_path.c_str(), m_category, m_setting
+                );
+
+                return true;
+
+            default:
+                setField(std::move(data), is_null);
+                return true;
+        }
+    }
+
+    bool onStartObject() override
+    {
+        // The fields of a setting can't be objects
+        if (m_depth == 3) {
+            if (m_field == "default") {
+                m_default = Field::Object;
+            } else if (m_field == "displayed_name") {
+                m_displayed_name = Field::WrongType;
+            } else if (m_field == "description") {
+                m_description = Field::WrongType;
+            }
+
+            skipObject();
+            return true;
+        }
+
+        m_depth++;
+
+        // Start a new setting
+        if (m_depth == 3) {
+            m_default = Field::Missing;
+            m_displayed_name = Field::Missing;
+            m_description = Field::Missing;
+
+            m_value = ConfigValue();
+            m_displayed_name_value.clear();
+            m_description_value.clear();
+        }
+
+        return true;
+    }
+
+    bool onKey(std::string key) override
+    {
+        switch (m_depth) {
+            case 1:
+                m_category = std::move(key);
+                break;
+            case 2:
+                m_setting = std::move(key);
+                break;
+            default:
+                m_field = std::move(key);
+                break;
+        }
+
+        return true;
+    }
+
+    bool onEndObject() override
+    {
+        if (m_depth == 3)
+            addSetting();
+
+        m_depth--;
+
+        return true;
+    }
+
+private:
+    // State of a field of the setting being read
+    enum class Field {
+        Missing = 0,
+        Valid,
+        WrongType,
+        Object
+    };
+
+    // Store the value of a field of the setting being read, the
+    // unknown fields are ignored. A null field is missing
+    void setField(ConfigValue data, bool is_null)
+    {
+        bool is_string =
+            ConfigParser::getValueType(data) == ConfigType::String;
+        Field state = is_null ? Field::Missing :
+            (is_string ? Field::Valid : Field::WrongType);
+
+        if (m_field == "default") {
+            m_default = is_null ? Field::Missing : Field::Valid;
+            m_value = std::move(data);
+        } else if (m_field == "displayed_name") {
+            m_displayed_name = state;
+
+            if (is_string)
+                m_displayed_name_value = std::get<std::string>(data);
+        } else if (m_field == "description") {
+            m_description = state;
+
+            if (is_string)
+                m_description_value = std::get<std::string>(data);
+        }
+    }
+
+    // Validate the setting that was read and add it to the settings
+    void addSetting()
+    {
+        // Check if all the field exist
+        if (m_default == Field::Missing) {
+            spdlog::warn(
+                "Ignoring \"{}: ({}:{})\"; missing default field",
+                m_path.c_str(), m_category, m_setting
+            );
+
+            return;
+        }
+        if (m_displayed_name == Field::Missing) {
+            spdlog::warn(
+                "Ignoring \"{}: ({}:{})\"; missing displayed_name field",
+                m_path.c_str(), m_category, m_setting
+            );
+
+            return;
+        }
+        if (m_description == Field::Missing) {
+            spdlog::warn(
+                "Ignoring \"{}: ({}:{})\"; missing description field",
+                m_path.c_str(), m_category, m_setting
+            );
+
+            return;
+        }
+
+        // Check the type of each field
+        if (m_default == Field::Object) {
+            spdlog::warn(
+                "Ignoring \"{}: ({}:{})\"; default can't be an onject",
+                m_path.c_str(), m_category, m_setting
+            );
+
+            return;
+        }
+        if (m_displayed_name != Field::Valid) {
+            spdlog::warn(
+                "Ignoring \"{}: ({}:{})\"; displayed_name has wrong type",
+                m_path.c_str(), m_category, m_setting
+            );
+
+            return;
+        }
+        if (m_description != Field::Valid) {
+            spdlog::warn(
+                "Ignoring \"{}: ({}:{})\"; description has wrong type",
+                m_path.c_str(), m_category, m_setting
+            );
+
+            return;
+        }
+
+        // Log the successful setting creation
+        spdlog::debug(
+            "Found config \"{}:{}\" - {}",
+            m_category,
+            m_setting,
+            ConfigParser::configTypeStr(ConfigParser::getValueType(m_value))
+        );
+
+        m_settings.push_back({
+            ConfigParser::ConfigPath(m_category, m_setting),
+            std::move(m_value),
+            std::move(m_displayed_name_value),
+            std::move(m_description_value)
+        });
+    }
+
+    // Path of the template, used in the warnings
+    const std::filesystem::path& m_path;
+
+    // Depth of the objects being read, 1 in the root object
+    size_t m_depth = 0;
+
+    // Names of the category, setting and field being read
+    std::string m_category;
+    std::string m_setting;
+    std::string m_field;
+
+    // Fields of the setting being read
+    Field m_default = Field::Missing;
+    Field m_displayed_name = Field::Missing;
+    Field m_description = Field::Missing;
+
+    ConfigValue m_value;
+    std::string m_displayed_name_value;
+    std::string m_description_value;
+
+    // Settings read
+    std::vector<TemplateSetting> m_settings;
+};
+
+// Tokens of the content of a category recorded by UserConfigHandler,
+// the values are followed by their bytes and the strings by their size
+enum class Token : char {
+    Null,
+    False,
+    True,
+    Integer,
+    Unsigned,
+    Float,
+    String,
+    Binary,
+    Key,
+    StartObject,
+    EndObject,
+    StartArray,
+    EndArray
+};
+
+// Read the categories of a user configuration:
+// {"category": {"setting": value}}. The content of each category is
+// recorded as tokens instead of being converted, two categories with
+// the same tokens have the same settings
+class UserConfigHandler : public nlohmann::json_sax<nlohmann::json> {
+public:
+    // Return the categories read
+    std::vector<UserCategory>& getCategories() { return m_categories; }
+
+    bool null() override { return value(Token::Null); }
+
+    bool boolean(bool data) override
+    {
+        return value(data ? Token::True : Token::False);
+    }
+
+    bool number_integer(number_integer_t data) override
+    {
+        return value(Token::Integer, data);
+    }
+
+    bool number_unsigned(number_unsigned_t data) override
+    {
+        return value(Token::Unsigned, data);
+    }
+
+    bool number_float(number_float_t data, const string_t&) override
+    {
+        return value(Token::Float, data);
+    }
+
+    bool string(string_t& data) override
+    {
+        return value(Token::String, data);
+    }
+
+    // The binary values are converted to monostate whatever their
+    // content, it isn't recorded
+    bool binary(binary_t&) override { return value(Token::Binary); }
+
+    bool start_object(std::size_t) override
+    {
+        return start(Token::StartObject);
+    }
+
+    bool key(string_t& key) override
+    {
+        if (m_depth == 1)
+            m_key = std::move(key);
+        else
+            record(Token::Key, key);
+
+        return true;
+    }
+
+    bool end_object() override { return end(Token::EndObject); }
+
+    bool start_array(std::size_t) override
+    {
+        return start(Token::StartArray);
+    }
+
+    bool end_array() override { return end(Token::EndArray); }
+
+    bool parse_error(
+        std::size_t,
+        const std::string&,
+        const nlohmann::detail::exception& exception
+    ) override {
+        m_error = exception.what();
+
+        return false;
+    }
+
+    // Return the error that stopped the parse
+    const std::string& getError() const { return m_error; }
+
+private:
+    // Handle a scalar value
+    template <typename... Data>
+    bool value(Token token, const Data&... data)
+    {
+        switch (m_depth) {
+            // The root
+            case 0:
+                m_error = "The user configuration must be an object";
+                return false;
+
+            // A category that isn't an object
+            case 1:
+                addCategory().m_is_object = false;
+                return true;
+
+            default:
+                record(token, data...);
+                return true;
+        }
+    }
+
+    // Handle the start of a container
+    bool start(Token token)
+    {
+        switch (m_depth) {
+            // The root
+            case 0:
+                if (token != Token::StartObject) {
+                    m_error = "The user configuration must be an object";
+                    return false;
+                }
+
+                break;
+
+            // A category, its content is skipped if it isn't an object
+            case 1:
+                addCategory().m_is_object = token == Token::StartObject;
+                break;
+
+            default:
+                record(token);
+                break;
+        }
+
+        m_depth++;
+
+        return true;
+    }
+
+    // Handle the end of a container
+    bool end(Token token)
+    {
+        m_depth--;
+
+        if (m_depth > 1)
+            record(token);
+
+        return true;
+    }
+
+    // Append a token to the content of the category being read
+    void record(Token token)
+    {
+        UserCategory& category = m_categories.back();
+
+        if (category.m_is_object)
+            category.m_content.push_back(static_cast<char>(token));
+    }
+
+    // Append a token and the bytes of its value to the content of the
+    // category being read
+    template <typename Type>
+    void record(Token token, const Type& data)
+    {
+        UserCategory& category = m_categories.back();
+
+        if (!category.m_is_object)
+            return;
+
+        category.m_content.push_back(static_cast<char>(token));
+        category.m_content.append(
+            reinterpret_cast<const char*>(&data),
+            sizeof(data)
+        );
+    }
+
+    // Append a token and its string to the content of the category
+    // being read
+    void record(Token token, const std::string& data)
+    {
+        record(token, data.size());
+
+        if (m_categories.back().m_is_object)
+            m_categories.back().m_content.append(data);
+    }
+
+    // Add a category named after the current key, it replaces a
+    // category with the same name
+    UserCategory& addCategory()
+    {
+        auto index = m_indexes.find(m_key);
+
+        if (index != m_indexes.end()) {
+            size_t removed = index->second;
+
+            m_categories.erase(m_categories.begin() + removed);
+            m_indexes.erase(index);
+
+            for (auto& [category, position] : m_indexes) {
+                if (position > removed)
+                    position--;
+            }
+        }
+
+        m_indexes.emplace(m_key, m_categories.size());
+
+        UserCategory& category = m_categories.emplace_back();
+        category.m_name = std::move(m_key);
+
+        return category;
+    }
+
+    // Depth of the containers being read, 1 in the root object
+    size_t m_depth = 0;
+    // Last key of the root object
+    std::string m_key;
+
+    // Categories read and their position
+    std::vector<UserCategory> m_categories;
+    std::map<std::string, size_t> m_indexes;
+
+    // Error that stopped the parse
+    std::string m_error;
+};
+
+// Read the settings of a single category: {"setting": value}
+class UserHandler : public SaxHandler {
+public:
+    // Return the category read
+    UserCategory& getCategory() { return m_category; }
+
+protected:
+    bool onValue(ConfigValue data, bool) override
+    {
+        // The root isn't an object
+        if (m_depth == 0) {
+            m_category.m_is_object = false;
+            return true;
+        }
+
+        m_category.m_settings.push_back({
+            std::move(m_key),
+            std::move(data)
+        });
+
+        return true;
+    }
+
+    bool onStartObject() override
+    {
+        // A setting can't be an object
+        if (m_depth == 1) {
+            m_category.m_settings.push_back({
+                std::move(m_key),
+                ConfigValue()
+            });
+
+            skipObject();
+            return true;
+        }
+
+        m_depth++;
+
+        return true;
+    }
+
+    bool onKey(std::string key) override
+    {
+        m_key = std::move(key);
+
+        return true;
+    }
+
+    bool onEndObject() override
+    {
+        m_depth--;
+
+        return true;
+    }
+
+private:
+    // Depth of the objects being read, 1 in the root object
+    size_t m_depth = 0;
+    // Last key read
+    std::string m_key;
+
+    // Category read
+    UserCategory m_category;
+};
+
+// Reader of the tokens recorded by UserConfigHandler
+class TokenReader {
+public:
+    explicit TokenReader(std::string_view content) : m_content(content) {}
+
+    // Return true if all the tokens were read
+    bool atEnd() const { return m_position == m_content.size(); }
+
+    // Return the next token
+    Token readToken()
+    {
+        return static_cast<Token>(m_content[m_position++]);
+    }
+
+    // Return the value following a token
+    template <typename Type>
+    Type read()
+    {
+        Type data;
+        std::memcpy(&data, m_content.data() + m_position, sizeof(data));
+        m_position += sizeof(data);
+
+        return data;
+    }
+
+    // Return the string following a token
+    std::string readString()
+    {
+        size_t size = read<size_t>();
+        std::string data(m_content.substr(m_position, size));
+        m_position += size;
+
+        return data;
+    }
+
+private:
+    std::string_view m_content;
+    size_t m_position = 0;
+};
+
+// Deliver the tokens recorded by UserConfigHandler to the handler
+//
+// Raise an exception if the handler stops
+static void replayTokens(std::string_view content, SaxHandler& handler)
+{
+    TokenReader reader(content);
+
+    while (!reader.atEnd()) {
+        bool result = true;
+
+        switch (reader.readToken()) {
+            case Token::Null:
+                result = handler.null();
+                break;
+            case Token::False:
+                result = handler.boolean(false);
+                break;
+            case Token::True:
+                result = handler.boolean(true);
+                break;
+            case Token::Integer:
+                result = handler.number_integer(
+                    reader.read<SaxHandler::number_integer_t>()
+                );
+                break;
+            case Token::Unsigned:
+                result = handler.number_unsigned(
+                    reader.read<SaxHandler::number_unsigned_t>()
+                );
+                break;
+            case Token::Float:
+                result = handler.number_float(
+                    reader.read<SaxHandler::number_float_t>(),
+                    ""
+                );
+                break;
+            case Token::String: {
+                std::string data = reader.readString();
+                result = handler.string(data);
+                break;
+            }
+            case Token::Binary: {
+                SaxHandler::binary_t data;
+                result = handler.binary(data);
+                break;
+            }
+            case Token::Key: {
+                std::string key = reader.readString();
+                result = handler.key(key);
+                break;
+            }
+            case Token::StartObject:
+                result = handler.start_object(0);
+                break;
+            case Token::EndObject:
+                result = handler.end_object();
+                break;
+            case Token::StartArray:
+                result = handler.start_array(0);
+                break;
+            case Token::EndArray:
+                result = handler.end_array();
+                break;
+        }
+
+        if (!result)
+            throw std::runtime_error(handler.getError());
+    }
+}
+
+// Return the nlohmann input format of the given user format
+static nlohmann::json::input_format_t getInputFormat(UserFormat format)
+{
+    switch (format) {
+        case UserFormat::Cbor:
+            return nlohmann::json::input_format_t::cbor;
+        case UserFormat::MessagePack:
+            return nlohmann::json::input_format_t::msgpack;
+        default:
+            return nlohmann::json::input_format_t::json;
+    }
+}
+
+// Parse the buffer in the given format with the given handler
+//
+// Raise an exception if the parse fail
+template <typename Handler>
+static void parseBuffer(
+    std::string_view buffer,
+    Handler& handler,
+    UserFormat format = UserFormat::Json
+) {
+    if (!nlohmann::json::sax_parse(
+        buffer.data(),
+        buffer.data() + buffer.size(),
+        &handler,
+        getInputFormat(format)
+    )) {
+        throw std::runtime_error(handler.getError());
+    }
+}
+
+// Parse the base template json held by the buffer with a streaming
+// parser, the settings are validated while they are read without
+// building a json document. The path is only used in the warnings.
+// The settings are sorted by path, a setting defined twice keeps its
+// last definition
+//
+// Raise an exception if the buffer isn't a valid json object
+std::vector<TemplateSetting> loadBaseTemplate(
+    std::string_view buffer,
+    const std::filesystem::path& path
+) {
+    TemplateHandler handler(path);
+    parseBuffer(buffer, handler);
+
+    std::vector<TemplateSetting>& settings = handler.getSettings();
+
+    // The ids are assigned in the path order, like when iterating
+    // over a json object
+    std::stable_sort(settings.begin(), settings.end(), [](
+        const TemplateSetting& lhs,
+        const TemplateSetting& rhs
+    ) {
+        return lhs.m_path < rhs.m_path;
+    });
+
+    // Keep the last of the settings with the same path
+    std::vector<TemplateSetting> unique;
+    unique.reserve(settings.size());
+
+    for (size_t i = 0; i < settings.size(); i++) {
+        bool replaced = i + 1 < settings.size() &&
+            !(settings[i].m_path < settings[i + 1].m_path);
+
+        if (!replaced)
+            unique.push_back(std::move(settings[i]));
+    }
+
+    return unique;
+}
+
+// Parse the user configuration held by the buffer in the given format
+// with a streaming parser. A category defined twice keeps its last
+// definition
+//
+// Raise an exception if the buffer isn't a valid object
+std::vector<UserCategory> loadUserConfig(
+    std::string_view buffer,
+    UserFormat format
+) {
+    std::vector<UserCategory> categories = loadUserContent(buffer, format);
+
+    for (auto& category : categories) {
+        loadUserSettings(category);
+    }
+
+    return categories;
+}
+
+// Parse the user configuration held by the buffer in the given format
+// like loadUserConfig, without converting the settings. Only the
+// content of the categories is read
+//
+// Raise an exception if the buffer isn't a valid object
+std::vector<UserCategory> loadUserContent(
+    std::string_view buffer,
+    UserFormat format
+) {
+    UserConfigHandler handler;
+    parseBuffer(buffer, handler, format);
+
+    return std::move(handler.getCategories());
+}
+
+// Convert the content of a category read by loadUserContent to its
+// settings
+void loadUserSettings(UserCategory& category)
+{
+    if (!category.m_is_object)
+        return;
+
+    UserHandler handler;
+    handler.start_object(0);
+    replayTokens(category.m_content, handler);
+    handler.end_object();
+
+    category.m_settings = std::move(handler.getCategory().m_settings);
+}
+
+// Parse the object held by the buffer in the given format as the
+// settings of a single category, the name of the returned category
+// is empty
+//
+// Raise an exception if the buffer isn't a valid document
+UserCategory loadUserCategory(
+    std::string_view buffer,
+    UserFormat format
+) {
+    UserHandler handler;
+    parseBuffer(buffer, handler, format);
+
+    return std::move(handler.getCategory());
+}
+
+} // namespace coil
@@ -0,0 +1,85 @@
+#ifndef COIL_JSON_LOADER_H
+#define COIL_JSON_LOADER_H
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "coil/userFormat.h"
+
+#include "configParser.h"
+#include "templateCache.h"
+
+namespace coil {
+
+// Setting value read from the user configuration
+struct UserSetting {
+    std::string m_name;
+    // Converted like ConfigParser::toConfigValue, monostate if the
+    // json value isn't a valid setting value
+    ConfigParser::ConfigValue m_value;
+};
+
+// Category read from the user configuration
+struct UserCategory {
+    std::string m_name;
+    // False if the json value of the category isn't an object,
+    // the category has no setting then
+    bool m_is_object = true;
+    // Tokens of the category object, two categories with the same
+    // content have the same settings
+    std::string m_content;
+    // Settings in the order of the file
+    std::vector<UserSetting> m_settings;
+};
+
+// Parse the base template json held by the buffer with a streaming
+// parser, the settings are validated while they are read without
+// building a json document. The path is only used in the warnings.
+// The settings are sorted by path, a setting defined twice keeps its
+// last definition
+//
+// Raise an exception if the buffer isn't a valid json object
+std::vector<TemplateSetting> loadBaseTemplate(
+    std::string_view buffer,
+    const std::filesystem::path& path
+);
+
+// Parse the user configuration held by the buffer in the given format
+// with a streaming parser. A category defined twice keeps its last
+// definition
+//
+// Raise an exception if the buffer isn't a valid object
+std::vector<UserCategory> loadUserConfig(
+    std::string_view buffer,
+    UserFormat format = UserFormat::Json
+);
+
+// Parse the user configuration held by the buffer in the given format
+// like loadUserConfig, without converting the settings. Only the
+// content of the categories is read
+//
+// Raise an exception if the buffer isn't a valid object
+std::vector<UserCategory> loadUserContent(
+    std::string_view buffer,
+    UserFormat format = UserFormat::Json
+);
+
+// Convert the content of a category read by loadUserContent to its
+// settings
+void loadUserSettings(UserCategory& category);
+
+// Parse the object held by the buffer in the given format as the
+// settings of a single category, the name of the returned category
+// is empty
+//
+// Raise an exception if the buffer isn't a valid document
+UserCategory loadUserCategory(
+    std::string_view buffer,
+    UserFormat format = UserFormat::Json
+);
+
+} // namespace coil
+
+#endif
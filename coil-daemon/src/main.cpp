@@ -1,3 +1,4 @@
+#include <chrono>
 #include <cstdlib>
 
 #include "dbusServer.h"
@@ -5,20 +6,76 @@
 
 // Define the configuration path environmental variables
 constexpr const char *c_base_config_env = "COIL_BASE_CONFIG";
+// Directory of base template fragments merged with the base template
+constexpr const char* c_base_fragments_env = "COIL_BASE_FRAGMENTS";
 constexpr const char* c_user_config_env = "COIL_USER_CONFIG";
 // If the variable is set enable debug logging
 constexpr const char* c_debug_env = "COIL_DEBUG";
+// Delay in milliseconds before writing the changes to the user
+// configuration file, coalescing the changes done in the meantime
+constexpr const char* c_write_delay_env = "COIL_WRITE_DELAY";
+// Path to the binary cache of the base template, empty to disable it
+constexpr const char* c_template_cache_env = "COIL_TEMPLATE_CACHE";
+// If the variable is set each category is stored in its own file, named
+// after the category, in the directory of the user configuration file
+constexpr const char* c_split_user_config_env = "COIL_SPLIT_USER_CONFIG";
+// If the variable is set the delayed changes are appended to a journal,
+// they survive a crash during the write delay. A property set is only
+// journaled once it's replied, the other sets before their reply
+constexpr const char* c_journal_env = "COIL_JOURNAL";
+// Values of the Vendor and Site layers, between the defaults of the
+// base template and the user values
+constexpr const char* c_vendor_config_env = "COIL_VENDOR_CONFIG";
+constexpr const char* c_site_config_env = "COIL_SITE_CONFIG";
+// Storage format of the user configuration: json, cbor or msgpack
+constexpr const char* c_user_format_env = "COIL_USER_FORMAT";
+// If the variable is set the daemon runs on the system bus and serves
+// the configuration of every user
+constexpr const char* c_system_bus_env = "COIL_SYSTEM_BUS";
+// Directory holding the configuration of every user on the system bus
+constexpr const char* c_users_dir_env = "COIL_USERS_DIR";
+// Time in seconds after which the configuration of a user that made
+// no request is unloaded, zero keeps it loaded
+constexpr const char* c_user_idle_env = "COIL_USER_IDLE";
+// Number of threads answering the read requests, zero or unset starts
+// one per hardware thread
+constexpr const char* c_dispatch_threads_env = "COIL_DISPATCH_THREADS";
 
 // Define the configuration path default parameter
 constexpr const char* c_base_config_default = "/etc/coil/default.json";
-// This default path is relative to the user home folder 
-constexpr const char* c_user_config_default = ".config/coil/config.json";
+constexpr const char* c_base_fragments_default = "/etc/coil/default.d";
+constexpr const char* c_vendor_config_default = "/usr/share/coil/vendor.json";
+constexpr const char* c_site_config_default = "/etc/coil/site.json";
+// This default path is relative to the user home folder, the extension
+// of the storage format is appended to it
+constexpr const char* c_user_config_default = ".config/coil/config";
+// The session daemon caches the template in the user cache folder, the
+// system bus daemon in the system one
+constexpr const char* c_template_cache_default = ".cache/coil/default.bin";
+constexpr const char* c_template_cache_system_default =
+    "/var/cache/coil/default.bin";
+constexpr const char* c_users_dir_default = "/var/lib/coil/users";
+constexpr std::chrono::seconds c_user_idle_default(300);
 
 int main() {
     // Set the logging level
     if (std::getenv(c_debug_env))
         spdlog::set_level(spdlog::level::debug);
 
+    // The user configuration is stored in json by default
+    coil::UserFormat user_format = coil::UserFormat::Json;
+
+    if (const char* user_format_env = std::getenv(c_user_format_env)) {
+        if (auto format = coil::parseUserFormat(user_format_env)) {
+            user_format = *format;
+        } else {
+            spdlog::warn(
+                "Invalid COIL_USER_FORMAT value: \"{}\", ignoring it",
+                user_format_env
+            );
+        }
+    }
+
     // Get the configuration paths from the environment
     const char* base_path_env = std::getenv(c_base_config_env);
     const char* user_path_env = std::getenv(c_user_config_env);
@@ -55,6 +112,7 @@ int main() {
         // Append the configuration path to the home folder
         user_path += "/";
         user_path += c_user_config_default;
+        user_path += coil::getUserFormatExtension(user_format);
 
         spdlog::info(
             "COIL_USER_CONFIG is not set, defaulting to: \"{}\"",
@@ -62,8 +120,113 @@ int main() {
         );
     }
 
+    // By default the user configuration file is written on every change
+    std::chrono::milliseconds write_delay(0);
+
+    if (const char* write_delay_env = std::getenv(c_write_delay_env)) {
+        try {
+            write_delay = std::chrono::milliseconds(
+                std::stoul(write_delay_env)
+            );
+        } catch (std::exception& e) {
+            spdlog::warn(
+                "Invalid COIL_WRITE_DELAY value: \"{}\", ignoring it",
+                write_delay_env
+            );
+        }
+    }
+
+    std::string fragments_path = c_base_fragments_default;
+
+    if (const char* fragments_path_env = std::getenv(c_base_fragments_env)) {
+        fragments_path = fragments_path_env;
+    }
+
+    std::string vendor_path = c_vendor_config_default;
+
+    if (const char* vendor_path_env = std::getenv(c_vendor_config_env)) {
+        vendor_path = vendor_path_env;
+    }
+
+    std::string site_path = c_site_config_default;
+
+    if (const char* site_path_env = std::getenv(c_site_config_env)) {
+        site_path = site_path_env;
+    }
+
+    std::string cache_path;
+    const char* cache_home = std::getenv("XDG_CACHE_HOME");
+
+    if (const char* cache_path_env = std::getenv(c_template_cache_env)) {
+        cache_path = cache_path_env;
+    } else if (std::getenv(c_system_bus_env)) {
+        cache_path = c_template_cache_system_default;
+    } else if (cache_home && *cache_home) {
+        cache_path = cache_home;
+        cache_path += "/coil/default.bin";
+    } else if (const char* home = std::getenv("HOME")) {
+        cache_path = home;
+        cache_path += "/";
+        cache_path += c_template_cache_default;
+    }
+
+    size_t dispatch_threads = 0;
+
+    if (const char* threads_env = std::getenv(c_dispatch_threads_env)) {
+        try {
+            dispatch_threads = std::stoul(threads_env);
+        } catch (std::exception& e) {
+            spdlog::warn(
+                "Invalid COIL_DISPATCH_THREADS value: \"{}\", ignoring it",
+                threads_env
+            );
+        }
+    }
+
+    bool split_user_config = std::getenv(c_split_user_config_env) != nullptr;
+    bool journal = std::getenv(c_journal_env) != nullptr;
+
+    // On the system bus the configuration of each user is stored in
+    // its own directory, the user configuration path only gives the
+    // name of the file
+    std::string users_path;
+    std::chrono::seconds user_idle = c_user_idle_default;
+
+    if (std::getenv(c_system_bus_env)) {
+        users_path = c_users_dir_default;
+
+        if (const char* users_path_env = std::getenv(c_users_dir_env)) {
+            users_path = users_path_env;
+        }
+
+        if (const char* user_idle_env = std::getenv(c_user_idle_env)) {
+            try {
+                user_idle = std::chrono::seconds(std::stoul(user_idle_env));
+            } catch (std::exception& e) {
+                spdlog::warn(
+                    "Invalid COIL_USER_IDLE value: \"{}\", ignoring it",
+                    user_idle_env
+                );
+            }
+        }
+    }
+
     try {
-        coil::DbusServer server(base_path, user_path);
+        coil::DbusServer server(
+            base_path, 
+            user_path, 
+            write_delay, 
+            cache_path,
+            fragments_path,
+            vendor_path,
+            site_path,
+            split_user_config,
+            user_format,
+            journal,
+            users_path,
+            user_idle,
+            dispatch_threads
+        );
 
         try {
             spdlog::info("Starting D-Bus server");
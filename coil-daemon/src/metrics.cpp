@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <bit>
+
+#include "spdlog/fmt/fmt.h"
+
+#include "metrics.h"
+
+namespace coil {
+
+// Add a duration to the distribution
+void Histogram::record(std::chrono::nanoseconds duration)
+{
+    uint64_t value = duration.count() > 0 ? duration.count() : 0;
+
+    // Index of the smallest power of two greater or equal to the value
+    size_t index = 0;
+
+    if (value > 1) {
+        size_t log2 = std::bit_width(value - 1);
+
+        if (log2 > c_first_bucket_log2)
+            index = std::min(log2 - c_first_bucket_log2, c_bucket_count - 1);
+    }
+
+    m_buckets[index].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Return the number of durations recorded in each bucket
+std::array<uint64_t, Histogram::c_bucket_count> Histogram::getBuckets() const
+{
+    std::array<uint64_t, c_bucket_count> buckets;
+
+    for (size_t i = 0; i < c_bucket_count; i++) {
+        buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    }
+
+    return buckets;
+}
+
+// Return the upper bound in ns of the given bucket,
+// zero for the last unbounded one
+uint64_t Histogram::getBucketBound(size_t index)
+{
+    if (index + 1 >= c_bucket_count)
+        return 0;
+
+    return uint64_t(1) << (index + c_first_bucket_log2);
+}
+
+// Return the upper bound in ns of the bucket holding the given
+// quantile. It's an estimation bounded by the bucket resolution
+uint64_t Histogram::getQuantile(double quantile) const
+{
+    std::array<uint64_t, c_bucket_count> buckets = getBuckets();
+    uint64_t count = 0;
+
+    for (auto bucket : buckets) {
+        count += bucket;
+    }
+
+    if (count == 0)
+        return 0;
+
+    // Rank of the quantile, at least the first duration
+    uint64_t rank = std::max<uint64_t>(1, quantile * count + 0.5);
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i + 1 < c_bucket_count; i++) {
+        seen += buckets[i];
+
+        if (seen >= rank)
+            return getBucketBound(i);
+    }
+
+    // In the unbounded bucket, report the bound of the previous one
+    return getBucketBound(c_bucket_count - 2);
+}
+
+// Return the statistics of the given category, created on first use.
+// The reference stays valid while the metrics exist
+CategoryMetrics& Metrics::getCategory(std::string_view category)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto metrics = m_categories.find(category);
+
+    if (metrics == m_categories.end()) {
+        metrics = m_categories.emplace(
+            std::string(category),
+            std::make_unique<CategoryMetrics>()
+        ).first;
+    }
+
+    return *metrics->second;
+}
+
+// Return the fields of a histogram in the statistics map
+static std::map<std::string, uint64_t> histogramStats(
+    const Histogram& histogram
+) {
+    return {
+        {"count", histogram.getCount()},
+        {"sum_ns", histogram.getSum()},
+        {"p50_ns", histogram.getQuantile(0.50)},
+        {"p90_ns", histogram.getQuantile(0.90)},
+        {"p99_ns", histogram.getQuantile(0.99)}
+    };
+}
+
+// Return the statistics as a map of metric name to their fields,
+// the category metrics are named "get:<category>" and
+// "set:<category>". Durations are in ns
+std::map<std::string, std::map<std::string, uint64_t>> Metrics::getStats()
+{
+    std::map<std::string, std::map<std::string, uint64_t>> stats;
+
+    stats["mutex_wait"] = histogramStats(m_mutex_wait);
+    stats["reload"] = histogramStats(m_reload);
+    stats["file_write"] = histogramStats(m_file_write);
+    stats["file_write"]["bytes"] = m_file_write_bytes.load();
+    stats["signals"] = {{"count", m_signals.load()}};
+    stats["wakeups"] = {{"count", m_wakeups.load()}};
+
+    forEachCategoryHistogram([&](
+        std::string_view name,
+        std::string_view category,
+        const Histogram& histogram
+    ) {
+        stats[fmt::format("{}:{}", name, category)] =
+            histogramStats(histogram);
+    });
+
+    return stats;
+}
+
+// Append a histogram in the Prometheus text format, the header
+// is written by the caller
+static void appendHistogram(
+    std::string& text,
+    std::string_view name,
+    std::string_view labels,
+    const Histogram& histogram
+) {
+    std::array<uint64_t, Histogram::c_bucket_count> buckets =
+        histogram.getBuckets();
+
+    // The label list is extended with the bucket bound
+    std::string prefix(labels);
+
+    if (!prefix.empty())
+        prefix += ",";
+
+    uint64_t cumulative = 0;
+
+    for (size_t i = 0; i < buckets.size(); i++) {
+        cumulative += buckets[i];
+        uint64_t bound = Histogram::getBucketBound(i);
+
+        if (bound == 0) {
+            text += fmt::format(
+                "{}_bucket{{{}le=\"+Inf\"}} {}\n",
+                name, prefix, cumulative
+            );
+        } else {
+            text += fmt::format(
+                "{}_bucket{{{}le=\"{}\"}} {}\n",
+                name, prefix, bound * 1e-9, cumulative
+            );
+        }
+    }
+
+    std::string suffix = labels.empty() ? "" : fmt::format("{{{}}}", labels);
+
+    text += fmt::format(
+        "{}_sum{} {}\n", name, suffix, histogram.getSum() * 1e-9
+    );
+    text += fmt::format(
+        "{}_count{} {}\n", name, suffix, histogram.getCount()
+    );
+}
+
+// Return the given label value escaped for the Prometheus text format
+static std::string escapeLabel(std::string_view value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+// Append the header of a metric in the Prometheus text format
+static void appendHeader(
+    std::string& text,
+    std::string_view name,
+    std::string_view type,
+    std::string_view help
+) {
+    text += fmt::format("# HELP {} {}\n", name, help);
+    text += fmt::format("# TYPE {} {}\n", name, type);
+}
+
+// Return the statistics in the Prometheus text exposition format,
+// durations are in seconds
+std::string Metrics::getPrometheusText()
+{
+    std::string text;
+
+    appendHeader(text, "coil_mutex_wait_seconds", "histogram",
+        "Time spent waiting for the lock of a category");
+    appendHistogram(text, "coil_mutex_wait_seconds", "", m_mutex_wait);
+
+    appendHeader(text, "coil_reload_seconds", "histogram",
+        "Duration of the reloads of the user configuration file");
+    appendHistogram(text, "coil_reload_seconds", "", m_reload);
+
+    appendHeader(text, "coil_file_write_seconds", "histogram",
+        "Duration of the writes of the user configuration file");
+    appendHistogram(text, "coil_file_write_seconds", "", m_file_write);
+
+    appendHeader(text, "coil_file_write_bytes_total", "counter",
+        "Bytes written to the user configuration file");
+    text += fmt::format(
+        "coil_file_write_bytes_total {}\n", m_file_write_bytes.load()
+    );
+
+    appendHeader(text, "coil_signals_total", "counter",
+        "Change signals emitted");
+    text += fmt::format("coil_signals_total {}\n", m_signals.load());
+
+    appendHeader(text, "coil_wakeups_total", "counter",
+        "Wake ups of the main loop");
+    text += fmt::format("coil_wakeups_total {}\n", m_wakeups.load());
+
+    // All the samples of a metric must follow its header
+    for (std::string_view name : {"get", "set"}) {
+        std::string metric = fmt::format("coil_{}_seconds", name);
+
+        appendHeader(text, metric, "histogram", fmt::format(
+            "Duration of the D-Bus {}s of the settings of a category", name
+        ));
+
+        forEachCategoryHistogram([&](
+            std::string_view histogram_name,
+            std::string_view category,
+            const Histogram& histogram
+        ) {
+            if (histogram_name != name)
+                return;
+
+            appendHistogram(
+                text,
+                metric,
+                fmt::format("category=\"{}\"", escapeLabel(category)),
+                histogram
+            );
+        });
+    }
+
+    return text;
+}
+
+// Call the function with the name, the category and the histogram
+// of every category histogram
+void Metrics::forEachCategoryHistogram(
+    const std::function<void(
+        std::string_view, std::string_view, const Histogram&
+    )>& function
+) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    for (const auto& [category, metrics] : m_categories) {
+        function("get", category, metrics->m_get);
+        function("set", category, metrics->m_set);
+    }
+}
+
+} // namespace coil
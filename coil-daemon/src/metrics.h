@@ -0,0 +1,136 @@
+#ifndef COIL_METRICS_H
+#define COIL_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace coil {
+
+// Distribution of durations in power of two buckets. Recording only
+// updates relaxed atomics, it can be done from any thread without lock
+class Histogram {
+public:
+    // Number of buckets, the upper bound of the bucket i is
+    // 2^(i + c_first_bucket_log2) ns and the last one is unbounded
+    static constexpr size_t c_bucket_count = 28;
+    // Log2 of the upper bound of the first bucket, 256 ns
+    static constexpr size_t c_first_bucket_log2 = 8;
+
+    // Add a duration to the distribution
+    void record(std::chrono::nanoseconds duration);
+
+    // Return the number of recorded durations
+    uint64_t getCount() const
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+    // Return the sum of the recorded durations in ns
+    uint64_t getSum() const { return m_sum.load(std::memory_order_relaxed); }
+
+    // Return the number of durations recorded in each bucket
+    std::array<uint64_t, c_bucket_count> getBuckets() const;
+
+    // Return the upper bound in ns of the given bucket,
+    // zero for the last unbounded one
+    static uint64_t getBucketBound(size_t index);
+
+    // Return the upper bound in ns of the bucket holding the given
+    // quantile. It's an estimation bounded by the bucket resolution
+    uint64_t getQuantile(double quantile) const;
+
+private:
+    std::atomic<uint64_t> m_count = 0;
+    std::atomic<uint64_t> m_sum = 0;
+    std::array<std::atomic<uint64_t>, c_bucket_count> m_buckets = {};
+};
+
+// Measure the duration of a scope and record it in a histogram
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram) :
+        m_histogram(histogram),
+        m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ScopedTimer()
+    {
+        m_histogram.record(std::chrono::steady_clock::now() - m_start);
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& m_histogram;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Access statistics of the settings of a category
+struct CategoryMetrics {
+    // Duration of the reads of the D-Bus clients
+    Histogram m_get;
+    // Duration of the writes of the D-Bus clients, including
+    // the file write when the writes aren't delayed
+    Histogram m_set;
+};
+
+// Runtime statistics of the daemon, updated on the hot paths
+// with relaxed atomics and exported on demand
+class Metrics {
+public:
+    // Return the statistics of the given category, created on first use.
+    // The reference stays valid while the metrics exist
+    CategoryMetrics& getCategory(std::string_view category);
+
+    // Return the statistics as a map of metric name to their fields,
+    // the category metrics are named "get:<category>" and
+    // "set:<category>". Durations are in ns
+    std::map<std::string, std::map<std::string, uint64_t>> getStats();
+
+    // Return the statistics in the Prometheus text exposition format,
+    // durations are in seconds
+    std::string getPrometheusText();
+
+    // Time spent waiting for the lock of a category
+    Histogram m_mutex_wait;
+    // Duration of the reloads of the user configuration file
+    Histogram m_reload;
+    // Duration of the writes of the user configuration file
+    Histogram m_file_write;
+
+    // Number of bytes written to the user configuration file
+    std::atomic<uint64_t> m_file_write_bytes = 0;
+    // Number of change signals emitted
+    std::atomic<uint64_t> m_signals = 0;
+    // Number of wake ups of the main loop
+    std::atomic<uint64_t> m_wakeups = 0;
+
+private:
+    // Call the function with the name, the category and the histogram
+    // of every category histogram
+    void forEachCategoryHistogram(
+        const std::function<void(
+            std::string_view, std::string_view, const Histogram&
+        )>& function
+    );
+
+    // Statistics of every category, the map only grows
+    std::map<std::string, std::unique_ptr<CategoryMetrics>, std::less<>>
+        m_categories;
+    // Protect m_categories
+    std::mutex m_mutex;
+};
+
+} // namespace coil
+
+#endif
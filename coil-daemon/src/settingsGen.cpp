@@ -0,0 +1,258 @@
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "coil/settingHandle.h"
+
+#include "configParser.h"
+#include "fileUtils.h"
+
+// Generate a header of typed setting handles from a base template.
+// The template is parsed like the daemon does, so the handles hold the
+// ids the daemon assigns to the settings
+
+using coil::ConfigParser;
+
+// Words that can't be used as identifiers
+static const std::set<std::string> c_reserved_words = {
+    "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand",
+    "bitor", "bool", "break", "case", "catch", "char", "char8_t",
+    "char16_t", "char32_t", "class", "compl", "concept", "const",
+    "consteval", "constexpr", "constinit", "const_cast", "continue",
+    "co_await", "co_return", "co_yield", "decltype", "default", "delete",
+    "do", "double", "dynamic_cast", "else", "enum", "explicit", "export",
+    "extern", "false", "float", "for", "friend", "goto", "if", "inline",
+    "int", "long", "mutable", "namespace", "new", "noexcept", "not",
+    "not_eq", "nullptr", "operator", "or", "or_eq", "private",
+    "protected", "public", "register", "reinterpret_cast", "requires",
+    "return", "short", "signed", "sizeof", "static", "static_assert",
+    "static_cast", "struct", "switch", "template", "this", "thread_local",
+    "throw", "true", "try", "typedef", "typeid", "typename", "union",
+    "unsigned", "using", "virtual", "void", "volatile", "wchar_t",
+    "while", "xor", "xor_eq",
+
+    // Names of the generated header
+    "c_count", "c_fingerprint"
+};
+
+// Print the command usage
+static void printUsage(const char* name)
+{
+    std::cerr
+        << "Usage: " << name << " <template> <header>\n"
+        << "Write to header the typed handles of the settings of the\n"
+        << "base template\n";
+}
+
+// Return a valid identifier for the given name, the characters that
+// can't be used are replaced by an underscore
+static std::string toIdentifier(std::string_view name)
+{
+    std::string identifier;
+
+    for (char character : name) {
+        bool valid =
+            (character >= 'a' && character <= 'z') ||
+            (character >= 'A' && character <= 'Z') ||
+            (character >= '0' && character <= '9') ||
+            character == '_';
+
+        identifier += valid ? character : '_';
+    }
+
+    if (identifier.empty() ||
+        (identifier[0] >= '0' && identifier[0] <= '9')
+    ) {
+        identifier.insert(0, "_");
+    }
+
+    if (c_reserved_words.count(identifier) != 0)
+        identifier += "_";
+
+    return identifier;
+}
+
+// Return the c++ type of the handle of a setting of the given type,
+// the readers return the values with these types
+static std::string_view getHandleType(ConfigParser::ConfigType type)
+{
+    switch (type) {
+        case ConfigParser::ConfigType::Int:
+            return "int";
+        case ConfigParser::ConfigType::Bool:
+            return "bool";
+        case ConfigParser::ConfigType::Float:
+            return "double";
+        case ConfigParser::ConfigType::String:
+            return "std::string";
+        case ConfigParser::ConfigType::ArrayInt:
+            return "std::vector<int>";
+        case ConfigParser::ConfigType::ArrayFloat:
+            return "std::vector<double>";
+        case ConfigParser::ConfigType::ArrayString:
+            return "std::vector<std::string>";
+
+        default:
+            throw std::runtime_error("Unknown setting type");
+    }
+}
+
+// Return a c++ string literal holding the given string
+static std::string toLiteral(std::string_view value)
+{
+    std::ostringstream literal;
+    literal << "\"";
+
+    for (char character : value) {
+        unsigned char byte = static_cast<unsigned char>(character);
+
+        if (character == '"' || character == '\\') {
+            literal << '\\' << character;
+        } else if (byte < 0x20 || byte >= 0x7f) {
+            // Octal escapes stop after three digits
+            literal << '\\'
+                << static_cast<char>('0' + (byte >> 6))
+                << static_cast<char>('0' + ((byte >> 3) & 7))
+                << static_cast<char>('0' + (byte & 7));
+        } else {
+            literal << character;
+        }
+    }
+
+    literal << "\"";
+
+    return literal.str();
+}
+
+// Return the header holding the handles of the settings of the template
+//
+// Raise an exception if two settings have the same identifier
+static std::string generateHeader(
+    const ConfigParser::TemplateStore& store,
+    const std::filesystem::path& template_path
+) {
+    // The fingerprint covers the settings in id order
+    std::vector<ConfigParser::ConfigMetadata> settings;
+
+    for (const auto& category : store.getCategories()) {
+        for (const auto& metadata : store.getMetadatas(category)) {
+            if (settings.size() <= metadata.getId())
+                settings.resize(metadata.getId() + 1);
+
+            settings[metadata.getId()] = metadata;
+        }
+    }
+
+    uint64_t fingerprint = coil::c_fingerprint_basis;
+
+    for (const auto& metadata : settings) {
+        fingerprint = coil::fingerprintSetting(
+            fingerprint,
+            metadata.getPath().getCategory(),
+            metadata.getPath().getName(),
+            static_cast<coil::SharedType>(metadata.getType())
+        );
+    }
+
+    std::ostringstream header;
+
+    header
+        << "// Generated by coil-settings-gen from "
+        << template_path.filename().string() << ", do not edit\n"
+        << "#ifndef COIL_SETTINGS_H\n"
+        << "#define COIL_SETTINGS_H\n"
+        << "\n"
+        << "#include \"coil/settingHandle.h\"\n"
+        << "\n"
+        << "namespace coil::settings {\n"
+        << "\n"
+        << "// Number of settings and fingerprint of the template\n"
+        << "constexpr size_t c_count = " << settings.size() << ";\n"
+        << "constexpr uint64_t c_fingerprint = 0x"
+        << std::hex << fingerprint << std::dec << ";\n";
+
+    std::set<std::string> namespaces;
+
+    for (const auto& category : store.getCategories()) {
+        std::string category_identifier = toIdentifier(category);
+
+        if (!namespaces.insert(category_identifier).second) {
+            throw std::runtime_error(
+                "Several categories are named " + category_identifier
+            );
+        }
+
+        header
+            << "\n"
+            << "namespace " << category_identifier << " {\n";
+
+        std::set<std::string> names;
+
+        for (const auto& metadata : store.getMetadatas(category)) {
+            ConfigParser::ConfigPathView path = metadata.getPath();
+            std::string name_identifier = toIdentifier(path.getName());
+
+            if (!names.insert(name_identifier).second) {
+                throw std::runtime_error(
+                    "Several settings are named " + category_identifier +
+                    "::" + name_identifier
+                );
+            }
+
+            header
+                << "constexpr SettingHandle<"
+                << getHandleType(metadata.getType()) << "> "
+                << name_identifier << "{\n"
+                << "    " << metadata.getId() << ", "
+                << toLiteral(path.getCategory()) << ", "
+                << toLiteral(path.getName()) << ", "
+                << "c_count, c_fingerprint\n"
+                << "};\n";
+        }
+
+        header << "} // namespace " << category_identifier << "\n";
+    }
+
+    header
+        << "\n"
+        << "} // namespace coil::settings\n"
+        << "\n"
+        << "#endif\n";
+
+    return header.str();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::filesystem::path template_path = argv[1];
+    std::filesystem::path header_path = argv[2];
+
+    // Only the errors of the template are relevant for the build
+    spdlog::set_level(spdlog::level::warn);
+
+    try {
+        ConfigParser::TemplateStore store(template_path);
+        std::string header = generateHeader(store, template_path);
+
+        if (header_path.has_parent_path())
+            std::filesystem::create_directories(header_path.parent_path());
+
+        coil::writeFileAtomic(header_path, header);
+
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,414 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+#include "sharedConfig.h"
+
+namespace coil {
+
+// Name of the memory file, only visible in /proc for debugging
+constexpr const char* c_shared_memfd_name = "coil-config";
+
+// Minimum slot size reserved for variable size values
+constexpr size_t c_shared_min_capacity = 32;
+
+// Raise an exception describing the failed operation and the errno value
+[[noreturn]] static void throwSharedError(std::string_view operation)
+{
+    throw std::runtime_error(
+        std::string(operation) + " failed for the shared config: " +
+        std::strerror(errno)
+    );
+}
+
+// Return the value rounded up to a multiple of 8 bytes
+static size_t align8(size_t value)
+{
+    return (value + 7) & ~size_t(7);
+}
+
+// Build the segment from the current configuration
+//
+// Raise an exception if the segment can't be created
+SharedConfig::SharedConfig(const ConfigParser& config_parser) :
+    m_config_parser(config_parser)
+{
+    m_segment = createSegment(*m_config_parser.getSnapshot());
+}
+
+SharedConfig::~SharedConfig()
+{
+    destroySegment(m_segment);
+}
+
+// Write the current value of the given settings in the segment.
+// If a value doesn't fit in its slot or settings were added a new
+// segment is built and the old one is marked as stale
+//
+// Return true if the segment was replaced
+bool SharedConfig::update(
+    const std::vector<ConfigParser::ConfigId>& config_ids
+) {
+    auto snapshot = m_config_parser.getSnapshot();
+    SharedHeader* header = reinterpret_cast<SharedHeader*>(m_segment.m_data);
+
+    // Settings added by a template fragment need new entries
+    bool fits = header->m_entry_count == snapshot->size();
+
+    for (auto config_id : config_ids) {
+        if (!fits)
+            break;
+
+        if (!writeEntry(
+            m_segment.m_data,
+            getEntry(config_id),
+            (*snapshot)[config_id]
+        )) {
+            fits = false;
+            break;
+        }
+    }
+
+    if (fits) {
+        header->m_generation.fetch_add(1, std::memory_order_release);
+        return false;
+    }
+
+    spdlog::debug("Rebuilding the shared config");
+
+    Segment segment = createSegment(*snapshot);
+
+    // The clients still mapping the old segment remap the new one
+    header->m_stale.store(1, std::memory_order_release);
+    header->m_generation.fetch_add(1, std::memory_order_release);
+
+    destroySegment(m_segment);
+    m_segment = segment;
+
+    return true;
+}
+
+// Create a segment holding the values of the given snapshot
+//
+// Raise an exception if the segment can't be created
+SharedConfig::Segment SharedConfig::createSegment(
+    const ConfigParser::ConfigSnapshot& snapshot
+) {
+    size_t entry_count = snapshot.size();
+
+    // Compute the position of each part of the segment
+    size_t entries_offset = align8(sizeof(SharedHeader));
+    size_t strings_offset = 
+        entries_offset + entry_count * sizeof(SharedEntry);
+
+    size_t strings_size = 0;
+    size_t data_size = 0;
+
+    for (ConfigParser::ConfigId id = 0; id < entry_count; id++) {
+        ConfigParser::ConfigPathView path =
+            m_config_parser.getMetadata(id).getPath();
+
+        strings_size += path.getCategory().size() + path.getName().size();
+        data_size += slotCapacity(snapshot[id]);
+    }
+
+    size_t data_offset = align8(strings_offset + strings_size);
+    size_t size = data_offset + data_size;
+
+    // The offsets are stored on 32 bits
+    if (size > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error("The shared config is too large");
+
+    // Create and map the memory file
+    Segment segment;
+
+    segment.m_fd = memfd_create(
+        c_shared_memfd_name,
+        MFD_CLOEXEC | MFD_ALLOW_SEALING
+    );
+
+    if (segment.m_fd < 0)
+        throwSharedError("memfd_create");
+
+    if (ftruncate(segment.m_fd, size) < 0) {
+        destroySegment(segment);
+        throwSharedError("ftruncate");
+    }
+
+    // The clients can't change the size of the segment under the daemon
+    if (fcntl(
+        segment.m_fd,
+        F_ADD_SEALS,
+        F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL
+    ) < 0) {
+        destroySegment(segment);
+        throwSharedError("fcntl");
+    }
+
+    void* data = mmap(
+        nullptr,
+        size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED,
+        segment.m_fd,
+        0
+    );
+
+    if (data == MAP_FAILED) {
+        destroySegment(segment);
+        throwSharedError("mmap");
+    }
+
+    segment.m_data = static_cast<char*>(data);
+    segment.m_size = size;
+
+    // Reopening the file read-only gives a descriptor that can't be
+    // mapped writable by the clients
+    std::string fd_path = "/proc/self/fd/" + std::to_string(segment.m_fd);
+    segment.m_read_fd = open(fd_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (segment.m_read_fd < 0) {
+        destroySegment(segment);
+        throwSharedError("open");
+    }
+
+    // Fill the segment, the memory file starts zeroed
+    SharedHeader* header = new (segment.m_data) SharedHeader();
+    header->m_magic = c_shared_magic;
+    header->m_version = c_shared_version;
+    header->m_size = size;
+    header->m_entry_count = entry_count;
+    header->m_entries_offset = entries_offset;
+
+    size_t string_position = strings_offset;
+    size_t data_position = data_offset;
+
+    for (ConfigParser::ConfigId id = 0; id < entry_count; id++) {
+        const ConfigParser::ConfigMetadata& metadata =
+            m_config_parser.getMetadata(id);
+        std::string_view category = metadata.getPath().getCategory();
+        std::string_view name = metadata.getPath().getName();
+
+        SharedEntry* entry = new (
+            segment.m_data + entries_offset + id * sizeof(SharedEntry)
+        ) SharedEntry();
+
+        entry->m_type = static_cast<SharedType>(metadata.getType());
+
+        entry->m_category_offset = string_position;
+        entry->m_category_size = category.size();
+        std::memcpy(
+            segment.m_data + string_position,
+            category.data(),
+            category.size()
+        );
+        string_position += category.size();
+
+        entry->m_name_offset = string_position;
+        entry->m_name_size = name.size();
+        std::memcpy(
+            segment.m_data + string_position,
+            name.data(),
+            name.size()
+        );
+        string_position += name.size();
+
+        entry->m_data_offset = data_position;
+        entry->m_data_capacity = slotCapacity(snapshot[id]);
+        data_position += entry->m_data_capacity;
+
+        writeEntry(segment.m_data, *entry, snapshot[id]);
+    }
+
+    spdlog::debug("Created shared config of {} bytes", size);
+
+    return segment;
+}
+
+// Unmap the segment and close its descriptors
+void SharedConfig::destroySegment(Segment& segment)
+{
+    if (segment.m_data != nullptr)
+        munmap(segment.m_data, segment.m_size);
+    if (segment.m_read_fd >= 0)
+        close(segment.m_read_fd);
+    if (segment.m_fd >= 0)
+        close(segment.m_fd);
+
+    segment = Segment();
+}
+
+// Return the entry of the given setting in the segment
+SharedEntry& SharedConfig::getEntry(ConfigParser::ConfigId config_id)
+{
+    const SharedHeader* header =
+        reinterpret_cast<const SharedHeader*>(m_segment.m_data);
+
+    return *reinterpret_cast<SharedEntry*>(
+        m_segment.m_data + header->m_entries_offset +
+        config_id * sizeof(SharedEntry)
+    );
+}
+
+// Write a value in the slot of the entry of the segment at the given
+// address, using the sequence counter
+// Return false if the value doesn't fit in the slot
+bool SharedConfig::writeEntry(
+    char* data,
+    SharedEntry& entry,
+    const ConfigParser::ConfigValue& value
+) {
+    size_t size = encodedSize(value);
+
+    if (size > entry.m_data_capacity)
+        return false;
+
+    // An odd sequence tells the readers that the payload is changing
+    uint32_t sequence = entry.m_sequence.load(std::memory_order_relaxed);
+    entry.m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    encodeValue(value, data + entry.m_data_offset);
+    entry.m_data_size.store(size, std::memory_order_relaxed);
+
+    entry.m_sequence.store(sequence + 2, std::memory_order_release);
+
+    return true;
+}
+
+// Return the size of the encoded value in bytes
+size_t SharedConfig::encodedSize(const ConfigParser::ConfigValue& value)
+{
+    switch (ConfigParser::getValueType(value)) {
+        case ConfigParser::ConfigType::Int:
+            return sizeof(int64_t);
+        case ConfigParser::ConfigType::Bool:
+            return sizeof(uint8_t);
+        case ConfigParser::ConfigType::Float:
+            return sizeof(double);
+        case ConfigParser::ConfigType::String:
+            return std::get<std::string>(value).size();
+        case ConfigParser::ConfigType::ArrayInt:
+            return std::get<std::vector<int64_t>>(value).size() *
+                sizeof(int64_t);
+        case ConfigParser::ConfigType::ArrayFloat:
+            return std::get<std::vector<double>>(value).size() *
+                sizeof(double);
+
+        case ConfigParser::ConfigType::ArrayString: {
+            size_t size = 0;
+
+            for (const auto& element :
+                std::get<std::vector<std::string>>(value)
+            ) {
+                size += sizeof(uint32_t) + element.size();
+            }
+
+            return size;
+        }
+
+        default:
+            return 0;
+    }
+}
+
+// Encode the value at the given destination, the destination must
+// hold at least encodedSize bytes
+void SharedConfig::encodeValue(
+    const ConfigParser::ConfigValue& value,
+    char* destination
+) {
+    switch (ConfigParser::getValueType(value)) {
+        case ConfigParser::ConfigType::Int: {
+            int64_t data = std::get<int64_t>(value);
+            std::memcpy(destination, &data, sizeof(data));
+            break;
+        }
+
+        case ConfigParser::ConfigType::Bool: {
+            uint8_t data = std::get<bool>(value) ? 1 : 0;
+            std::memcpy(destination, &data, sizeof(data));
+            break;
+        }
+
+        case ConfigParser::ConfigType::Float: {
+            double data = std::get<double>(value);
+            std::memcpy(destination, &data, sizeof(data));
+            break;
+        }
+
+        case ConfigParser::ConfigType::String: {
+            const auto& data = std::get<std::string>(value);
+            std::memcpy(destination, data.data(), data.size());
+            break;
+        }
+
+        case ConfigParser::ConfigType::ArrayInt: {
+            const auto& data = std::get<std::vector<int64_t>>(value);
+            std::memcpy(
+                destination,
+                data.data(),
+                data.size() * sizeof(int64_t)
+            );
+            break;
+        }
+
+        case ConfigParser::ConfigType::ArrayFloat: {
+            const auto& data = std::get<std::vector<double>>(value);
+            std::memcpy(
+                destination,
+                data.data(),
+                data.size() * sizeof(double)
+            );
+            break;
+        }
+
+        case ConfigParser::ConfigType::ArrayString: {
+            for (const auto& element :
+                std::get<std::vector<std::string>>(value)
+            ) {
+                uint32_t size = element.size();
+                std::memcpy(destination, &size, sizeof(size));
+                destination += sizeof(size);
+
+                std::memcpy(destination, element.data(), element.size());
+                destination += element.size();
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+// Return the size of the slot reserved for a value, variable size
+// values get extra room to grow without rebuilding the segment
+size_t SharedConfig::slotCapacity(const ConfigParser::ConfigValue& value)
+{
+    switch (ConfigParser::getValueType(value)) {
+        case ConfigParser::ConfigType::Int:
+        case ConfigParser::ConfigType::Bool:
+        case ConfigParser::ConfigType::Float:
+            return sizeof(int64_t);
+
+        default:
+            return align8(std::max(
+                encodedSize(value) * 2,
+                c_shared_min_capacity
+            ));
+    }
+}
+
+} // namespace coil
@@ -0,0 +1,91 @@
+#ifndef COIL_SHARED_CONFIG_H
+#define COIL_SHARED_CONFIG_H
+
+#include <cstddef>
+#include <vector>
+
+#include "coil/sharedLayout.h"
+
+#include "configParser.h"
+
+namespace coil {
+
+// Publish the merged configuration in a shared memory segment that
+// local clients map read-only, the layout is described in sharedLayout.h
+class SharedConfig {
+public:
+    // Build the segment from the current configuration
+    //
+    // Raise an exception if the segment can't be created
+    SharedConfig(const ConfigParser& config_parser);
+    ~SharedConfig();
+
+    SharedConfig(const SharedConfig&) = delete;
+    SharedConfig& operator=(const SharedConfig&) = delete;
+
+    // Return a read-only file descriptor of the current segment
+    int getFd() const { return m_segment.m_read_fd; }
+
+    // Write the current value of the given settings in the segment.
+    // If a value doesn't fit in its slot or settings were added a new
+    // segment is built and the old one is marked as stale
+    //
+    // Return true if the segment was replaced
+    bool update(const std::vector<ConfigParser::ConfigId>& config_ids);
+
+private:
+    // Memory segment and its mapping in the daemon
+    struct Segment {
+        // Read-write descriptor used by the daemon
+        int m_fd = -1;
+        // Read-only descriptor sent to the clients
+        int m_read_fd = -1;
+        // Mapping of the segment
+        char* m_data = nullptr;
+        size_t m_size = 0;
+    };
+
+    // Create a segment holding the values of the given snapshot
+    //
+    // Raise an exception if the segment can't be created
+    Segment createSegment(const ConfigParser::ConfigSnapshot& snapshot);
+
+    // Unmap the segment and close its descriptors
+    static void destroySegment(Segment& segment);
+
+    // Return the entry of the given setting in the segment
+    SharedEntry& getEntry(ConfigParser::ConfigId config_id);
+
+    // Write a value in the slot of the entry of the segment at the given
+    // address, using the sequence counter
+    // Return false if the value doesn't fit in the slot
+    static bool writeEntry(
+        char* data,
+        SharedEntry& entry,
+        const ConfigParser::ConfigValue& value
+    );
+
+    // Return the size of the encoded value in bytes
+    static size_t encodedSize(const ConfigParser::ConfigValue& value);
+
+    // Encode the value at the given destination, the destination must
+    // hold at least encodedSize bytes
+    static void encodeValue(
+        const ConfigParser::ConfigValue& value,
+        char* destination
+    );
+
+    // Return the size of the slot reserved for a value, variable size
+    // values get extra room to grow without rebuilding the segment
+    static size_t slotCapacity(const ConfigParser::ConfigValue& value);
+
+    // Configuration published in the segment
+    const ConfigParser& m_config_parser;
+
+    // Current segment
+    Segment m_segment;
+};
+
+} // namespace coil
+
+#endif
@@ -0,0 +1,64 @@
+#include <cstring>
+
+#include "stringPool.h"
+
+namespace coil {
+
+StringPool::StringPool() :
+    m_block_used(c_block_size),
+    m_allocated(0)
+{
+}
+
+// Return a view of the pooled copy of the given string
+std::string_view StringPool::intern(std::string_view value)
+{
+    // An empty view doesn't need any storage
+    if (value.empty())
+        return std::string_view();
+
+    auto existing = m_strings.find(value);
+
+    if (existing != m_strings.end())
+        return *existing;
+
+    char* data = allocate(value.size());
+    std::memcpy(data, value.data(), value.size());
+
+    std::string_view copy(data, value.size());
+    m_strings.insert(copy);
+
+    return copy;
+}
+
+// Return space for the given number of characters
+char* StringPool::allocate(size_t size)
+{
+    // A large string would waste the end of the current block, it gets
+    // a block of its own inserted before it
+    if (size > c_block_size / 4) {
+        auto block = std::make_unique<char[]>(size);
+        char* data = block.get();
+
+        m_blocks.insert(
+            m_blocks.empty() ? m_blocks.end() : m_blocks.end() - 1,
+            std::move(block)
+        );
+        m_allocated += size;
+
+        return data;
+    }
+
+    if (c_block_size - m_block_used < size) {
+        m_blocks.push_back(std::make_unique<char[]>(c_block_size));
+        m_block_used = 0;
+        m_allocated += c_block_size;
+    }
+
+    char* data = m_blocks.back().get() + m_block_used;
+    m_block_used += size;
+
+    return data;
+}
+
+} // namespace coil
@@ -0,0 +1,51 @@
+#ifndef COIL_STRING_POOL_H
+#define COIL_STRING_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace coil {
+
+// Append only arena of interned strings. The characters are copied in
+// large blocks that never move, so the returned views remain valid as
+// long as the pool. Equal strings share a single copy.
+// Not thread safe, a pool is only appended by the thread building the
+// tables referencing it
+class StringPool {
+public:
+    StringPool();
+
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    // Return a view of the pooled copy of the given string
+    std::string_view intern(std::string_view value);
+
+    // Return the number of bytes allocated for the characters
+    size_t getAllocatedSize() const { return m_allocated; }
+
+private:
+    // Size of the blocks, a larger string gets a block of its own
+    static constexpr size_t c_block_size = 16 * 1024;
+
+    // Return space for the given number of characters
+    char* allocate(size_t size);
+
+    // Blocks holding the characters, the last one is being filled
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    // Characters used in the last block
+    size_t m_block_used;
+
+    // Number of bytes of all the blocks
+    size_t m_allocated;
+
+    // Views of the strings of the pool, to find the existing copy
+    std::unordered_set<std::string_view> m_strings;
+};
+
+} // namespace coil
+
+#endif
@@ -0,0 +1,299 @@
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+#include "fileUtils.h"
+#include "templateCache.h"
+
+namespace coil {
+
+// Magic number at the start of the cache file, "COILTPL" and a version
+// of the format, changed on every incompatible change
+constexpr char c_cache_magic[8] = {'C', 'O', 'I', 'L', 'T', 'P', 'L', '1'};
+
+// Header at the start of the cache file, followed by the encoded settings
+struct CacheHeader {
+    char m_magic[8];
+    TemplateSource m_source;
+    uint64_t m_setting_count;
+    uint64_t m_payload_size;
+    // Checksum of the payload, used to detect a corrupted cache
+    uint64_t m_checksum;
+};
+
+// Append the binary representation of a trivial value
+template <typename Type>
+static void encode(std::string& buffer, const Type& value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Append a string prefixed by its size
+static void encodeString(std::string& buffer, std::string_view value)
+{
+    encode<uint32_t>(buffer, value.size());
+    buffer.append(value);
+}
+
+// Append a setting value prefixed by its type
+static void encodeValue(
+    std::string& buffer,
+    const ConfigParser::ConfigValue& value
+) {
+    ConfigParser::ConfigType type = ConfigParser::getValueType(value);
+    encode<uint8_t>(buffer, static_cast<uint8_t>(type));
+
+    switch (type) {
+        case ConfigParser::ConfigType::Int:
+            encode(buffer, std::get<int64_t>(value));
+            break;
+        case ConfigParser::ConfigType::Bool:
+            encode<uint8_t>(buffer, std::get<bool>(value) ? 1 : 0);
+            break;
+        case ConfigParser::ConfigType::Float:
+            encode(buffer, std::get<double>(value));
+            break;
+        case ConfigParser::ConfigType::String:
+            encodeString(buffer, std::get<std::string>(value));
+            break;
+
+        case ConfigParser::ConfigType::ArrayInt: {
+            const auto& data = std::get<std::vector<int64_t>>(value);
+            encode<uint32_t>(buffer, data.size());
+
+            for (auto element : data)
+                encode(buffer, element);
+            break;
+        }
+
+        case ConfigParser::ConfigType::ArrayFloat: {
+            const auto& data = std::get<std::vector<double>>(value);
+            encode<uint32_t>(buffer, data.size());
+
+            for (auto element : data)
+                encode(buffer, element);
+            break;
+        }
+
+        case ConfigParser::ConfigType::ArrayString: {
+            const auto& data = std::get<std::vector<std::string>>(value);
+            encode<uint32_t>(buffer, data.size());
+
+            for (const auto& element : data)
+                encodeString(buffer, element);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+// Sequential reader over the mapped cache payload, every read is
+// bounds checked and sets the error flag instead of overrunning
+struct CacheReader {
+    std::string_view m_data;
+    size_t m_position = 0;
+    bool m_error = false;
+
+    // Return the next trivial value, a default value on error
+    template <typename Type>
+    Type read()
+    {
+        Type value{};
+
+        if (m_error || m_data.size() - m_position < sizeof(Type)) {
+            m_error = true;
+            return value;
+        }
+
+        std::memcpy(&value, m_data.data() + m_position, sizeof(Type));
+        m_position += sizeof(Type);
+
+        return value;
+    }
+
+    // Return the next size prefixed string
+    std::string_view readString()
+    {
+        uint32_t size = read<uint32_t>();
+
+        if (m_error || m_data.size() - m_position < size) {
+            m_error = true;
+            return {};
+        }
+
+        std::string_view value = m_data.substr(m_position, size);
+        m_position += size;
+
+        return value;
+    }
+
+    // Return the next type prefixed setting value
+    ConfigParser::ConfigValue readValue()
+    {
+        auto type = static_cast<ConfigParser::ConfigType>(read<uint8_t>());
+
+        switch (type) {
+            case ConfigParser::ConfigType::Int:
+                return read<int64_t>();
+            case ConfigParser::ConfigType::Bool:
+                return read<uint8_t>() != 0;
+            case ConfigParser::ConfigType::Float:
+                return read<double>();
+            case ConfigParser::ConfigType::String:
+                return std::string(readString());
+
+            case ConfigParser::ConfigType::ArrayInt:
+                return readArray<int64_t>([this] {
+                    return read<int64_t>();
+                });
+            case ConfigParser::ConfigType::ArrayFloat:
+                return readArray<double>([this] {
+                    return read<double>();
+                });
+            case ConfigParser::ConfigType::ArrayString:
+                return readArray<std::string>([this] {
+                    return std::string(readString());
+                });
+
+            default:
+                m_error = true;
+                return std::monostate();
+        }
+    }
+
+    // Return the next count prefixed array using the given element reader
+    template <typename Type, typename Reader>
+    std::vector<Type> readArray(Reader read_element)
+    {
+        uint32_t count = read<uint32_t>();
+        std::vector<Type> values;
+
+        for (uint32_t i = 0; i < count && !m_error; i++)
+            values.push_back(read_element());
+
+        return values;
+    }
+};
+
+// Load the validated base template from the binary cache at the given
+// path. The file is mapped and decoded without any json parsing
+//
+// Return nullopt if the cache is missing, corrupted or was built
+// from a different version of the template
+std::optional<std::vector<TemplateSetting>> readTemplateCache(
+    const std::filesystem::path& cache_path,
+    const TemplateSource& source
+) {
+    int fd = open(cache_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return std::nullopt;
+
+    struct stat file_stat;
+
+    if (fstat(fd, &file_stat) != 0 ||
+        static_cast<size_t>(file_stat.st_size) < sizeof(CacheHeader)
+    ) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    size_t size = file_stat.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+        return std::nullopt;
+
+    const char* data = static_cast<const char*>(mapping);
+    std::optional<std::vector<TemplateSetting>> settings;
+
+    CacheHeader header;
+    std::memcpy(&header, data, sizeof(header));
+
+    std::string_view payload(data + sizeof(header), size - sizeof(header));
+
+    if (std::memcmp(header.m_magic, c_cache_magic, sizeof(c_cache_magic))) {
+        spdlog::debug("Template cache has a different format, ignoring it");
+    } else if (!(header.m_source == source)) {
+        spdlog::debug("Template cache is stale, ignoring it");
+    } else if (header.m_payload_size != payload.size() ||
+        header.m_checksum != checksumData(payload)
+    ) {
+        spdlog::warn("Template cache is corrupted, ignoring it");
+    } else {
+        CacheReader reader{payload};
+        std::vector<TemplateSetting> cached;
+
+        for (uint64_t i = 0; i < header.m_setting_count && !reader.m_error;
+            i++
+        ) {
+            TemplateSetting& setting = cached.emplace_back();
+
+            std::string_view category = reader.readString();
+            std::string_view name = reader.readString();
+            setting.m_path = ConfigParser::ConfigPath(category, name);
+
+            setting.m_default = reader.readValue();
+            setting.m_displayed_name = reader.readString();
+            setting.m_description = reader.readString();
+        }
+
+        if (reader.m_error) {
+            spdlog::warn("Template cache is corrupted, ignoring it");
+        } else {
+            settings = std::move(cached);
+        }
+    }
+
+    munmap(mapping, size);
+
+    return settings;
+}
+
+// Store the validated base template in the binary cache at the given path,
+// creating the parent directory if needed
+//
+// Raise an exception if the cache can't be written
+void writeTemplateCache(
+    const std::filesystem::path& cache_path,
+    const TemplateSource& source,
+    const std::vector<TemplateSetting>& settings
+) {
+    std::string payload;
+
+    for (const auto& setting : settings) {
+        encodeString(payload, setting.m_path.getCategory());
+        encodeString(payload, setting.m_path.getName());
+        encodeValue(payload, setting.m_default);
+        encodeString(payload, setting.m_displayed_name);
+        encodeString(payload, setting.m_description);
+    }
+
+    CacheHeader header;
+    std::memcpy(header.m_magic, c_cache_magic, sizeof(c_cache_magic));
+    header.m_source = source;
+    header.m_setting_count = settings.size();
+    header.m_payload_size = payload.size();
+    header.m_checksum = checksumData(payload);
+
+    std::string content;
+    encode(content, header);
+    content += payload;
+
+    if (cache_path.has_parent_path())
+        std::filesystem::create_directories(cache_path.parent_path());
+
+    writeFileAtomic(cache_path, content);
+}
+
+} // namespace coil
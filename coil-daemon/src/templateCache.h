@@ -0,0 +1,54 @@
+#ifndef COIL_TEMPLATE_CACHE_H
+#define COIL_TEMPLATE_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "configParser.h"
+
+namespace coil {
+
+// Identify the version of the base template the cache was built from
+struct TemplateSource {
+    uint64_t m_device = 0;
+    uint64_t m_inode = 0;
+    uint64_t m_size = 0;
+    int64_t m_mtime_nsec = 0;
+
+    bool operator ==(const TemplateSource& rhs) const = default;
+};
+
+// Validated setting of the base template as stored in the cache
+struct TemplateSetting {
+    ConfigParser::ConfigPath m_path;
+    ConfigParser::ConfigValue m_default;
+    std::string m_displayed_name;
+    std::string m_description;
+};
+
+// Load the validated base template from the binary cache at the given
+// path. The file is mapped and decoded without any json parsing
+//
+// Return nullopt if the cache is missing, corrupted or was built
+// from a different version of the template
+std::optional<std::vector<TemplateSetting>> readTemplateCache(
+    const std::filesystem::path& cache_path,
+    const TemplateSource& source
+);
+
+// Store the validated base template in the binary cache at the given path,
+// creating the parent directory if needed
+//
+// Raise an exception if the cache can't be written
+void writeTemplateCache(
+    const std::filesystem::path& cache_path,
+    const TemplateSource& source,
+    const std::vector<TemplateSetting>& settings
+);
+
+} // namespace coil
+
+#endif
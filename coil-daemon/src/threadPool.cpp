@@ -0,0 +1,62 @@
+#include <algorithm>
+
+#include "threadPool.h"
+
+namespace coil {
+
+// Start the given number of worker threads, if zero one thread
+// per hardware thread is started
+ThreadPool::ThreadPool(size_t thread_count) :
+    m_stopping(false)
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    m_threads.reserve(thread_count);
+
+    for (size_t i = 0; i < thread_count; i++) {
+        m_threads.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+// Wait for the queued tasks to complete and stop the threads
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stopping = true;
+    }
+
+    m_condition.notify_all();
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+// Execute the queued tasks until the pool is stopped
+void ThreadPool::workerLoop()
+{
+    while (true) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            m_condition.wait(lock, [this]() {
+                return m_stopping || !m_tasks.empty();
+            });
+
+            // The remaining tasks are executed before stopping
+            if (m_tasks.empty())
+                return;
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop();
+        }
+
+        task();
+    }
+}
+
+} // namespace coil
@@ -0,0 +1,87 @@
+#ifndef COIL_THREAD_POOL_H
+#define COIL_THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace coil {
+
+// Fixed size pool of worker threads executing the submitted tasks
+// in submission order
+class ThreadPool {
+public:
+    // Start the given number of worker threads, if zero one thread
+    // per hardware thread is started
+    ThreadPool(size_t thread_count = 0);
+
+    // Wait for the queued tasks to complete and stop the threads
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Return the number of worker threads
+    size_t size() const { return m_threads.size(); }
+
+    // Queue a task for execution on a worker thread.
+    // Return a future holding the result of the task or the exception
+    // it raised
+    template <typename Function>
+    auto submit(Function&& function)
+        -> std::future<std::invoke_result_t<std::decay_t<Function>>>;
+
+private:
+    // Execute the queued tasks until the pool is stopped
+    void workerLoop();
+
+    // Worker threads
+    std::vector<std::thread> m_threads;
+
+    // Tasks waiting for a worker
+    std::queue<std::function<void()>> m_tasks;
+
+    // Protect the task queue and the stop flag
+    std::mutex m_mutex;
+    // Notified when a task is queued or the pool is stopped
+    std::condition_variable m_condition;
+
+    // True once the destructor was called
+    bool m_stopping;
+};
+
+// Queue a task for execution on a worker thread.
+// Return a future holding the result of the task or the exception
+// it raised
+template <typename Function>
+auto ThreadPool::submit(Function&& function)
+    -> std::future<std::invoke_result_t<std::decay_t<Function>>>
+{
+    using Result = std::invoke_result_t<std::decay_t<Function>>;
+
+    // std::function must be copyable, the packaged task is shared
+    auto task = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<Function>(function)
+    );
+    std::future<Result> result = task->get_future();
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_tasks.emplace([task]() { (*task)(); });
+    }
+
+    m_condition.notify_one();
+
+    return result;
+}
+
+} // namespace coil
+
+#endif
@@ -0,0 +1,25 @@
+# Generate the typed setting handles of a base template for a target.
+#
+#   coil_generate_settings(<target> <template>)
+#
+# The header coil/settings.h is generated from the template at build time
+# and added to the include path of the target, it's generated again when
+# the template changes. Each setting gets a handle named after its
+# category and name, for example coil::settings::audio::volume.
+function(coil_generate_settings TARGET TEMPLATE)
+    get_filename_component(template_path "${TEMPLATE}" ABSOLUTE)
+
+    set(output_dir "${CMAKE_CURRENT_BINARY_DIR}/coil-settings/${TARGET}")
+    set(header "${output_dir}/coil/settings.h")
+
+    add_custom_command(
+        OUTPUT "${header}"
+        COMMAND coil-settings-gen "${template_path}" "${header}"
+        DEPENDS coil-settings-gen "${template_path}"
+        COMMENT "Generating the setting handles of ${TEMPLATE}"
+        VERBATIM
+    )
+
+    target_sources(${TARGET} PRIVATE "${header}")
+    target_include_directories(${TARGET} PRIVATE "${output_dir}")
+endfunction()
@@ -0,0 +1,252 @@
+#ifndef COIL_COIL_H
+#define COIL_COIL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "coil/settingHandle.h"
+
+namespace sdbus {
+    class Error;
+    class IConnection;
+    class IProxy;
+    class Variant;
+}
+
+namespace coil {
+
+// Client of the coil daemon keeping a local copy of the settings.
+//
+// Each category is loaded with a single bulk call the first time it is
+// used, then kept current by the PropertiesChanged signals of the daemon.
+// Reading a setting after the category is loaded doesn't involve the bus
+// and doesn't take any lock. The values are fetched by the signal thread,
+// a category not loaded yet must not be read from a watch callback.
+class Client {
+public:
+    // Value of a setting, the alternatives match the types exposed by
+    // the daemon properties
+    using Value = std::variant<
+        std::monostate,
+        int,
+        bool,
+        double,
+        std::string,
+        std::vector<int>,
+        std::vector<double>,
+        std::vector<std::string>
+    >;
+
+    // Values of several categories, by category then by name
+    using Config = std::map<std::string, std::map<std::string, Value>>;
+
+    // Changed values of a watch, by "category:name"
+    using Changes = std::map<std::string, Value>;
+
+    // Connect to the bus and start the thread processing the signals
+    //
+    // Raise an exception if the connection can't be created
+    Client();
+    ~Client();
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    // Load the given category and keep it updated. Do nothing if
+    // the category is already loaded
+    //
+    // Raise an exception if the category can't be fetched from the daemon
+    void subscribe(const std::string& category);
+
+    // Return the value of the given setting from the local cache,
+    // the category is loaded if needed
+    //
+    // Raise an exception if the setting doesn't exist or if the
+    // requested type is wrong
+    template <typename Type>
+    Type get(const std::string& category, std::string_view name);
+
+    // Return the value of the setting of the given handle from the local
+    // cache. The type is checked at build time, the cache is still 
+    // indexed by name
+    //
+    // Raise an exception if the setting doesn't exist
+    template <typename Type>
+    Type get(const SettingHandle<Type>& handle);
+
+    // Return every setting from the daemon with a single bus call,
+    // the local cache isn't used
+    //
+    // Raise an exception if the call fails
+    Config getAll();
+
+    // Return the given settings of a category from the daemon with a
+    // single bus call, all of them if no name is given. The local cache
+    // isn't used
+    //
+    // Raise an exception if the category or a setting doesn't exist
+    std::map<std::string, Value> getMany(
+        const std::string& category,
+        const std::vector<std::string>& names
+    );
+
+    // Set settings of several categories with a single bus call, either
+    // all of them are set or none. Return once the values are committed
+    //
+    // Raise an exception if a setting doesn't exist, if a value has the
+    // wrong type or if the daemon failed to write them
+    void apply(const Config& config);
+
+    // Watch the settings whose "category:name" matches one of the glob
+    // patterns. The callback is called by the signal thread with the
+    // values changed during each debounce window, zero calls it on
+    // every change
+    //
+    // Raise an exception if the subscription fails
+    void watch(
+        const std::vector<std::string>& patterns,
+        std::chrono::milliseconds debounce,
+        std::function<void(const Changes&)> callback
+    );
+
+private:
+    // Immutable values of a category, replaced on each update
+    using Values = std::map<std::string, Value, std::less<>>;
+
+    // Cache of a subscribed category
+    struct Category {
+        // Proxy of the category object on the daemon
+        std::unique_ptr<sdbus::IProxy> m_proxy;
+        // Current values, read without holding the mutex, null until
+        // the first fetch completes
+        std::atomic<std::shared_ptr<const Values>> m_values;
+
+        // Serialize the updates of the values, never held during a
+        // bus call
+        std::mutex m_mutex;
+        // Signaled when a fetch of the values completes
+        std::condition_variable m_fetched;
+        // Store true while a fetch of the values is in progress
+        bool m_fetching = false;
+        // Error of the last failed fetch
+        std::string m_error;
+    };
+
+    // Subscription of a watch and its signal match, defined with the
+    // bus types
+    struct Watch;
+
+    // Immutable map of the subscribed categories, replaced on subscribe
+    using Categories = std::map<std::string, std::shared_ptr<Category>,
+        std::less<>>;
+
+    // Return the current values of the given category,
+    // subscribe to it if needed
+    //
+    // Raise an exception if the category can't be fetched from the daemon
+    std::shared_ptr<const Values> getValues(const std::string& category);
+
+    // Create the cache of the given category, register its signal
+    // handler and publish it without values. The caller must hold m_mutex
+    std::shared_ptr<Category> subscribeCategory(
+        const Categories& categories,
+        const std::string& category
+    );
+
+    // Return the values of the given category once fetched, the
+    // fetch is started if none is in progress
+    //
+    // Raise an exception if the category can't be fetched from the daemon
+    static std::shared_ptr<const Values> waitValues(Category& category);
+
+    // Start fetching all the values of a category from the daemon.
+    // The m_fetching flag of the category must be set by the caller
+    static void fetchValues(Category& category);
+
+    // Store the values of a category received in a fetch reply, or the
+    // error of the fetch
+    static void storeValues(
+        Category& category,
+        const std::optional<sdbus::Error>& error,
+        const std::map<std::string, sdbus::Variant>& variants
+    );
+
+    // Apply the values received in a PropertiesChanged signal
+    static void applyChanges(
+        Category& category,
+        const std::string& interface_name,
+        const std::map<std::string, sdbus::Variant>& changed,
+        const std::vector<std::string>& invalidated
+    );
+
+    // Convert a D-Bus variant received from the daemon to a value
+    static Value toValue(const sdbus::Variant& variant);
+
+    // Convert a value to a D-Bus variant sent to the daemon
+    //
+    // Raise an exception if the value is empty
+    static sdbus::Variant toVariant(const Value& value);
+
+    // Bus connection shared by all the category proxies
+    std::unique_ptr<sdbus::IConnection> m_connection;
+
+    // Proxy of the root object of the daemon
+    std::unique_ptr<sdbus::IProxy> m_root_proxy;
+
+    // Subscriptions of the watches
+    std::vector<std::unique_ptr<Watch>> m_watches;
+
+    // Subscribed categories, read without holding the mutex
+    std::atomic<std::shared_ptr<const Categories>> m_categories;
+
+    // Serialize the subscriptions, the values of each category are
+    // updated holding its own mutex
+    std::mutex m_mutex;
+};
+
+// Return the value of the given setting from the local cache,
+// the category is loaded if needed
+//
+// Raise an exception if the setting doesn't exist or if the
+// requested type is wrong
+template <typename Type>
+Type Client::get(const std::string& category, std::string_view name)
+{
+    std::shared_ptr<const Values> values = getValues(category);
+    auto value = values->find(name);
+
+    if (value == values->end())
+        throw std::runtime_error("The requested setting doesn't exist");
+
+    const Type* data = std::get_if<Type>(&value->second);
+
+    if (data == nullptr)
+        throw std::runtime_error("The requested setting has the wrong type");
+
+    return *data;
+}
+
+// Return the value of the setting of the given handle from the local
+// cache
+//
+// Raise an exception if the setting doesn't exist
+template <typename Type>
+Type Client::get(const SettingHandle<Type>& handle)
+{
+    return get<Type>(std::string(handle.m_category), handle.m_name);
+}
+
+} // namespace coil
+
+#endif
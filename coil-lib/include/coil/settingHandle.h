@@ -0,0 +1,80 @@
+#ifndef COIL_SETTING_HANDLE_H
+#define COIL_SETTING_HANDLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "coil/sharedLayout.h"
+
+// Typed handles of the settings, generated at build time from a base
+// template by the coil_generate_settings CMake function.
+//
+// A handle holds the id the daemon assigns to the setting, its type is
+// part of the handle type so a wrong type fails to compile. The ids are
+// only valid for the template the handles were generated from, the
+// readers compare the fingerprint of the handles with the one of the
+// template once, then use the ids without any lookup.
+
+namespace coil {
+
+// Offset basis and prime of the 64 bits FNV-1a hash
+constexpr uint64_t c_fingerprint_basis = 0xcbf29ce484222325;
+constexpr uint64_t c_fingerprint_prime = 0x100000001b3;
+
+// Return the fingerprint updated with the given bytes
+constexpr uint64_t fingerprintBytes(
+    uint64_t fingerprint,
+    std::string_view bytes
+) {
+    for (char byte : bytes) {
+        fingerprint ^= static_cast<unsigned char>(byte);
+        fingerprint *= c_fingerprint_prime;
+    }
+
+    return fingerprint;
+}
+
+// Return the template fingerprint updated with a setting. The settings
+// are added in id order, starting from c_fingerprint_basis
+constexpr uint64_t fingerprintSetting(
+    uint64_t fingerprint,
+    std::string_view category,
+    std::string_view name,
+    SharedType type
+) {
+    // The separators tell apart the paths sharing their characters
+    fingerprint = fingerprintBytes(fingerprint, category);
+    fingerprint = fingerprintBytes(fingerprint, std::string_view("\0", 1));
+    fingerprint = fingerprintBytes(fingerprint, name);
+    fingerprint = fingerprintBytes(fingerprint, std::string_view("\0", 1));
+
+    fingerprint ^= static_cast<uint32_t>(type);
+    fingerprint *= c_fingerprint_prime;
+
+    return fingerprint;
+}
+
+// Typed handle of a setting, the type is the one returned by the readers
+template <typename Type>
+struct SettingHandle {
+    using ValueType = Type;
+
+    // Id of the setting in the template
+    size_t m_id;
+
+    // Category and name of the setting
+    std::string_view m_category;
+    std::string_view m_name;
+
+    // Number of settings and fingerprint of the template the handle
+    // was generated from
+    size_t m_count;
+    uint64_t m_fingerprint;
+};
+
+} // namespace coil
+
+#endif
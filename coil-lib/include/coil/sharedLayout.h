@@ -0,0 +1,99 @@
+#ifndef COIL_SHARED_LAYOUT_H
+#define COIL_SHARED_LAYOUT_H
+
+#include <atomic>
+#include <cstdint>
+
+// Layout of the shared memory segment published by the daemon.
+//
+// The segment starts with a SharedHeader followed by one SharedEntry per
+// setting, the setting paths and the payload slots. All the offsets are
+// relative to the start of the segment. The daemon is the only writer,
+// the clients map the segment read-only.
+//
+// Each entry is protected by a sequence counter: the writer makes it odd
+// before changing the payload and even again once done. A reader copies
+// the payload and retries if the counter changed or was odd.
+//
+// Payload encoding:
+//  - Int, Bool, Float: a single int64_t, uint8_t or double
+//  - String: the characters without terminator
+//  - ArrayInt, ArrayFloat: the int64_t or double elements
+//  - ArrayString: for each element a uint32_t size followed by
+//    the characters
+//
+// When a value doesn't fit in its slot the daemon builds a new segment and
+// marks the old one as stale, the clients must then request the new one.
+
+namespace coil {
+
+// Magic number at the start of the segment, "COIL" in little endian
+constexpr uint32_t c_shared_magic = 0x4c494f43;
+
+// Version of the layout, changed on every incompatible change
+constexpr uint32_t c_shared_version = 1;
+
+// The counters must work across processes
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+// Type of a setting stored in the segment, the values match the daemon
+// configuration types
+enum class SharedType : uint32_t {
+    None = 0,
+    Int,
+    Bool,
+    Float,
+    String,
+    ArrayInt,
+    ArrayFloat,
+    ArrayString
+};
+
+// Header at the start of the segment
+struct SharedHeader {
+    // Must be c_shared_magic
+    uint32_t m_magic;
+    // Must be c_shared_version
+    uint32_t m_version;
+
+    // Total size of the segment in bytes
+    uint64_t m_size;
+
+    // Number of entries and offset of the first one
+    uint32_t m_entry_count;
+    uint32_t m_entries_offset;
+
+    // Incremented after each batch of updates
+    std::atomic<uint64_t> m_generation;
+
+    // Set to non zero when the segment was replaced by a new one
+    std::atomic<uint32_t> m_stale;
+    uint32_t m_reserved;
+};
+
+// Description of a setting and of its payload slot
+struct SharedEntry {
+    // Sequence counter, odd while the payload is being written
+    std::atomic<uint32_t> m_sequence;
+
+    // Type of the setting
+    SharedType m_type;
+
+    // Category and name of the setting
+    uint32_t m_category_offset;
+    uint32_t m_category_size;
+    uint32_t m_name_offset;
+    uint32_t m_name_size;
+
+    // Payload slot and size of the current value in bytes
+    uint32_t m_data_offset;
+    uint32_t m_data_capacity;
+    std::atomic<uint32_t> m_data_size;
+
+    uint32_t m_reserved;
+};
+
+} // namespace coil
+
+#endif
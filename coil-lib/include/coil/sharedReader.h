@@ -0,0 +1,181 @@
+#ifndef COIL_SHARED_READER_H
+#define COIL_SHARED_READER_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "coil/coil.h"
+#include "coil/settingHandle.h"
+#include "coil/sharedLayout.h"
+
+namespace sdbus {
+    class IConnection;
+    class IProxy;
+}
+
+namespace coil {
+
+// Read the settings from the shared memory segment published by the
+// daemon. Reading a value doesn't involve any IPC, the bus is only used
+// to request the segment
+class SharedReader {
+public:
+    using Value = Client::Value;
+
+    // Request the segment from the daemon and map it
+    //
+    // Raise an exception if the segment can't be requested or mapped
+    SharedReader();
+
+    // Map the segment of the given descriptor, the descriptor isn't
+    // kept open. A stale segment can't be replaced in this mode
+    //
+    // Raise an exception if the segment can't be mapped
+    explicit SharedReader(int fd);
+
+    ~SharedReader();
+
+    SharedReader(const SharedReader&) = delete;
+    SharedReader& operator=(const SharedReader&) = delete;
+
+    // Return the value of the given setting
+    //
+    // Raise an exception if the setting doesn't exist
+    Value getValue(std::string_view category, std::string_view name);
+
+    // Return the value of the given setting
+    //
+    // Raise an exception if the setting doesn't exist or if the
+    // requested type is wrong
+    template <typename Type>
+    Type get(std::string_view category, std::string_view name);
+
+    // Return the value of the setting of the given handle. The entry 
+    // is read by id, without lookup and without type check
+    //
+    // Raise an exception if the handle wasn't generated from the
+    // template of the daemon
+    template <typename Type>
+    Type get(const SettingHandle<Type>& handle);
+
+    // Return the generation of the segment, incremented by the daemon
+    // after each batch of updates
+    uint64_t getGeneration();
+
+private:
+    // Mapping of a segment and index of its entries
+    struct Mapping {
+        ~Mapping();
+
+        const char* m_data = nullptr;
+        size_t m_size = 0;
+
+        // Entries indexed by category and name, the names point
+        // inside the segment
+        std::map<
+            std::string_view,
+            std::map<std::string_view, const SharedEntry*>
+        > m_entries;
+
+        // Entries in id order
+        const SharedEntry* m_entry_array = nullptr;
+        uint32_t m_entry_count = 0;
+
+        // Fingerprint of the setting handles matching the entries,
+        // zero until a handle is used
+        mutable std::atomic<uint64_t> m_handle_fingerprint = 0;
+    };
+
+    // Return the current mapping, replace it if the daemon
+    // built a new segment
+    std::shared_ptr<const Mapping> getMapping();
+
+    // Map the segment of the given descriptor and index its entries
+    //
+    // Raise an exception if the segment can't be mapped or is invalid
+    static std::shared_ptr<const Mapping> mapSegment(int fd);
+
+    // Request the descriptor of the current segment from the daemon
+    // and map it
+    //
+    // Raise an exception if the segment can't be requested or mapped
+    std::shared_ptr<const Mapping> requestSegment();
+
+    // Read the value of an entry using its sequence counter
+    //
+    // Raise an exception if the daemon never finishes writing the entry
+    static Value readEntry(const char* data, const SharedEntry& entry);
+
+    // Compare the fingerprint of the setting handles with the one of
+    // the first count entries of the mapping, the handles with the
+    // same fingerprint are then used without check
+    //
+    // Raise an exception if the fingerprints don't match
+    static void checkHandles(
+        const Mapping& mapping,
+        size_t count,
+        uint64_t fingerprint
+    );
+
+    // Bus connection and root object proxy, null if the reader was
+    // created from a descriptor
+    std::unique_ptr<sdbus::IConnection> m_connection;
+    std::unique_ptr<sdbus::IProxy> m_proxy;
+
+    // Current mapping, read without holding the mutex
+    std::atomic<std::shared_ptr<const Mapping>> m_mapping;
+
+    // Serialize the replacement of the mapping
+    std::mutex m_mutex;
+};
+
+// Return the value of the given setting
+//
+// Raise an exception if the setting doesn't exist or if the
+// requested type is wrong
+template <typename Type>
+Type SharedReader::get(std::string_view category, std::string_view name)
+{
+    Value value = getValue(category, name);
+    Type* data = std::get_if<Type>(&value);
+
+    if (data == nullptr)
+        throw std::runtime_error("The requested setting has the wrong type");
+
+    return std::move(*data);
+}
+
+// Return the value of the setting of the given handle
+//
+// Raise an exception if the handle wasn't generated from the
+// template of the daemon
+template <typename Type>
+Type SharedReader::get(const SettingHandle<Type>& handle)
+{
+    std::shared_ptr<const Mapping> mapping = getMapping();
+
+    // A new segment holds the same settings first, it's checked again
+    // only because it's a new mapping
+    if (mapping->m_handle_fingerprint.load(std::memory_order_relaxed) != 
+        handle.m_fingerprint
+    ) {
+        checkHandles(*mapping, handle.m_count, handle.m_fingerprint);
+    }
+
+    Value value = readEntry(
+        mapping->m_data,
+        mapping->m_entry_array[handle.m_id]
+    );
+
+    return std::move(*std::get_if<Type>(&value));
+}
+
+} // namespace coil
+
+#endif
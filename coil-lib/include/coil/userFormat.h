@@ -0,0 +1,54 @@
+#ifndef COIL_USER_FORMAT_H
+#define COIL_USER_FORMAT_H
+
+#include <optional>
+#include <string_view>
+
+// Storage formats of the user configuration, shared by the daemon and
+// the coil tool.
+//
+// Every format holds the same data model as the json file: an object of
+// categories, each an object of setting values. The binary formats are
+// the CBOR and MessagePack encodings of this object, they are smaller
+// and faster to parse but can't be edited by hand. The coil tool
+// converts them from and to json.
+
+namespace coil {
+
+// Storage format of the user configuration
+enum class UserFormat {
+    Json,
+    Cbor,
+    MessagePack
+};
+
+// Return the format with the given name: "json", "cbor" or "msgpack"
+// Return nullopt if the name is unknown
+inline std::optional<UserFormat> parseUserFormat(std::string_view name)
+{
+    if (name == "json")
+        return UserFormat::Json;
+    if (name == "cbor")
+        return UserFormat::Cbor;
+    if (name == "msgpack")
+        return UserFormat::MessagePack;
+
+    return std::nullopt;
+}
+
+// Return the extension of the files stored in the given format
+inline const char* getUserFormatExtension(UserFormat format)
+{
+    switch (format) {
+        case UserFormat::Cbor:
+            return ".cbor";
+        case UserFormat::MessagePack:
+            return ".msgpack";
+        default:
+            return ".json";
+    }
+}
+
+} // namespace coil
+
+#endif
@@ -0,0 +1,21 @@
+#include <cstdlib>
+
+#include "busConnection.h"
+
+namespace coil {
+
+// If the variable is set the daemon is reached on the system bus
+constexpr const char* c_system_bus_env = "COIL_SYSTEM_BUS";
+
+// Connect to the bus the coil daemon runs on
+//
+// Raise an exception if the connection can't be created
+std::unique_ptr<sdbus::IConnection> createDaemonConnection()
+{
+    if (std::getenv(c_system_bus_env))
+        return sdbus::createSystemBusConnection();
+
+    return sdbus::createBusConnection();
+}
+
+} // namespace coil
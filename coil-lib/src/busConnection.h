@@ -0,0 +1,19 @@
+#ifndef COIL_BUS_CONNECTION_H
+#define COIL_BUS_CONNECTION_H
+
+#include <memory>
+
+#include <sdbus-c++/IConnection.h>
+
+namespace coil {
+
+// Connect to the bus the coil daemon runs on. The daemon serving every
+// user runs on the system bus, COIL_SYSTEM_BUS selects it. The session
+// bus is used otherwise
+//
+// Raise an exception if the connection can't be created
+std::unique_ptr<sdbus::IConnection> createDaemonConnection();
+
+} // namespace coil
+
+#endif
@@ -0,0 +1,456 @@
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <sdbus-c++/IConnection.h>
+#include <sdbus-c++/IProxy.h>
+#include <sdbus-c++/Types.h>
+
+#include "coil/coil.h"
+
+#include "busConnection.h"
+
+namespace coil {
+
+// D-Bus name of the coil daemon
+constexpr const char* c_dbus_service_name = "org.sparkplug.coil1";
+
+// D-Bus root object of the coil daemon
+constexpr const char* c_dbus_root_object = "/org/sparkplug/coil";
+
+// D-Bus config interface of the category objects
+constexpr const char* c_dbus_interface_name = "org.sparkplug.coil.config1";
+
+// D-Bus subscription interface of the watches and its change signal
+constexpr const char* c_dbus_subscription_interface_name =
+    "org.sparkplug.coil.subscription1";
+constexpr const char* c_dbus_subscription_changed = "Changed";
+
+// D-Bus standard properties interface and its change signal
+constexpr const char* c_dbus_properties_interface =
+    "org.freedesktop.DBus.Properties";
+constexpr const char* c_dbus_properties_changed = "PropertiesChanged";
+
+// Subscription of a watch, the changes are received through a match
+// of the signals of every subscription of the daemon
+struct Client::Watch {
+    // Match of the change signals, removed with the watch
+    sdbus::Slot m_match;
+
+    // Serialize the calls of the callback
+    std::mutex m_mutex;
+    // Path of the subscription object, set by the reply of Subscribe
+    std::optional<std::string> m_path;
+    // Changes received before the reply, with the path of their object
+    std::vector<std::pair<std::string, Changes>> m_early;
+
+    // Called with the changes of each debounce window
+    std::function<void(const Changes&)> m_callback;
+};
+
+// Connect to the bus and start the thread processing the signals
+//
+// Raise an exception if the connection can't be created
+Client::Client() :
+    m_connection(createDaemonConnection()),
+    m_categories(std::make_shared<const Categories>())
+{
+    m_root_proxy = sdbus::createProxy(
+        *m_connection,
+        sdbus::ServiceName{c_dbus_service_name},
+        sdbus::ObjectPath{c_dbus_root_object}
+    );
+
+    m_connection->enterEventLoopAsync();
+}
+
+Client::~Client()
+{
+    m_connection->leaveEventLoop();
+}
+
+// Load the given category and keep it updated. Do nothing if
+// the category is already loaded
+//
+// Raise an exception if the category can't be fetched from the daemon
+void Client::subscribe(const std::string& category_name)
+{
+    getValues(category_name);
+}
+
+// Return the current values of the given category,
+// subscribe to it if needed
+//
+// Raise an exception if the category can't be fetched from the daemon
+std::shared_ptr<const Client::Values> Client::getValues(
+    const std::string& category_name
+) {
+    // Fast path, the category is already loaded
+    {
+        std::shared_ptr<const Categories> categories = m_categories.load();
+        auto category = categories->find(category_name);
+
+        if (category != categories->end())
+            return category->second->m_values.load();
+    }
+
+    std::shared_ptr<Category> category;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        // Another thread could have subscribed in the meantime
+        std::shared_ptr<const Categories> categories = m_categories.load();
+        auto existing = categories->find(category_name);
+
+        if (existing != categories->end()) {
+            category = existing->second;
+        } else {
+            category = subscribeCategory(*categories, category_name);
+        }
+    }
+
+    // The fetch is waited for without holding m_mutex, the other 
+    // categories are updated meanwhile
+    return waitValues(*category);
+}
+
+// Create the cache of the given category, register its signal handler
+// and publish it without values. The caller must hold m_mutex
+std::shared_ptr<Client::Category> Client::subscribeCategory(
+    const Categories& categories,
+    const std::string& category_name
+) {
+    auto category = std::make_shared<Category>();
+
+    category->m_proxy = sdbus::createProxy(
+        *m_connection,
+        sdbus::ServiceName{c_dbus_service_name},
+        sdbus::ObjectPath{
+            std::string(c_dbus_root_object) + "/" + category_name
+        }
+    );
+
+    // Register the signal handler before fetching the values so that no
+    // change is lost. The fetch reply is handled by the signal thread in
+    // order with the signals, a signal handled before it only carries
+    // values already included in it
+    Category* category_p = category.get();
+
+    category->m_proxy->uponSignal(c_dbus_properties_changed)
+        .onInterface(c_dbus_properties_interface)
+        .call([category_p](
+            const std::string& interface_name,
+            const std::map<std::string, sdbus::Variant>& changed,
+            const std::vector<std::string>& invalidated
+        ) {
+            applyChanges(*category_p, interface_name, changed, invalidated);
+    });
+
+    // Publish the new category map
+    auto updated = std::make_shared<Categories>(categories);
+    updated->emplace(category_name, category);
+    m_categories.store(std::move(updated));
+
+    return category;
+}
+
+// Return the values of the given category once fetched, the fetch is
+// started if none is in progress
+//
+// Raise an exception if the category can't be fetched from the daemon
+std::shared_ptr<const Client::Values> Client::waitValues(Category& category)
+{
+    std::unique_lock<std::mutex> guard(category.m_mutex);
+
+    if (std::shared_ptr<const Values> values = category.m_values.load())
+        return values;
+
+    // A failed fetch is started again by the next caller
+    if (!category.m_fetching) {
+        category.m_fetching = true;
+        category.m_error.clear();
+
+        guard.unlock();
+        fetchValues(category);
+        guard.lock();
+    }
+
+    category.m_fetched.wait(guard, [&]() { return !category.m_fetching; });
+
+    if (std::shared_ptr<const Values> values = category.m_values.load())
+        return values;
+
+    throw std::runtime_error(category.m_error);
+}
+
+// Start fetching all the values of a category from the daemon, the
+// reply is handled by the signal thread
+void Client::fetchValues(Category& category)
+{
+    Category* category_p = &category;
+
+    try {
+        // An empty list of names returns the whole category
+        category.m_proxy->callMethodAsync("GetMany")
+            .onInterface(c_dbus_interface_name)
+            .withArguments(std::vector<std::string>())
+            .uponReplyInvoke([category_p](
+                std::optional<sdbus::Error> error,
+                const std::map<std::string, sdbus::Variant>& variants
+            ) {
+                storeValues(*category_p, error, variants);
+        });
+    } catch (const sdbus::Error& e) {
+        storeValues(category, e, {});
+    }
+}
+
+// Store the values of a category received in a fetch reply, or the
+// error of the fetch. A failed fetch keeps the previous values
+void Client::storeValues(
+    Category& category,
+    const std::optional<sdbus::Error>& error,
+    const std::map<std::string, sdbus::Variant>& variants
+) {
+    Values values;
+
+    for (const auto& [name, variant] : variants) {
+        values.emplace(name, toValue(variant));
+    }
+
+    std::lock_guard<std::mutex> guard(category.m_mutex);
+
+    if (error.has_value()) {
+        category.m_error = error->what();
+    } else {
+        category.m_values.store(
+            std::make_shared<const Values>(std::move(values))
+        );
+    }
+
+    category.m_fetching = false;
+    category.m_fetched.notify_all();
+}
+
+// Return every setting from the daemon with a single bus call
+//
+// Raise an exception if the call fails
+Client::Config Client::getAll()
+{
+    std::map<std::string, std::map<std::string, sdbus::Variant>> variants;
+
+    m_root_proxy->callMethod("GetAllConfig")
+        .onInterface(c_dbus_interface_name)
+        .storeResultsTo(variants);
+
+    Config config;
+
+    for (const auto& [category, values] : variants) {
+        for (const auto& [name, variant] : values) {
+            config[category].emplace(name, toValue(variant));
+        }
+    }
+
+    return config;
+}
+
+// Return the given settings of a category from the daemon with a
+// single bus call, all of them if no name is given
+//
+// Raise an exception if the category or a setting doesn't exist
+std::map<std::string, Client::Value> Client::getMany(
+    const std::string& category,
+    const std::vector<std::string>& names
+) {
+    auto proxy = sdbus::createProxy(
+        *m_connection,
+        sdbus::ServiceName{c_dbus_service_name},
+        sdbus::ObjectPath{std::string(c_dbus_root_object) + "/" + category}
+    );
+
+    std::map<std::string, sdbus::Variant> variants;
+
+    proxy->callMethod("GetMany")
+        .onInterface(c_dbus_interface_name)
+        .withArguments(names)
+        .storeResultsTo(variants);
+
+    std::map<std::string, Value> values;
+
+    for (const auto& [name, variant] : variants) {
+        values.emplace(name, toValue(variant));
+    }
+
+    return values;
+}
+
+// Set settings of several categories with a single bus call
+//
+// Raise an exception if a setting doesn't exist, if a value has the
+// wrong type or if the daemon failed to write them
+void Client::apply(const Config& config)
+{
+    std::map<std::string, std::map<std::string, sdbus::Variant>> variants;
+
+    for (const auto& [category, values] : config) {
+        for (const auto& [name, value] : values) {
+            variants[category].emplace(name, toVariant(value));
+        }
+    }
+
+    m_root_proxy->callMethod("Apply")
+        .onInterface(c_dbus_interface_name)
+        .withArguments(variants);
+}
+
+// Watch the settings whose "category:name" matches one of the patterns
+//
+// Raise an exception if the subscription fails
+void Client::watch(
+    const std::vector<std::string>& patterns,
+    std::chrono::milliseconds debounce,
+    std::function<void(const Changes&)> callback
+) {
+    auto watch = std::make_unique<Watch>();
+    watch->m_callback = std::move(callback);
+
+    // The match is added before subscribing so that no change is lost,
+    // the path of the subscription is only known from the reply. The
+    // changes received before it are held until then
+    std::string match =
+        "type='signal',sender='" + std::string(c_dbus_service_name) + "',"
+        "interface='" + c_dbus_subscription_interface_name + "',"
+        "member='" + c_dbus_subscription_changed + "'";
+
+    Watch* watch_p = watch.get();
+
+    watch->m_match = m_connection->addMatch(
+        match,
+        [watch_p](sdbus::Message message) {
+            std::map<std::string, sdbus::Variant> changed;
+            message >> changed;
+
+            Changes changes;
+
+            for (const auto& [name, variant] : changed) {
+                changes.emplace(name, toValue(variant));
+            }
+
+            std::lock_guard<std::mutex> guard(watch_p->m_mutex);
+
+            if (!watch_p->m_path.has_value()) {
+                watch_p->m_early.emplace_back(
+                    message.getPath(),
+                    std::move(changes)
+                );
+            } else if (*watch_p->m_path == message.getPath()) {
+                watch_p->m_callback(changes);
+            }
+    });
+
+    sdbus::ObjectPath path;
+
+    m_root_proxy->callMethod("Subscribe")
+        .onInterface(c_dbus_interface_name)
+        .withArguments(patterns, static_cast<uint32_t>(debounce.count()))
+        .storeResultsTo(path);
+
+    // Deliver the changes of the subscription received before the
+    // reply, the other watches of the client get their own
+    {
+        std::lock_guard<std::mutex> guard(watch->m_mutex);
+        watch->m_path = path;
+
+        for (const auto& [early_path, changes] : watch->m_early) {
+            if (early_path == path)
+                watch->m_callback(changes);
+        }
+
+        watch->m_early.clear();
+    }
+
+    // The subscription lasts as long as the connection
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_watches.push_back(std::move(watch));
+}
+
+// Apply the values received in a PropertiesChanged signal
+void Client::applyChanges(
+    Category& category,
+    const std::string& interface_name,
+    const std::map<std::string, sdbus::Variant>& changed,
+    const std::vector<std::string>& invalidated
+) {
+    if (interface_name != c_dbus_interface_name)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(category.m_mutex);
+
+        // The values are only missing while the category is being
+        // fetched, the reply follows and already includes this change
+        std::shared_ptr<const Values> current = category.m_values.load();
+
+        if (!current)
+            return;
+
+        auto values = std::make_shared<Values>(*current);
+
+        for (const auto& [name, variant] : changed) {
+            (*values)[name] = toValue(variant);
+        }
+
+        category.m_values.store(std::move(values));
+
+        // Invalidated properties don't carry their value, fetch the
+        // whole category again in that case. A fetch in progress 
+        // already includes them
+        if (invalidated.empty() || category.m_fetching)
+            return;
+
+        category.m_fetching = true;
+    }
+
+    fetchValues(category);
+}
+
+// Convert a D-Bus variant received from the daemon to a value
+Client::Value Client::toValue(const sdbus::Variant& variant)
+{
+    if (variant.containsValueOfType<bool>())
+        return variant.get<bool>();
+    if (variant.containsValueOfType<int>())
+        return variant.get<int>();
+    if (variant.containsValueOfType<double>())
+        return variant.get<double>();
+    if (variant.containsValueOfType<std::string>())
+        return variant.get<std::string>();
+    if (variant.containsValueOfType<std::vector<int>>())
+        return variant.get<std::vector<int>>();
+    if (variant.containsValueOfType<std::vector<double>>())
+        return variant.get<std::vector<double>>();
+    if (variant.containsValueOfType<std::vector<std::string>>())
+        return variant.get<std::vector<std::string>>();
+
+    return std::monostate();
+}
+
+// Convert a value to a D-Bus variant sent to the daemon
+//
+// Raise an exception if the value is empty
+sdbus::Variant Client::toVariant(const Value& value)
+{
+    return std::visit([](const auto& data) -> sdbus::Variant {
+        using Type = std::decay_t<decltype(data)>;
+
+        if constexpr (std::is_same_v<Type, std::monostate>) {
+            throw std::runtime_error("The value is empty");
+        } else {
+            return sdbus::Variant(data);
+        }
+    }, value);
+}
+
+} // namespace coil
@@ -0,0 +1,368 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sdbus-c++/IConnection.h>
+#include <sdbus-c++/IProxy.h>
+#include <sdbus-c++/Types.h>
+
+#include "coil/sharedReader.h"
+
+#include "busConnection.h"
+
+namespace coil {
+
+// D-Bus name of the coil daemon
+constexpr const char* c_dbus_service_name = "org.sparkplug.coil1";
+
+// D-Bus root object of the coil daemon
+constexpr const char* c_dbus_root_object = "/org/sparkplug/coil";
+
+// D-Bus config interface of the root object
+constexpr const char* c_dbus_interface_name = "org.sparkplug.coil.config1";
+
+// Attempts to read an entry before yielding the processor between the
+// attempts, the daemon may be preempted in the middle of a write
+constexpr size_t c_read_spin_count = 64;
+
+// Attempts to read an entry before giving up, the daemon only holds
+// an entry while it copies its payload
+constexpr size_t c_read_attempt_count = 100000;
+
+// Raise an exception describing the failed operation and the errno value
+[[noreturn]] static void throwSharedError(std::string_view operation)
+{
+    throw std::runtime_error(
+        std::string(operation) + " failed for the shared config: " +
+        std::strerror(errno)
+    );
+}
+
+// Request the segment from the daemon and map it
+//
+// Raise an exception if the segment can't be requested or mapped
+SharedReader::SharedReader() :
+    m_connection(createDaemonConnection())
+{
+    m_proxy = sdbus::createProxy(
+        *m_connection,
+        sdbus::ServiceName{c_dbus_service_name},
+        sdbus::ObjectPath{c_dbus_root_object}
+    );
+
+    m_mapping.store(requestSegment());
+}
+
+// Map the segment of the given descriptor, the descriptor isn't
+// kept open. A stale segment can't be replaced in this mode
+//
+// Raise an exception if the segment can't be mapped
+SharedReader::SharedReader(int fd)
+{
+    m_mapping.store(mapSegment(fd));
+}
+
+SharedReader::~SharedReader() = default;
+
+SharedReader::Mapping::~Mapping()
+{
+    if (m_data != nullptr)
+        munmap(const_cast<char*>(m_data), m_size);
+}
+
+// Return the value of the given setting
+//
+// Raise an exception if the setting doesn't exist
+SharedReader::Value SharedReader::getValue(
+    std::string_view category,
+    std::string_view name
+) {
+    std::shared_ptr<const Mapping> mapping = getMapping();
+
+    auto category_entries = mapping->m_entries.find(category);
+
+    if (category_entries == mapping->m_entries.end())
+        throw std::runtime_error("The requested setting doesn't exist");
+
+    auto entry = category_entries->second.find(name);
+
+    if (entry == category_entries->second.end())
+        throw std::runtime_error("The requested setting doesn't exist");
+
+    return readEntry(mapping->m_data, *entry->second);
+}
+
+// Return the generation of the segment, incremented by the daemon
+// after each batch of updates
+uint64_t SharedReader::getGeneration()
+{
+    std::shared_ptr<const Mapping> mapping = getMapping();
+    const SharedHeader* header =
+        reinterpret_cast<const SharedHeader*>(mapping->m_data);
+
+    return header->m_generation.load(std::memory_order_acquire);
+}
+
+// Return the current mapping, replace it if the daemon
+// built a new segment
+std::shared_ptr<const SharedReader::Mapping> SharedReader::getMapping()
+{
+    std::shared_ptr<const Mapping> mapping = m_mapping.load();
+    const SharedHeader* header =
+        reinterpret_cast<const SharedHeader*>(mapping->m_data);
+
+    if (!header->m_stale.load(std::memory_order_acquire) || !m_proxy)
+        return mapping;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    // Another thread could have replaced it in the meantime
+    if (m_mapping.load() != mapping)
+        return m_mapping.load();
+
+    mapping = requestSegment();
+    m_mapping.store(mapping);
+
+    return mapping;
+}
+
+// Map the segment of the given descriptor and index its entries
+//
+// Raise an exception if the segment can't be mapped or is invalid
+std::shared_ptr<const SharedReader::Mapping> SharedReader::mapSegment(int fd)
+{
+    struct stat info;
+
+    if (fstat(fd, &info) < 0)
+        throwSharedError("fstat");
+
+    if (static_cast<size_t>(info.st_size) < sizeof(SharedHeader))
+        throw std::runtime_error("The shared config is truncated");
+
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (data == MAP_FAILED)
+        throwSharedError("mmap");
+
+    auto mapping = std::make_shared<Mapping>();
+    mapping->m_data = static_cast<const char*>(data);
+    mapping->m_size = info.st_size;
+
+    const SharedHeader* header =
+        reinterpret_cast<const SharedHeader*>(mapping->m_data);
+
+    if (header->m_magic != c_shared_magic ||
+        header->m_version != c_shared_version
+    ) {
+        throw std::runtime_error("The shared config has the wrong version");
+    }
+
+    if (header->m_size > mapping->m_size ||
+        header->m_entries_offset +
+            size_t(header->m_entry_count) * sizeof(SharedEntry) >
+            mapping->m_size
+    ) {
+        throw std::runtime_error("The shared config is truncated");
+    }
+
+    mapping->m_entry_array = reinterpret_cast<const SharedEntry*>(
+        mapping->m_data + header->m_entries_offset
+    );
+    mapping->m_entry_count = header->m_entry_count;
+
+    // Index the entries, their paths never change in a segment
+    for (uint32_t i = 0; i < header->m_entry_count; i++) {
+        const SharedEntry* entry = reinterpret_cast<const SharedEntry*>(
+            mapping->m_data + header->m_entries_offset +
+            i * sizeof(SharedEntry)
+        );
+
+        std::string_view category(
+            mapping->m_data + entry->m_category_offset,
+            entry->m_category_size
+        );
+        std::string_view name(
+            mapping->m_data + entry->m_name_offset,
+            entry->m_name_size
+        );
+
+        mapping->m_entries[category][name] = entry;
+    }
+
+    return mapping;
+}
+
+// Request the descriptor of the current segment from the daemon
+// and map it
+//
+// Raise an exception if the segment can't be requested or mapped
+std::shared_ptr<const SharedReader::Mapping> SharedReader::requestSegment()
+{
+    sdbus::UnixFd fd;
+
+    m_proxy->callMethod("GetSharedMemory")
+        .onInterface(c_dbus_interface_name)
+        .storeResultsTo(fd);
+
+    return mapSegment(fd.get());
+}
+
+// Compare the fingerprint of the setting handles with the one of
+// the first count entries of the mapping
+//
+// Raise an exception if the fingerprints don't match
+void SharedReader::checkHandles(
+    const Mapping& mapping,
+    size_t count,
+    uint64_t fingerprint
+) {
+    if (count > mapping.m_entry_count) {
+        throw std::runtime_error(
+            "The setting handles don't match the daemon template"
+        );
+    }
+
+    uint64_t entries_fingerprint = c_fingerprint_basis;
+
+    for (size_t i = 0; i < count; i++) {
+        const SharedEntry& entry = mapping.m_entry_array[i];
+
+        entries_fingerprint = fingerprintSetting(
+            entries_fingerprint,
+            std::string_view(
+                mapping.m_data + entry.m_category_offset,
+                entry.m_category_size
+            ),
+            std::string_view(
+                mapping.m_data + entry.m_name_offset,
+                entry.m_name_size
+            ),
+            entry.m_type
+        );
+    }
+
+    if (entries_fingerprint != fingerprint) {
+        throw std::runtime_error(
+            "The setting handles don't match the daemon template"
+        );
+    }
+
+    mapping.m_handle_fingerprint.store(
+        fingerprint,
+        std::memory_order_relaxed
+    );
+}
+
+// Read the value of an entry using its sequence counter
+//
+// Raise an exception if the daemon never finishes writing the entry
+SharedReader::Value SharedReader::readEntry(
+    const char* data,
+    const SharedEntry& entry
+) {
+    const char* payload = data + entry.m_data_offset;
+    std::string buffer;
+
+    // Copy the payload until the daemon didn't change it during the copy
+    for (size_t attempt = 0; ; attempt++) {
+        if (attempt == c_read_attempt_count) {
+            throw std::runtime_error(
+                "The shared config entry is never released by the daemon"
+            );
+        }
+
+        if (attempt >= c_read_spin_count)
+            std::this_thread::yield();
+
+        uint32_t sequence = entry.m_sequence.load(std::memory_order_acquire);
+
+        if (sequence & 1)
+            continue;
+
+        uint32_t size = entry.m_data_size.load(std::memory_order_relaxed);
+
+        if (size <= entry.m_data_capacity)
+            buffer.assign(payload, size);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (entry.m_sequence.load(std::memory_order_relaxed) == sequence)
+            break;
+    }
+
+    // Decode the copied payload
+    switch (entry.m_type) {
+        case SharedType::Int: {
+            int64_t value = 0;
+            std::memcpy(&value, buffer.data(), sizeof(value));
+            return static_cast<int>(value);
+        }
+
+        case SharedType::Bool:
+            return buffer[0] != 0;
+
+        case SharedType::Float: {
+            double value = 0;
+            std::memcpy(&value, buffer.data(), sizeof(value));
+            return value;
+        }
+
+        case SharedType::String:
+            return buffer;
+
+        case SharedType::ArrayInt: {
+            std::vector<int> values(buffer.size() / sizeof(int64_t));
+
+            for (size_t i = 0; i < values.size(); i++) {
+                int64_t value;
+                std::memcpy(
+                    &value,
+                    buffer.data() + i * sizeof(int64_t),
+                    sizeof(value)
+                );
+                values[i] = static_cast<int>(value);
+            }
+
+            return values;
+        }
+
+        case SharedType::ArrayFloat: {
+            std::vector<double> values(buffer.size() / sizeof(double));
+            std::memcpy(
+                values.data(),
+                buffer.data(),
+                values.size() * sizeof(double)
+            );
+
+            return values;
+        }
+
+        case SharedType::ArrayString: {
+            std::vector<std::string> values;
+            size_t position = 0;
+
+            while (position + sizeof(uint32_t) <= buffer.size()) {
+                uint32_t size;
+                std::memcpy(&size, buffer.data() + position, sizeof(size));
+                position += sizeof(size);
+
+                values.emplace_back(buffer, position, size);
+                position += size;
+            }
+
+            return values;
+        }
+
+        default:
+            return std::monostate();
+    }
+}
+
+} // namespace coil
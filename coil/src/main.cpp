@@ -1,9 +1,564 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
 
 #include "coil/coil.h"
+#include "coil/userFormat.h"
+
+// Storage format of the user configuration, like for the daemon
+constexpr const char* c_user_format_env = "COIL_USER_FORMAT";
+
+// Print the usage of the tool
+static void printUsage()
+{
+    std::cerr <<
+        "Usage:\n"
+        "  coil get <category:name>...\n"
+        "      Print the json value of each setting, one per line\n"
+        "  coil set <category:name>=<value>...\n"
+        "      Set the settings at once, the values are json. The value\n"
+        "      of a string setting can also be given without quotes\n"
+        "  coil dump [<category>...]\n"
+        "      Print the settings of the categories as json, all of\n"
+        "      them if no category is given\n"
+        "  coil load\n"
+        "      Set at once the settings of the json read from the\n"
+        "      standard input, grouped by category like dump prints\n"
+        "  coil watch [--debounce <ms>] <pattern>...\n"
+        "      Print a json line with the changed settings matching the\n"
+        "      glob patterns on category:name, at most once per\n"
+        "      debounce window\n"
+        "  coil export <user-file> [<json-file>]\n"
+        "      Write the user configuration as json, to the standard\n"
+        "      output if no json file is given\n"
+        "  coil import <json-file> <user-file>\n"
+        "      Replace the user configuration with the json file\n"
+        "\n"
+        "The get, set, dump, load and watch commands talk to the\n"
+        "daemon. The set and load commands read the type of the\n"
+        "given settings with a bus call per category, then set them\n"
+        "all in a single bus call, the other commands make a single\n"
+        "bus call. The export and import commands work on the user\n"
+        "file directly, its format is given by COIL_USER_FORMAT\n"
+        "(json, cbor or msgpack), else by the extension of the file.\n";
+}
+
+// Return the storage format of the given user configuration file
+//
+// Raise an exception if COIL_USER_FORMAT isn't a valid format
+static coil::UserFormat getUserFormat(const std::filesystem::path& path)
+{
+    if (const char* format_env = std::getenv(c_user_format_env)) {
+        if (auto format = coil::parseUserFormat(format_env))
+            return *format;
+
+        throw std::runtime_error(
+            std::string("Invalid COIL_USER_FORMAT value: ") + format_env
+        );
+    }
+
+    for (coil::UserFormat format : {
+        coil::UserFormat::Cbor,
+        coil::UserFormat::MessagePack
+    }) {
+        if (path.extension() == coil::getUserFormatExtension(format))
+            return format;
+    }
+
+    return coil::UserFormat::Json;
+}
+
+// Return the content of the given file
+//
+// Raise an exception if the file can't be read
+static std::string readFile(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file)
+        throw std::runtime_error("Can't open " + path.string());
+
+    return std::string(
+        std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>()
+    );
+}
+
+// Replace the content of the given file, the file is replaced
+// atomically so the daemon never reads a partial file
+//
+// Raise an exception if the file can't be written
+static void writeFile(
+    const std::filesystem::path& path,
+    const std::string& content
+) {
+    std::filesystem::path temp_path = path;
+    temp_path.replace_filename("." + path.filename().string() + ".tmp");
+
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file << content;
+        file.close();
+
+        if (!file)
+            throw std::runtime_error("Can't write " + temp_path.string());
+    }
+
+    std::filesystem::rename(temp_path, path);
+}
+
+// Return the json held by the content of a file in the given format
+//
+// Raise an exception if the content isn't valid
+static nlohmann::json decode(
+    const std::string& content,
+    coil::UserFormat format
+) {
+    switch (format) {
+        case coil::UserFormat::Cbor:
+            return nlohmann::json::from_cbor(content);
+        case coil::UserFormat::MessagePack:
+            return nlohmann::json::from_msgpack(content);
+        default:
+            return nlohmann::json::parse(content);
+    }
+}
+
+// Return the content of a file holding the json in the given format
+static std::string encode(
+    const nlohmann::json& json,
+    coil::UserFormat format
+) {
+    std::string content;
+
+    switch (format) {
+        case coil::UserFormat::Cbor:
+            nlohmann::json::to_cbor(json, content);
+            break;
+        case coil::UserFormat::MessagePack:
+            nlohmann::json::to_msgpack(json, content);
+            break;
+        default:
+            content = json.dump(4) + "\n";
+            break;
+    }
+
+    return content;
+}
+
+// Return the category and the name of a "category:name" key
+//
+// Raise an exception if the key has no category
+static std::pair<std::string, std::string> splitKey(std::string_view key)
+{
+    size_t separator = key.find(':');
+
+    if (separator == 0 || separator == std::string_view::npos)
+        throw std::runtime_error("Invalid setting " + std::string(key));
+
+    return {
+        std::string(key.substr(0, separator)),
+        std::string(key.substr(separator + 1))
+    };
+}
+
+// Return the json holding a setting value
+static nlohmann::json toJson(const coil::Client::Value& value)
+{
+    return std::visit([](const auto& data) -> nlohmann::json {
+        using Type = std::decay_t<decltype(data)>;
+
+        if constexpr (std::is_same_v<Type, std::monostate>) {
+            return nullptr;
+        } else {
+            return data;
+        }
+    }, value);
+}
+
+// Return the value of the json with the type of the current value of
+// the setting, the daemon doesn't convert the types
+//
+// Raise an exception if the json doesn't hold a value of that type
+static coil::Client::Value fromJson(
+    const nlohmann::json& json,
+    const coil::Client::Value& current,
+    std::string_view key
+) {
+    return std::visit([&](const auto& data) -> coil::Client::Value {
+        using Type = std::decay_t<decltype(data)>;
+
+        bool valid;
+
+        if constexpr (std::is_same_v<Type, int>) {
+            valid = json.is_number_integer();
+        } else if constexpr (std::is_same_v<Type, bool>) {
+            valid = json.is_boolean();
+        } else if constexpr (std::is_same_v<Type, double>) {
+            valid = json.is_number();
+        } else if constexpr (std::is_same_v<Type, std::string>) {
+            valid = json.is_string();
+        } else if constexpr (std::is_same_v<Type, std::monostate>) {
+            valid = false;
+        } else {
+            using Element = typename Type::value_type;
+
+            valid = json.is_array();
+
+            for (const auto& element : json) {
+                if constexpr (std::is_same_v<Element, int>) {
+                    valid = valid && element.is_number_integer();
+                } else if constexpr (std::is_same_v<Element, double>) {
+                    valid = valid && element.is_number();
+                } else {
+                    valid = valid && element.is_string();
+                }
+            }
+        }
+
+        if (!valid) {
+            throw std::runtime_error(
+                "Wrong value type for " + std::string(key)
+            );
+        }
+
+        if constexpr (std::is_same_v<Type, std::monostate>) {
+            return data;
+        } else {
+            return json.get<Type>();
+        }
+    }, current);
+}
+
+// Return the values of the json grouped by category, converted to
+// the type of the current values
+//
+// Raise an exception if a setting doesn't exist or if a value has
+// the wrong type
+static coil::Client::Config toConfig(
+    const nlohmann::json& json,
+    const coil::Client::Config& current
+) {
+    if (!json.is_object())
+        throw std::runtime_error("The settings must be an object");
+
+    coil::Client::Config config;
+
+    for (const auto& [category, values] : json.items()) {
+        if (!values.is_object()) {
+            throw std::runtime_error(
+                "The category " + category + " must be an object"
+            );
+        }
+
+        for (const auto& [name, value] : values.items()) {
+            std::string key = category + ":" + name;
+            auto current_category = current.find(category);
+
+            if (current_category == current.end() ||
+                current_category->second.count(name) == 0
+            ) {
+                throw std::runtime_error("Setting not found: " + key);
+            }
+
+            config[category].emplace(
+                name,
+                fromJson(value, current_category->second.at(name), key)
+            );
+        }
+    }
+
+    return config;
+}
+
+// Return the current values of the given settings, by category then by
+// name, with a bus call per category. They give the types of the values
+// to set
+//
+// Raise an exception if a category or a setting doesn't exist
+static coil::Client::Config getCurrent(
+    coil::Client& client,
+    const std::map<std::string, std::vector<std::string>>& settings
+) {
+    coil::Client::Config current;
+
+    for (const auto& [category, names] : settings) {
+        current[category] = client.getMany(category, names);
+    }
+
+    return current;
+}
+
+// Print the json value of each of the given settings, one per line
+//
+// Raise an exception if a setting doesn't exist
+static void getSettings(const std::vector<std::string_view>& keys)
+{
+    coil::Client client;
+    coil::Client::Config config = client.getAll();
+
+    for (auto key : keys) {
+        auto [category, name] = splitKey(key);
+        auto values = config.find(category);
+
+        if (values == config.end() || values->second.count(name) == 0)
+            throw std::runtime_error("Setting not found: " + std::string(key));
+
+        std::cout << toJson(values->second.at(name)).dump() << "\n";
+    }
+}
+
+// Set the given category:name=value settings at once
+//
+// Raise an exception if a setting doesn't exist or if a value has
+// the wrong type
+static void setSettings(const std::vector<std::string_view>& assignments)
+{
+    std::map<std::string, std::vector<std::string>> settings;
+
+    for (auto assignment : assignments) {
+        size_t separator = assignment.find('=');
+
+        if (separator == std::string_view::npos) {
+            throw std::runtime_error(
+                "Missing value for " + std::string(assignment)
+            );
+        }
+
+        auto [category, name] = splitKey(assignment.substr(0, separator));
+        settings[category].push_back(name);
+    }
+
+    // The current values give the types of the settings
+    coil::Client client;
+    coil::Client::Config current = getCurrent(client, settings);
+    coil::Client::Config config;
+
+    for (auto assignment : assignments) {
+        size_t separator = assignment.find('=');
+        std::string_view key = assignment.substr(0, separator);
+        std::string text(assignment.substr(separator + 1));
+        auto [category, name] = splitKey(key);
+
+        auto values = current.find(category);
+
+        if (values == current.end() || values->second.count(name) == 0)
+            throw std::runtime_error("Setting not found: " + std::string(key));
+
+        const coil::Client::Value& value = values->second.at(name);
+        nlohmann::json json = nlohmann::json::parse(text, nullptr, false);
+
+        // The value of a string setting can be given without quotes
+        if (std::holds_alternative<std::string>(value) && !json.is_string())
+            json = text;
+
+        config[category].insert_or_assign(name, fromJson(json, value, key));
+    }
+
+    client.apply(config);
+}
+
+// Print the settings of the given categories as json, all of them if
+// no category is given
+//
+// Raise an exception if a category doesn't exist
+static void dumpSettings(const std::vector<std::string_view>& categories)
+{
+    coil::Client client;
+    coil::Client::Config config = client.getAll();
+    nlohmann::json json = nlohmann::json::object();
+
+    for (const auto& [category, values] : config) {
+        nlohmann::json& category_json = json[category];
+        category_json = nlohmann::json::object();
+
+        for (const auto& [name, value] : values) {
+            category_json[name] = toJson(value);
+        }
+    }
+
+    if (!categories.empty()) {
+        nlohmann::json selected = nlohmann::json::object();
+
+        for (auto category : categories) {
+            std::string category_name(category);
+
+            if (!json.contains(category_name)) {
+                throw std::runtime_error(
+                    "Category not found: " + category_name
+                );
+            }
+
+            selected[category_name] = json[category_name];
+        }
+
+        json = std::move(selected);
+    }
+
+    std::cout << json.dump(4) << "\n";
+}
+
+// Set at once the settings of the json read from the standard input
+//
+// Raise an exception if the json isn't valid, if a setting doesn't
+// exist or if a value has the wrong type
+static void loadSettings()
+{
+    nlohmann::json json = nlohmann::json::parse(std::cin);
+
+    // Only the settings of the json are read, toConfig reports the
+    // invalid json
+    std::map<std::string, std::vector<std::string>> settings;
+
+    if (json.is_object()) {
+        for (const auto& [category, values] : json.items()) {
+            if (!values.is_object())
+                continue;
+
+            for (const auto& [name, value] : values.items()) {
+                settings[category].push_back(name);
+            }
+        }
+    }
+
+    coil::Client client;
+    client.apply(toConfig(json, getCurrent(client, settings)));
+}
+
+// Print a json line with the changed settings matching the patterns,
+// until the process is interrupted
+//
+// Raise an exception if the subscription fails
+static void watchSettings(
+    const std::vector<std::string>& patterns,
+    std::chrono::milliseconds debounce
+) {
+    coil::Client client;
+
+    client.watch(patterns, debounce, [](const coil::Client::Changes& changes) {
+        nlohmann::json json = nlohmann::json::object();
+
+        for (const auto& [key, value] : changes) {
+            json[key] = toJson(value);
+        }
+
+        // Flushed so a pipe reader gets each change right away
+        std::cout << json.dump() << std::endl;
+    });
+
+    // The changes are printed by the signal thread of the client
+    for (;;) {
+        pause();
+    }
+}
+
+// Write the user configuration file as json to the output file,
+// to the standard output if the output path is empty
+//
+// Raise an exception if the user file can't be read
+static void exportConfig(
+    const std::filesystem::path& user_path,
+    const std::filesystem::path& output_path
+) {
+    nlohmann::json json = decode(
+        readFile(user_path),
+        getUserFormat(user_path)
+    );
+
+    std::string content = json.dump(4) + "\n";
+
+    if (output_path.empty()) {
+        std::cout << content;
+    } else {
+        writeFile(output_path, content);
+    }
+}
+
+// Replace the user configuration file with the settings of the json
+// file, converted to the format of the user file
+//
+// Raise an exception if the json file isn't a valid user configuration
+static void importConfig(
+    const std::filesystem::path& json_path,
+    const std::filesystem::path& user_path
+) {
+    nlohmann::json json = nlohmann::json::parse(readFile(json_path));
+
+    if (!json.is_object())
+        throw std::runtime_error("The user configuration must be an object");
+
+    writeFile(user_path, encode(json, getUserFormat(user_path)));
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage();
+
+        return 1;
+    }
+
+    std::string_view command = argv[1];
+
+    std::vector<std::string_view> arguments(argv + 2, argv + argc);
+
+    try {
+        if (command == "get" && argc >= 3) {
+            getSettings(arguments);
+        } else if (command == "set" && argc >= 3) {
+            setSettings(arguments);
+        } else if (command == "dump") {
+            dumpSettings(arguments);
+        } else if (command == "load" && argc == 2) {
+            loadSettings();
+        } else if (command == "watch" && argc >= 3) {
+            std::chrono::milliseconds debounce(0);
+            std::vector<std::string> patterns;
+
+            for (size_t i = 0; i < arguments.size(); i++) {
+                if (arguments[i] == "--debounce" && i + 1 < arguments.size()) {
+                    debounce = std::chrono::milliseconds(
+                        std::stoul(std::string(arguments[++i]))
+                    );
+                } else {
+                    patterns.emplace_back(arguments[i]);
+                }
+            }
+
+            if (patterns.empty()) {
+                printUsage();
+
+                return 1;
+            }
+
+            watchSettings(patterns, debounce);
+        } else if (command == "export" && (argc == 3 || argc == 4)) {
+            exportConfig(argv[2], argc == 4 ? argv[3] : "");
+        } else if (command == "import" && argc == 4) {
+            importConfig(argv[2], argv[3]);
+        } else {
+            printUsage();
+
+            return 1;
+        }
+    } catch (std::exception& e) {
+        std::cerr << "coil " << command << ": " << e.what() << std::endl;
 
-int main() {
-    std::cout << "Hello world" << std::endl;
+        return 1;
+    }
 
     return 0;
 }